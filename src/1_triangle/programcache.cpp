@@ -0,0 +1,230 @@
+#include "programcache.hpp"
+#include "trace.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// In front of every binary. format is what glGetProgramBinary() gave,
+	// size the bytes that follow.
+	struct BinaryHeader
+	{
+		char magic[4];
+		uint32_t format;
+		uint32_t size;
+		uint32_t reserved;
+	};
+
+	const char kMagic[4] = { 'G', 'L', 'P', 'B' };
+
+	// Counted from ShaderReloader's thread too.
+	std::string g_directory;
+	std::atomic<int> g_hits(0);
+	std::atomic<int> g_misses(0);
+
+	bool supported()
+	{
+		if (g_directory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+			return false;
+
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+
+	// 64-bit FNV-1a; every string goes in with its terminator so moving
+	// text from one source to the next changes the hash.
+	void hash(uint64_t& h, const char* text)
+	{
+		if (!text)
+			text = "";
+
+		do {
+			h ^= (unsigned char)*text;
+			h *= 1099511628211ull;
+		} while (*text++);
+	}
+
+	std::string binaryPath(const char* const* sources, int count)
+	{
+		uint64_t h = 14695981039346656037ull;
+		for (int i = 0; i < count; ++i)
+			hash(h, sources[i]);
+
+		hash(h, (const char*)glGetString(GL_VENDOR));
+		hash(h, (const char*)glGetString(GL_RENDERER));
+		hash(h, (const char*)glGetString(GL_VERSION));
+
+		char name[32];
+		snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)h);
+		return g_directory + name;
+	}
+
+	bool readFile(const std::string& path, std::vector<char>* data)
+	{
+		FILE* file = fopen(path.c_str(), "rb");
+		if (!file)
+			return false;
+
+		fseek(file, 0, SEEK_END);
+		long size = ftell(file);
+		fseek(file, 0, SEEK_SET);
+
+		data->resize(size > 0 ? (size_t)size : 0);
+		bool read = size > 0 && fread(&(*data)[0], 1, data->size(), file) == data->size();
+		fclose(file);
+
+		return read;
+	}
+
+	// Written under a name of its own, then renamed over path, so runs
+	// started together never read half a binary.
+	bool writeFile(const std::string& path, const BinaryHeader& header, const std::vector<char>& binary)
+	{
+#ifdef _WIN32
+		_mkdir(g_directory.c_str());
+		unsigned long process = GetCurrentProcessId();
+#else
+		mkdir(g_directory.c_str(), 0755);
+		unsigned long process = (unsigned long)getpid();
+#endif
+
+		char suffix[32];
+		snprintf(suffix, sizeof(suffix), ".%lu.tmp", process);
+		std::string temporary = path + suffix;
+
+		FILE* file = fopen(temporary.c_str(), "wb");
+		if (!file)
+			return false;
+
+		bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+			fwrite(&binary[0], 1, binary.size(), file) == binary.size();
+		written = fclose(file) == 0 && written;
+
+#ifdef _WIN32
+		written = written && MoveFileExA(temporary.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+		written = written && rename(temporary.c_str(), path.c_str()) == 0;
+#endif
+		if (!written)
+			remove(temporary.c_str());
+
+		return written;
+	}
+}
+
+void ProgramCache::setDirectory(const char* path)
+{
+	g_directory = path ? path : "";
+
+	// Without the separator binaryPath() adds.
+	while (g_directory.size() > 1 && (g_directory.back() == '/' || g_directory.back() == '\\'))
+		g_directory.pop_back();
+}
+
+const char* ProgramCache::directory()
+{
+	return g_directory.c_str();
+}
+
+unsigned int ProgramCache::load(const char* const* sources, int count)
+{
+	if (!supported())
+		return 0;
+
+	TRACE_ZONE("ProgramCache::load");
+
+	std::vector<char> data;
+	const BinaryHeader* header = nullptr;
+	if (readFile(binaryPath(sources, count), &data) && data.size() >= sizeof(BinaryHeader)) {
+		header = (const BinaryHeader*)&data[0];
+		if (memcmp(header->magic, kMagic, sizeof(kMagic)) != 0 ||
+				header->size != data.size() - sizeof(BinaryHeader))
+			header = nullptr;
+	}
+
+	if (!header) {
+		++g_misses;
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, header->format, &data[sizeof(BinaryHeader)], (GLsizei)header->size);
+
+	// A driver that changed without changing its strings, or a binary it
+	// no longer takes for any other reason.
+	GLint linked = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linked);
+	if (!linked) {
+		glDeleteProgram(program);
+		++g_misses;
+		return 0;
+	}
+
+	++g_hits;
+	return program;
+}
+
+void ProgramCache::markRetrievable(unsigned int program)
+{
+	if (supported())
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+void ProgramCache::store(unsigned int program, const char* const* sources, int count)
+{
+	if (!supported())
+		return;
+
+	TRACE_ZONE("ProgramCache::store");
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, &binary[0]);
+	binary.resize(length);
+	if (binary.empty())
+		return;
+
+	BinaryHeader header;
+	memcpy(header.magic, kMagic, sizeof(kMagic));
+	header.format = format;
+	header.size = (uint32_t)binary.size();
+	header.reserved = 0;
+
+	std::string path = binaryPath(sources, count);
+	if (!writeFile(path, header, binary))
+		fprintf(stderr, "Error: cannot write program cache %s\n", path.c_str());
+}
+
+int ProgramCache::hits()
+{
+	return g_hits.load();
+}
+
+int ProgramCache::misses()
+{
+	return g_misses.load();
+}
@@ -52,6 +52,11 @@ int main(int argc, char** argv)
 	}
 
 	helloSample = new HelloSample();
+	if (!helloSample->parseArguments(argc, argv)) {
+		delete helloSample;
+		return EXIT_FAILURE;
+	}
+
 	helloSample->init();
 
 	helloSample->run();
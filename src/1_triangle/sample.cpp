@@ -1,42 +1,458 @@
 #include "sample.hpp"
+#include "benchmark.hpp"
+#include "programcache.hpp"
+#include "shaderpack.hpp"
+#include "trace.hpp"
 
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <cassert>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#ifdef SAMPLE_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#endif
+
+#ifdef SAMPLE_SHADER_PACK_EMBEDDED
+// From packshaders --embed, built into the sample.
+extern const unsigned char g_shaderPack[];
+extern const size_t g_shaderPackSize;
+#endif
+
+static void window_size_callback(GLFWwindow* window, int width, int height);
+
 class Sample_Impl {
+	friend void window_size_callback(GLFWwindow*, int, int);
 public:
-	Sample_Impl()
-		: _GLFWwindow(nullptr)
+	// Frames the offscreen backend lets the GPU run behind the CPU,
+	// mirroring what a double-buffered swap chain would allow.
+	static const int kFramesInFlight = 2;
+
+	Sample_Impl(int contextMajor, int contextMinor)
+		: _GLFWwindow(nullptr), _sharedWindow(nullptr), _windowWidth(640), _windowHeight(480),
+		_contextMajor(contextMajor), _contextMinor(contextMinor), _contextReady(false),
+		_backend(SAMPLE_BACKEND_WINDOW), _frameLimit(0), _frameCount(0),
+		_benchmarking(false), _warmupFrames(60), _benchmarkOutput("bench.json"),
+		_gpuProfiling(false), _programCache("programcache"), _threaded(false),
+		_offscreenFBO(0), _offscreenColorRBO(0), _offscreenDepthRBO(0)
 	{
+		memset(_frameFences, 0, sizeof(_frameFences));
+
+#ifdef SAMPLE_HAVE_EGL
+		_eglDisplay = EGL_NO_DISPLAY;
+		_eglContext = EGL_NO_CONTEXT;
+		_eglSurface = EGL_NO_SURFACE;
+		_eglConfig = nullptr;
+		_eglSurfaceless = false;
+		_eglSharedContext = EGL_NO_CONTEXT;
+		_eglSharedSurface = EGL_NO_SURFACE;
+#endif
+	}
+
+	bool parseArguments(int argc, char** argv)
+	{
+		if (argc > 0) {
+			const char* name = strrchr(argv[0], '/');
+			_name = name ? name + 1 : argv[0];
+			_executable = argv[0];
+		}
+
+		for (int i = 1; i < argc; ++i) {
+			if (strcmp(argv[i], "--offscreen") == 0) {
+				_backend = SAMPLE_BACKEND_OFFSCREEN;
+			}
+			else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+				_frameLimit = atoi(argv[++i]);
+				if (_frameLimit < 0) {
+					fprintf(stderr, "Error: invalid frame count %s\n", argv[i]);
+					return false;
+				}
+			}
+			else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+				int width = 0, height = 0;
+				if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 ||
+						width <= 0 || height <= 0) {
+					fprintf(stderr, "Error: invalid size %s\n", argv[i]);
+					return false;
+				}
+
+				_windowWidth = width;
+				_windowHeight = height;
+			}
+			else if (strcmp(argv[i], "--bench") == 0) {
+				_benchmarking = true;
+			}
+			else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc) {
+				_warmupFrames = atoi(argv[++i]);
+				if (_warmupFrames < 0) {
+					fprintf(stderr, "Error: invalid warm-up frame count %s\n", argv[i]);
+					return false;
+				}
+			}
+			else if (strcmp(argv[i], "--bench-output") == 0 && i + 1 < argc) {
+				_benchmarkOutput = argv[++i];
+			}
+			else if (strcmp(argv[i], "--gpu-profile") == 0) {
+				_gpuProfiling = true;
+			}
+			else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+				_tracePath = argv[++i];
+			}
+			else if (strcmp(argv[i], "--program-cache") == 0 && i + 1 < argc) {
+				_programCache = argv[++i];
+			}
+			else if (strcmp(argv[i], "--shader-pack") == 0 && i + 1 < argc) {
+				_shaderPackPath = argv[++i];
+			}
+			else if (strcmp(argv[i], "--threaded") == 0) {
+				_threaded = true;
+			}
+		}
+
+		ProgramCache::setDirectory(_programCache == "none" ? nullptr : _programCache.c_str());
+
+		// Start right away so shader loading in init() shows up as well.
+		if (!_tracePath.empty()) {
+			Trace::start();
+			Trace::setThreadName("main");
+		}
+
+		if (!_benchmarking)
+			_warmupFrames = 0;
+		else if (_frameLimit == 0)
+			_frameLimit = 300;
+
+#ifndef SAMPLE_HAVE_EGL
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN) {
+			fprintf(stderr, "Error: offscreen backend needs EGL (build with SAMPLE_HAVE_EGL)\n");
+			return false;
+		}
+#endif
+
+		return openShaderPack();
 	}
 
 	bool init()
+	{
+		bool initialized = _backend == SAMPLE_BACKEND_OFFSCREEN ?
+			initOffscreen() : initWindow();
+		if (!initialized)
+			return false;
+
+		if (_gpuProfiling || _benchmarking) {
+			_gpuProfiler.init();
+			_gpuProfiler.setEnabled(true);
+		}
+
+		return true;
+	}
+
+	void destroy()
+	{
+		if (_contextReady)
+			_gpuProfiler.destroy();
+
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN) {
+			destroyOffscreen();
+		}
+		else {
+			if (_sharedWindow)
+				glfwDestroyWindow(_sharedWindow);
+			_sharedWindow = nullptr;
+
+			glfwTerminate();
+		}
+		_contextReady = false;
+
+		ShaderSource::setPack(nullptr);
+		_shaderPack.close();
+
+		if (!_tracePath.empty())
+			Trace::write(_tracePath.c_str());
+	}
+
+	bool contextReady() const { return _contextReady; }
+
+	bool is_running() const
+	{
+		if (_frameLimit > 0 && _frameCount >= _warmupFrames + _frameLimit)
+			return false;
+
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN)
+			return true;
+
+		return !glfwWindowShouldClose(_GLFWwindow);
+	}
+
+	double time() const
+	{
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN) {
+			using namespace std::chrono;
+			return duration<double>(steady_clock::now().time_since_epoch()).count();
+		}
+
+		return glfwGetTime();
+	}
+
+	void beginFrame()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
+
+		if (_gpuProfiler.beginFrame())
+			reportGpuTimings();
+
+		_gpuProfiler.beginZone("frame");
+	}
+
+	void endFrame()
+	{
+		_gpuProfiler.endZone();
+		_gpuProfiler.endFrame();
+
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN) {
+			// Nothing is presented, so throttle on a fence instead of a swap
+			// to keep the CPU from queueing an unbounded amount of work.
+			GLsync& fence = _frameFences[_frameCount % kFramesInFlight];
+			if (fence) {
+				TRACE_ZONE("glClientWaitSync");
+
+				glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(fence);
+			}
+
+			fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			glFlush();
+		}
+		else {
+			{
+				TRACE_ZONE("glfwSwapBuffers");
+				glfwSwapBuffers(_GLFWwindow);
+			}
+			{
+				TRACE_ZONE("glfwPollEvents");
+				glfwPollEvents();
+			}
+		}
+
+		++_frameCount;
+	}
+
+	Benchmark* benchmark()
+	{
+		if (!_benchmarking || _frameCount < _warmupFrames)
+			return nullptr;
+
+		return &_benchmark;
+	}
+
+	void reportGpuTimings()
+	{
+		const std::vector<GpuTiming>& timings = _gpuProfiler.timings();
+
+		if (Benchmark* bench = benchmark()) {
+			for (const GpuTiming& timing : timings)
+				bench->record("gpu_" + timing.name + "_ms", timing.milliseconds);
+		}
+
+		if (_gpuProfiling && _frameCount % 60 == 0) {
+			fprintf(stderr, "gpu:");
+			for (const GpuTiming& timing : timings)
+				fprintf(stderr, " %s %.3f ms", timing.name.c_str(), timing.milliseconds);
+			fprintf(stderr, "\n");
+		}
+	}
+
+	Benchmark* report() { return &_benchmark; }
+
+	bool reportBenchmark()
+	{
+		if (!_benchmarking)
+			return true;
+
+		_benchmark.setProperty("sample", _name);
+		_benchmark.setProperty("backend",
+				_backend == SAMPLE_BACKEND_OFFSCREEN ? "offscreen" : "window");
+		_benchmark.setProperty("renderer", (const char*)glGetString(GL_RENDERER));
+		_benchmark.setProperty("width", _windowWidth);
+		_benchmark.setProperty("height", _windowHeight);
+		_benchmark.setProperty("warmup_frames", _warmupFrames);
+		_benchmark.setProperty("frames", _frameCount - _warmupFrames);
+		_benchmark.setProperty("gpu_dropped_frames", _gpuProfiler.droppedFrames());
+		_benchmark.setProperty("threaded", _threaded ? "yes" : "no");
+		_benchmark.setProperty("program_cache", _programCache);
+		_benchmark.setProperty("program_cache_hits", ProgramCache::hits());
+		_benchmark.setProperty("program_cache_misses", ProgramCache::misses());
+		_benchmark.setProperty("shader_pack", _shaderPackSource);
+
+		if (_benchmarkOutput == "-") {
+			_benchmark.writeJSON(stdout);
+			return true;
+		}
+
+		return _benchmark.writeJSON(_benchmarkOutput.c_str());
+	}
+
+	GLFWwindow* window() { return _GLFWwindow; }
+	int windowWidth() const { return _windowWidth; }
+	int windowHeight() const { return _windowHeight; }
+
+	bool createSharedContext()
+	{
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN)
+			return createSharedOffscreen();
+
+		if (_sharedWindow)
+			return true;
+
+		// A hidden window is the only way GLFW hands out a second context.
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+		_sharedWindow = glfwCreateWindow(1, 1, "", nullptr, _GLFWwindow);
+		glfwWindowHint(GLFW_VISIBLE, GL_TRUE);
+
+		if (!_sharedWindow) {
+			fprintf(stderr, "Error: cannot create a shared context\n");
+			return false;
+		}
+
+		return true;
+	}
+
+	bool makeSharedContextCurrent(bool current)
+	{
+		if (_backend == SAMPLE_BACKEND_OFFSCREEN)
+			return makeSharedOffscreenCurrent(current);
+
+		if (!_sharedWindow)
+			return false;
+
+		glfwMakeContextCurrent(current ? _sharedWindow : nullptr);
+		return true;
+	}
+
+	SampleBackend backend() const { return _backend; }
+	bool threaded() const { return _threaded; }
+	void setThreaded(bool threaded) { _threaded = threaded; }
+	GpuProfiler* gpuProfiler() { return &_gpuProfiler; }
+	GLuint defaultFramebuffer() const { return _offscreenFBO; }
+
+private:
+	// --shader-pack, or the pack built into the sample, or shaders.pack
+	// next to the executable, wherever it was started from. Without any of
+	// them the shaders are read from the working directory.
+	bool openShaderPack()
+	{
+		TRACE_ZONE("openShaderPack");
+
+		_shaderPackSource = "none";
+		if (_shaderPackPath == "none")
+			return true;
+
+		if (!_shaderPackPath.empty()) {
+			if (!_shaderPack.open(_shaderPackPath.c_str()))
+				return false;
+			_shaderPackSource = _shaderPackPath;
+		}
+		else {
+#ifdef SAMPLE_SHADER_PACK_EMBEDDED
+			if (!_shaderPack.open(g_shaderPack, g_shaderPackSize, "the embedded shader pack"))
+				return false;
+			_shaderPackSource = "embedded";
+#else
+			std::string path = executableDirectory() + "shaders.pack";
+			FILE* file = fopen(path.c_str(), "rb");
+			if (!file)
+				return true;
+			fclose(file);
+
+			if (!_shaderPack.open(path.c_str()))
+				return false;
+			_shaderPackSource = path;
+#endif
+		}
+
+		ShaderSource::setPack(&_shaderPack);
+		return true;
+	}
+
+	// With its separator, or empty when only the working directory is known.
+	std::string executableDirectory() const
+	{
+		std::string path = _executable;
+
+#ifdef _WIN32
+		char module[MAX_PATH];
+		DWORD length = GetModuleFileNameA(nullptr, module, MAX_PATH);
+		if (length > 0 && length < MAX_PATH)
+			path.assign(module, length);
+#elif defined(__linux__)
+		char link[4096];
+		ssize_t length = readlink("/proc/self/exe", link, sizeof(link));
+		if (length > 0 && length < (ssize_t)sizeof(link))
+			path.assign(link, length);
+#endif
+
+		size_t separator = path.find_last_of("/\\");
+		return separator == std::string::npos ? std::string() : path.substr(0, separator + 1);
+	}
+
+	bool initWindow()
 	{
 		if (!glfwInit())
 				return false;
 
 		glfwWindowHint(GLFW_SAMPLES, 4);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, _contextMajor);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, _contextMinor);
 		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-		_GLFWwindow = glfwCreateWindow(640, 480, "Hello World", nullptr, nullptr);
+		_GLFWwindow = glfwCreateWindow(_windowWidth, _windowHeight,
+				"Hello World", nullptr, nullptr);
 		if (!_GLFWwindow)
 		{
 			glfwTerminate();
 			return false;
 		}
 
+		glfwSetWindowUserPointer(_GLFWwindow, this);
+		glfwSetWindowSizeCallback(_GLFWwindow, window_size_callback);
+
 		glfwMakeContextCurrent(_GLFWwindow);
 
+		return initGLEW();
+	}
+
+	bool initGLEW()
+	{
 		glewExperimental = true; // Needed for core profile
 		GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+		// GLEW built for GLX complains about the missing display after it
+		// has already loaded every entry point, which is all we need.
+		if (err == GLEW_ERROR_NO_GLX_DISPLAY && _backend == SAMPLE_BACKEND_OFFSCREEN)
+			err = GLEW_OK;
+#endif
 		if (GLEW_OK != err) {
-			fprintf(stderr, "Error: %s\n", 
+			fprintf(stderr, "Error: %s\n",
 					glewGetErrorString(err));
 
 			return false;
@@ -44,24 +460,279 @@ public:
 
 		fprintf(stderr, "%s\n", glGetString(GL_VERSION));
 
+		_contextReady = true;
 		return true;
 	}
 
-	void destroy()
+#ifdef SAMPLE_HAVE_EGL
+	bool initOffscreen()
 	{
-		glfwTerminate();
+		// Prefer Mesa's surfaceless platform so no X or Wayland server is
+		// needed; other drivers get whatever the default display is.
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (clientExtensions && strstr(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+				(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay)
+				_eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+		}
+
+		if (_eglDisplay == EGL_NO_DISPLAY)
+			_eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+		if (_eglDisplay == EGL_NO_DISPLAY || !eglInitialize(_eglDisplay, nullptr, nullptr)) {
+			fprintf(stderr, "Error: cannot initialize EGL display\n");
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API)) {
+			fprintf(stderr, "Error: EGL has no desktop OpenGL support\n");
+			return false;
+		}
+
+		const char* displayExtensions = eglQueryString(_eglDisplay, EGL_EXTENSIONS);
+		bool surfaceless = displayExtensions &&
+			strstr(displayExtensions, "EGL_KHR_surfaceless_context") != nullptr;
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(_eglDisplay, configAttributes, &_eglConfig, 1, &numConfigs) ||
+				numConfigs == 0) {
+			fprintf(stderr, "Error: no suitable EGL config\n");
+			return false;
+		}
+
+		_eglSurfaceless = surfaceless;
+		_eglContext = createEGLContext(EGL_NO_CONTEXT);
+		if (_eglContext == EGL_NO_CONTEXT) {
+			fprintf(stderr, "Error: cannot create OpenGL %d.%d core context\n",
+					_contextMajor, _contextMinor);
+			return false;
+		}
+
+		if (!surfaceless) {
+			_eglSurface = createEGLPbuffer();
+			if (_eglSurface == EGL_NO_SURFACE)
+				return false;
+		}
+
+		if (!eglMakeCurrent(_eglDisplay, _eglSurface, _eglSurface, _eglContext)) {
+			fprintf(stderr, "Error: cannot make EGL context current\n");
+			return false;
+		}
+
+		if (!initGLEW())
+			return false;
+
+		// The color target samples render into in place of a window.
+		glGenRenderbuffers(1, &_offscreenColorRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, _offscreenColorRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _windowWidth, _windowHeight);
+
+		glGenRenderbuffers(1, &_offscreenDepthRBO);
+		glBindRenderbuffer(GL_RENDERBUFFER, _offscreenDepthRBO);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _windowWidth, _windowHeight);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &_offscreenFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, _offscreenFBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+				GL_RENDERBUFFER, _offscreenColorRBO);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+				GL_RENDERBUFFER, _offscreenDepthRBO);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "Error: offscreen framebuffer is incomplete\n");
+			return false;
+		}
+
+		return true;
 	}
 
-	GLFWwindow* window() { return _GLFWwindow; }
+	EGLContext createEGLContext(EGLContext share)
+	{
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, _contextMajor,
+			EGL_CONTEXT_MINOR_VERSION, _contextMinor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_CONTEXT_OPENGL_FORWARD_COMPATIBLE, EGL_TRUE,
+			EGL_NONE
+		};
+
+		return eglCreateContext(_eglDisplay, _eglConfig, share, contextAttributes);
+	}
+
+	EGLSurface createEGLPbuffer()
+	{
+		const EGLint pbufferAttributes[] = {
+			EGL_WIDTH, 1,
+			EGL_HEIGHT, 1,
+			EGL_NONE
+		};
+
+		EGLSurface surface = eglCreatePbufferSurface(_eglDisplay, _eglConfig, pbufferAttributes);
+		if (surface == EGL_NO_SURFACE)
+			fprintf(stderr, "Error: cannot create pbuffer surface\n");
+
+		return surface;
+	}
+
+	// A surface is current on one thread at most, so the shared context
+	// gets a pbuffer of its own where it needs one.
+	bool createSharedOffscreen()
+	{
+		if (_eglSharedContext != EGL_NO_CONTEXT)
+			return true;
+
+		_eglSharedContext = createEGLContext(_eglContext);
+		if (_eglSharedContext == EGL_NO_CONTEXT) {
+			fprintf(stderr, "Error: cannot create a shared context\n");
+			return false;
+		}
+
+		if (!_eglSurfaceless) {
+			_eglSharedSurface = createEGLPbuffer();
+			if (_eglSharedSurface == EGL_NO_SURFACE)
+				return false;
+		}
+
+		return true;
+	}
+
+	bool makeSharedOffscreenCurrent(bool current)
+	{
+		if (_eglSharedContext == EGL_NO_CONTEXT)
+			return false;
+
+		if (!current)
+			return eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT) == EGL_TRUE;
+
+		// The bound API is per thread, and EGL starts every thread on GLES.
+		return eglBindAPI(EGL_OPENGL_API) &&
+			eglMakeCurrent(_eglDisplay, _eglSharedSurface, _eglSharedSurface, _eglSharedContext);
+	}
+
+	void destroyOffscreen()
+	{
+		if (_eglSharedContext != EGL_NO_CONTEXT) {
+			eglDestroyContext(_eglDisplay, _eglSharedContext);
+			_eglSharedContext = EGL_NO_CONTEXT;
+		}
+
+		if (_eglSharedSurface != EGL_NO_SURFACE) {
+			eglDestroySurface(_eglDisplay, _eglSharedSurface);
+			_eglSharedSurface = EGL_NO_SURFACE;
+		}
+
+		if (_eglContext != EGL_NO_CONTEXT) {
+			if (_contextReady) {
+				for (int i = 0; i < kFramesInFlight; ++i) {
+					if (_frameFences[i])
+						glDeleteSync(_frameFences[i]);
+					_frameFences[i] = 0;
+				}
+
+				glDeleteFramebuffers(1, &_offscreenFBO);
+				glDeleteRenderbuffers(1, &_offscreenColorRBO);
+				glDeleteRenderbuffers(1, &_offscreenDepthRBO);
+				_offscreenFBO = 0;
+			}
+
+			eglMakeCurrent(_eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(_eglDisplay, _eglContext);
+			_eglContext = EGL_NO_CONTEXT;
+		}
+
+		if (_eglSurface != EGL_NO_SURFACE) {
+			eglDestroySurface(_eglDisplay, _eglSurface);
+			_eglSurface = EGL_NO_SURFACE;
+		}
+
+		if (_eglDisplay != EGL_NO_DISPLAY) {
+			eglTerminate(_eglDisplay);
+			_eglDisplay = EGL_NO_DISPLAY;
+		}
+	}
+#else
+	bool initOffscreen() { return false; }
+	bool createSharedOffscreen() { return false; }
+	bool makeSharedOffscreenCurrent(bool) { return false; }
+	void destroyOffscreen() {}
+#endif
 
-private:
 	GLFWwindow* _GLFWwindow;
+	GLFWwindow* _sharedWindow;
+	int _windowWidth;
+	int _windowHeight;
+
+	int _contextMajor;
+	int _contextMinor;
+
+	// Current and with GL loaded, so GL objects can be made and deleted,
+	// even if init() went no further.
+	bool _contextReady;
+
+	SampleBackend _backend;
+	int _frameLimit;
+	int _frameCount;
+
+	std::string _name;
+	bool _benchmarking;
+	int _warmupFrames;
+	std::string _benchmarkOutput;
+	Benchmark _benchmark;
+
+	bool _gpuProfiling;
+	GpuProfiler _gpuProfiler;
+
+	std::string _tracePath;
+	std::string _programCache;
+
+	std::string _executable;
+	std::string _shaderPackPath;
+	std::string _shaderPackSource;
+	ShaderPack _shaderPack;
+
+	bool _threaded;
+
+	GLuint _offscreenFBO;
+	GLuint _offscreenColorRBO, _offscreenDepthRBO;
+	GLsync _frameFences[kFramesInFlight];
+
+#ifdef SAMPLE_HAVE_EGL
+	EGLDisplay _eglDisplay;
+	EGLContext _eglContext;
+	EGLSurface _eglSurface;
+	EGLConfig _eglConfig;
+	bool _eglSurfaceless;
+
+	EGLContext _eglSharedContext;
+	EGLSurface _eglSharedSurface;
+#endif
 };
 
-Sample::Sample()
+static void window_size_callback(GLFWwindow* window, int width, int height)
+{
+	Sample_Impl* impl = (Sample_Impl*)glfwGetWindowUserPointer(window);
+
+	impl->_windowWidth = width;
+	impl->_windowHeight = height;
+}
+
+
+Sample::Sample(int contextMajor, int contextMinor)
 	: impl(nullptr)
 {
-	impl = new Sample_Impl();
+	impl = new Sample_Impl(contextMajor, contextMinor);
 }
 
 Sample::~Sample()
@@ -69,14 +740,32 @@ Sample::~Sample()
 	delete impl;
 }
 
+bool Sample::parseArguments(int argc, char** argv)
+{
+	assert(impl);
+	return impl->parseArguments(argc, argv);
+}
+
 bool Sample::init()
 {
 	assert(impl);
+	double start = Benchmark::now();
+
 	if (!impl->init())
 		return false;
 
-	if (!initContents())
-		return false;
+	double contentsStart = Benchmark::now();
+	{
+		TRACE_ZONE("initContents");
+		if (!initContents())
+			return false;
+	}
+
+	// Context creation to the first frame, and the part of it that is the
+	// sample's own, where the program cache saves.
+	double end = Benchmark::now();
+	impl->report()->setProperty("startup_ms", (end - start) * 1000.0);
+	impl->report()->setProperty("init_contents_ms", (end - contentsStart) * 1000.0);
 
 	return true;
 }
@@ -84,26 +773,241 @@ bool Sample::init()
 void Sample::destroy()
 {
 	assert(impl);
-	destroyContents();
+
+	// After a failed init(), what initContents() got to; nothing without
+	// a context.
+	if (impl->contextReady())
+		destroyContents();
 
 	impl->destroy();
 }
 
+bool Sample::createSharedContext()
+{
+	assert(impl);
+	return impl->createSharedContext();
+}
+
+bool Sample::makeSharedContextCurrent(bool current)
+{
+	assert(impl);
+	return impl->makeSharedContextCurrent(current);
+}
+
 bool Sample::is_running() const
 {
 	assert(impl);
-	return !glfwWindowShouldClose(impl->window());
+	return impl->is_running();
+}
+
+// Runs update() one frame ahead on a simulation thread. The simulation
+// starts frame N+1 as soon as render() has taken frame N, so the two
+// overlap while neither gets more than one frame ahead of the other.
+static void runThreaded(Sample* sample, Sample_Impl* impl)
+{
+	std::mutex mutex;
+	std::condition_variable framesChanged;
+	unsigned long framesProduced = 0, framesConsumed = 0;
+	bool stopping = false;
+
+	std::atomic<double> lastUpdateMilliseconds(0.0);
+
+	std::thread simulation([&]() {
+		if (Trace::enabled())
+			Trace::setThreadName("simulation");
+
+		double lastTime = impl->time();
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				framesChanged.wait(lock, [&]() {
+					return stopping || framesProduced == framesConsumed;
+				});
+
+				if (stopping)
+					break;
+			}
+
+			double currentTime = impl->time();
+			double updateStart = Benchmark::now();
+
+			{
+				TRACE_ZONE("update");
+				sample->update(currentTime - lastTime);
+			}
+
+			lastTime = currentTime;
+			lastUpdateMilliseconds.store((Benchmark::now() - updateStart) * 1000.0);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				++framesProduced;
+			}
+			framesChanged.notify_all();
+		}
+	});
+
+	while (sample->is_running()) {
+		Benchmark* bench = impl->benchmark();
+
+		double waitStart = Benchmark::now();
+
+		{
+			TRACE_ZONE("waitForSimulation");
+
+			std::unique_lock<std::mutex> lock(mutex);
+			framesChanged.wait(lock, [&]() { return framesProduced > framesConsumed; });
+			++framesConsumed;
+		}
+		framesChanged.notify_all();
+
+		double renderStart = Benchmark::now();
+
+		impl->beginFrame();
+		{
+			TRACE_ZONE("render");
+			sample->render();
+		}
+
+		double swapStart = Benchmark::now();
+
+		impl->endFrame();
+
+		double frameEnd = Benchmark::now();
+
+		if (bench) {
+			bench->record("update_ms", lastUpdateMilliseconds.load());
+			bench->record("wait_ms", (renderStart - waitStart) * 1000.0);
+			bench->record("render_ms", (swapStart - renderStart) * 1000.0);
+			bench->record("swap_ms", (frameEnd - swapStart) * 1000.0);
+			bench->record("frame_ms", (frameEnd - waitStart) * 1000.0);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	framesChanged.notify_all();
+
+	simulation.join();
 }
 
 void Sample::run()
 {
 	assert(impl);
 
+	if (impl->threaded()) {
+		if (supportsThreadedUpdate()) {
+			runThreaded(this, impl);
+			impl->reportBenchmark();
+			return;
+		}
+
+		fprintf(stderr, "update() of this sample needs the GL context, running single-threaded\n");
+		impl->setThreaded(false);
+	}
+
+	double lastTime = impl->time();
+
 	while (is_running()) {
-		update(0.0f);
-		render();
+		Benchmark* bench = impl->benchmark();
+
+		double currentTime = impl->time();
+		double updateStart = Benchmark::now();
 
-		glfwSwapBuffers(impl->window());
-		glfwPollEvents();
+		{
+			TRACE_ZONE("update");
+			update(currentTime - lastTime);
+		}
+
+		lastTime = currentTime;
+
+		double renderStart = Benchmark::now();
+
+		impl->beginFrame();
+		{
+			TRACE_ZONE("render");
+			render();
+		}
+
+		double swapStart = Benchmark::now();
+
+		impl->endFrame();
+
+		double frameEnd = Benchmark::now();
+
+		if (bench) {
+			bench->record("update_ms", (renderStart - updateStart) * 1000.0);
+			bench->record("render_ms", (swapStart - renderStart) * 1000.0);
+			bench->record("swap_ms", (frameEnd - swapStart) * 1000.0);
+			bench->record("frame_ms", (frameEnd - updateStart) * 1000.0);
+		}
 	}
+
+	impl->reportBenchmark();
+}
+
+int Sample::windowWidth() const
+{
+	assert(impl);
+
+	return impl->windowWidth();
+}
+
+int Sample::windowHeight() const
+{
+	assert(impl);
+
+	return impl->windowHeight();
+}
+
+SampleBackend Sample::backend() const
+{
+	assert(impl);
+
+	return impl->backend();
+}
+
+unsigned int Sample::defaultFramebuffer() const
+{
+	assert(impl);
+
+	return impl->defaultFramebuffer();
+}
+
+Benchmark* Sample::benchmark() const
+{
+	assert(impl);
+
+	return impl->benchmark();
+}
+
+void Sample::setBenchmarkProperty(const char* key, const char* value)
+{
+	assert(impl);
+
+	impl->report()->setProperty(key, value);
+}
+
+void Sample::setBenchmarkProperty(const char* key, double value)
+{
+	assert(impl);
+
+	impl->report()->setProperty(key, value);
+}
+
+GpuProfiler* Sample::gpuProfiler() const
+{
+	assert(impl);
+
+	return impl->gpuProfiler();
+}
+
+const std::vector<GpuTiming>& Sample::gpuTimings() const
+{
+	assert(impl);
+
+	return impl->gpuProfiler()->timings();
 }
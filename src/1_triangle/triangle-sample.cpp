@@ -13,6 +13,11 @@
 class TriangleSample : public Sample
 {
 public:
+	TriangleSample()
+		: _vao(0), _vbo(0), _program(0)
+	{
+	}
+
 	virtual bool initContents()
 	{
 		glClearColor(0.0f, 0.0f, 0.3f, 0.0f);
@@ -107,7 +112,16 @@ int main(int argc, char** argv)
 	}
 
 	triangleSample = new TriangleSample();
-	triangleSample->init();
+	if (!triangleSample->parseArguments(argc, argv)) {
+		delete triangleSample;
+		return EXIT_FAILURE;
+	}
+
+	if (!triangleSample->init()) {
+		triangleSample->destroy();
+		delete triangleSample;
+		return EXIT_FAILURE;
+	}
 
 	triangleSample->run();
 
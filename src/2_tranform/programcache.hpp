@@ -0,0 +1,37 @@
+#ifndef PROGRAMCACHE_H_
+#define PROGRAMCACHE_H_
+
+// Linked programs kept on disk as glGetProgramBinary() returns them, so
+// later runs skip compiling and linking. A program is found by a hash of
+// its stages' sources plus GL_VENDOR, GL_RENDERER and GL_VERSION, so a
+// driver update or an edited shader misses and builds from source again;
+// so does a binary the driver refuses. Needs GL 4.1 or
+// GL_ARB_get_program_binary and a driver with at least one binary format,
+// and does nothing otherwise.
+//
+// Sample sets the directory from --program-cache; LoadShaders() and the
+// compute shaders use it through load(), markRetrievable() and store().
+namespace ProgramCache
+{
+	// Where binaries go, created on the first store(); null or "" turns
+	// the cache off, which is how it starts.
+	void setDirectory(const char* path);
+	const char* directory();
+
+	// Needs a current context. The program linked from sources before,
+	// given in the same order, or 0.
+	unsigned int load(const char* const* sources, int count);
+
+	// Asks the driver to keep program's binary; between glCreateProgram()
+	// and glLinkProgram().
+	void markRetrievable(unsigned int program);
+
+	// Writes program, linked from sources, for load() to find.
+	void store(unsigned int program, const char* const* sources, int count);
+
+	// Programs load() found and did not find.
+	int hits();
+	int misses();
+}
+
+#endif // PROGRAMCACHE_H_
@@ -0,0 +1,167 @@
+#include "shaderpreprocessor.hpp"
+#include "shaderpack.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+namespace
+{
+	// With its separator, so it goes in front of a file name as it is.
+	std::string directoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	// Whether line is the directive, and where its argument starts.
+	bool isDirective(const std::string& line, const char* directive, size_t* argument)
+	{
+		size_t i = line.find_first_not_of(" \t");
+		if (i == std::string::npos || line[i] != '#')
+			return false;
+
+		i = line.find_first_not_of(" \t", i + 1);
+		size_t length = strlen(directive);
+		if (i == std::string::npos || line.compare(i, length, directive) != 0)
+			return false;
+
+		i += length;
+		if (i < line.size() && line[i] != ' ' && line[i] != '\t')
+			return false;
+
+		*argument = i;
+		return true;
+	}
+
+	// The file of an #include "file" or #include <file> line.
+	bool includedFile(const std::string& line, size_t argument, std::string* name)
+	{
+		size_t open = line.find_first_not_of(" \t", argument);
+		if (open == std::string::npos || (line[open] != '"' && line[open] != '<'))
+			return false;
+
+		size_t close = line.find(line[open] == '"' ? '"' : '>', open + 1);
+		if (close == std::string::npos || close == open + 1)
+			return false;
+
+		*name = line.substr(open + 1, close - open - 1);
+		return true;
+	}
+
+	std::string lineDirective(int line, size_t file)
+	{
+		char directive[48];
+		snprintf(directive, sizeof(directive), "#line %d %zu\n", line, file);
+		return directive;
+	}
+
+	// Appends the file files[index] to source; prologue goes after its
+	// #version, which only the shader itself has.
+	bool expand(size_t index, const std::string& prologue, std::vector<std::string>& files,
+			std::string* source)
+	{
+		const std::string path = files[index];
+
+		// The file including this one says which line failed.
+		std::string text;
+		if (!ShaderSource::read(path.c_str(), &text)) {
+			if (index == 0)
+				fprintf(stderr, "Error: cannot read %s\n", path.c_str());
+			return false;
+		}
+
+		bool versioned = !prologue.empty() && text.find("#version") != std::string::npos;
+		if (!prologue.empty() && !versioned)
+			*source += prologue + lineDirective(1, index);
+
+		int lineNumber = 0;
+		for (size_t start = 0; start < text.size(); ) {
+			size_t end = text.find('\n', start);
+			if (end == std::string::npos)
+				end = text.size();
+
+			std::string line = text.substr(start, end - start);
+			start = end + 1;
+			++lineNumber;
+
+			size_t argument;
+			if (versioned && isDirective(line, "version", &argument)) {
+				*source += line + "\n" + prologue + lineDirective(lineNumber + 1, index);
+				versioned = false;
+				continue;
+			}
+
+			if (!isDirective(line, "include", &argument)) {
+				*source += line + "\n";
+				continue;
+			}
+
+			std::string name;
+			if (!includedFile(line, argument, &name)) {
+				fprintf(stderr, "Error: %s:%d: bad #include\n", path.c_str(), lineNumber);
+				return false;
+			}
+
+			std::string included = directoryOf(path) + name;
+			if (std::find(files.begin(), files.end(), included) != files.end()) {
+				*source += "\n";
+				continue;
+			}
+
+			files.push_back(included);
+			*source += lineDirective(1, files.size() - 1);
+			if (!expand(files.size() - 1, std::string(), files, source)) {
+				fprintf(stderr, "Error: %s:%d: cannot include %s\n", path.c_str(), lineNumber, included.c_str());
+				return false;
+			}
+			*source += lineDirective(lineNumber + 1, index);
+		}
+
+		return true;
+	}
+}
+
+ShaderDefines& ShaderDefines::set(const std::string& name, const std::string& value)
+{
+	_values[name] = value;
+	return *this;
+}
+
+ShaderDefines& ShaderDefines::set(const std::string& name, int value)
+{
+	char text[16];
+	snprintf(text, sizeof(text), "%d", value);
+	return set(name, std::string(text));
+}
+
+ShaderDefines& ShaderDefines::unset(const std::string& name)
+{
+	_values.erase(name);
+	return *this;
+}
+
+std::string ShaderDefines::source() const
+{
+	std::string source;
+	for (const auto& value : _values)
+		source += "#define " + value.first + " " + value.second + "\n";
+
+	return source;
+}
+
+bool preprocessShader(const char* path, const ShaderDefines& defines, const char* header,
+		std::string* source, std::vector<std::string>* files)
+{
+	std::vector<std::string> read(1, path);
+	std::string prologue = defines.source() + (header ? header : "");
+
+	source->clear();
+	bool expanded = expand(0, prologue, read, source);
+
+	if (files)
+		files->swap(read);
+
+	return expanded;
+}
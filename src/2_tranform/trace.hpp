@@ -0,0 +1,56 @@
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+
+// CPU timeline recorder producing chrome://tracing / Perfetto JSON.
+//
+// Every thread appends complete events to its own buffer, so recording a
+// zone takes no lock; buffers are only walked by write(). Zone names must
+// outlive the trace (string literals in practice).
+namespace Trace
+{
+	// Recording is off until start() is called; zones are then nearly free.
+	void start();
+	bool enabled();
+
+	// Names the calling thread in the timeline.
+	void setThreadName(const char* name);
+
+	uint64_t now();
+	void record(const char* name, uint64_t begin, uint64_t end);
+
+	// Writes every event recorded so far; safe while other threads record.
+	bool write(const char* path);
+
+	extern std::atomic<bool> g_enabled;
+}
+
+class TraceZone
+{
+public:
+	explicit TraceZone(const char* name)
+		: _name(name), _begin(0)
+	{
+		if (Trace::g_enabled.load(std::memory_order_relaxed))
+			_begin = Trace::now();
+	}
+
+	~TraceZone()
+	{
+		if (_begin)
+			Trace::record(_name, _begin, Trace::now());
+	}
+
+private:
+	const char* _name;
+	uint64_t _begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_ZONE(name) TraceZone TRACE_CONCAT(traceZone, __LINE__)(name)
+
+#endif // TRACE_H_
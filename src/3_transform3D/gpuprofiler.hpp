@@ -0,0 +1,99 @@
+#ifndef GPUPROFILER_H_
+#define GPUPROFILER_H_
+
+#include <string>
+#include <vector>
+
+struct GpuTiming
+{
+	std::string name;
+	int depth;				// nesting level, 0 for outermost zones
+	double milliseconds;
+};
+
+// Measures GPU time of named zones with GL_TIMESTAMP queries. Query objects
+// are kept in a ring of kFrameLatency frames and only read back once the
+// driver reports them available, so profiling never stalls the pipeline;
+// timings() therefore trails the frame being recorded by a few frames.
+class GpuProfiler
+{
+public:
+	static const int kFrameLatency = 4;
+
+	GpuProfiler();
+	~GpuProfiler();
+
+	// Needs a current context; returns false when timer queries are missing.
+	bool init();
+	void destroy();
+
+	bool enabled() const { return _enabled; }
+	void setEnabled(bool enabled) { _enabled = enabled && _supported; }
+
+	// Returns true when the frame started collects a new set of timings.
+	bool beginFrame();
+	void endFrame();
+
+	void beginZone(const char* name);
+	void endZone();
+
+	// Zones of the most recent frame whose queries have completed.
+	const std::vector<GpuTiming>& timings() const { return _timings; }
+
+	// Frames whose results were still pending when their queries had to be
+	// reused; non-zero means the GPU is more than kFrameLatency frames behind.
+	int droppedFrames() const { return _droppedFrames; }
+
+private:
+	struct Zone
+	{
+		std::string name;
+		int depth;
+		unsigned int beginQuery, endQuery;
+	};
+
+	struct Frame
+	{
+		std::vector<Zone> zones;
+		std::vector<unsigned int> queries;
+		size_t usedQueries;
+		bool pending;
+	};
+
+	unsigned int allocateQuery(Frame& frame);
+	bool resolve(Frame& frame);
+
+	bool _supported;
+	bool _enabled;
+	bool _recording;
+
+	Frame _frames[kFrameLatency];
+	int _currentFrame;
+
+	std::vector<int> _openZones;
+	std::vector<GpuTiming> _timings;
+	int _droppedFrames;
+};
+
+// Measures the enclosing scope as one zone.
+class GpuZone
+{
+public:
+	GpuZone(GpuProfiler* profiler, const char* name)
+		: _profiler(profiler)
+	{
+		if (_profiler)
+			_profiler->beginZone(name);
+	}
+
+	~GpuZone()
+	{
+		if (_profiler)
+			_profiler->endZone();
+	}
+
+private:
+	GpuProfiler* _profiler;
+};
+
+#endif // GPUPROFILER_H_
@@ -1,8 +1,6 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
-#include <iostream>
-#include <fstream>
 #include <algorithm>
 using namespace std;
 
@@ -12,98 +10,233 @@ using namespace std;
 #include <GL/glew.h>
 
 #include "shader.hpp"
+#include "programcache.hpp"
+#include "shaderpack.hpp"
+#include "trace.hpp"
 
-GLuint LoadShaders(const char * const vertex_file_path, const char * const fragment_file_path)
-{
-	// Create the shaders
-	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-	GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-	// Read the Vertex Shader code from the file
-	std::string VertexShaderCode;
-	std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-	if(VertexShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(VertexShaderStream, Line))
-			VertexShaderCode += "\n" + Line;
-		VertexShaderStream.close();
-	}else{
-		printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-		getchar();
-		return 0;
+static void PrintShaderLog(GLuint ShaderID)
+{
+	int InfoLogLength = 0;
+	glGetShaderiv(ShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ShaderErrorMessage(InfoLogLength+1);
+		glGetShaderInfoLog(ShaderID, InfoLogLength, NULL, &ShaderErrorMessage[0]);
+		printf("%s\n", &ShaderErrorMessage[0]);
 	}
+}
 
-	// Read the Fragment Shader code from the file
-	std::string FragmentShaderCode;
-	std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-	if(FragmentShaderStream.is_open()){
-		std::string Line = "";
-		while(getline(FragmentShaderStream, Line))
-			FragmentShaderCode += "\n" + Line;
-		FragmentShaderStream.close();
+static void PrintProgramLog(GLuint ProgramID)
+{
+	int InfoLogLength = 0;
+	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
+	if ( InfoLogLength > 0 ){
+		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
+		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
+		printf("%s\n", &ProgramErrorMessage[0]);
 	}
+}
 
-	GLint Result = GL_FALSE;
-	int InfoLogLength;
+ShaderBatch::ShaderBatch(bool parallel)
+	: _parallel(parallel && GLEW_KHR_parallel_shader_compile)
+{
+	// As many threads as the driver likes, or none at all: 0 has it
+	// compile on the calling thread again.
+	if (GLEW_KHR_parallel_shader_compile)
+		glMaxShaderCompilerThreadsKHR(_parallel ? 0xFFFFFFFFu : 0u);
+}
 
+ShaderBatch::~ShaderBatch()
+{
+	for (size_t i = 0; i < _entries.size(); ++i) {
+		Entry& entry = _entries[i];
+		glDeleteShader(entry.vertexShader);
+		glDeleteShader(entry.fragmentShader);
+		if (!entry.handedOut)
+			glDeleteProgram(entry.program);
+	}
+}
 
-	// Compile Vertex Shader
-	printf("Compiling shader : %s\n", vertex_file_path);
-	char const * VertexSourcePointer = VertexShaderCode.c_str();
-	glShaderSource(VertexShaderID, 1, &VertexSourcePointer , NULL);
-	glCompileShader(VertexShaderID);
+int ShaderBatch::add(const char * const vertex_file_path, const char * const fragment_file_path,
+		const char * const vertex_header)
+{
+	return add(vertex_file_path, fragment_file_path, ShaderDefines(), vertex_header);
+}
 
-	// Check Vertex Shader
-	glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> VertexShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-		printf("%s\n", &VertexShaderErrorMessage[0]);
+int ShaderBatch::add(const char * const vertex_file_path, const char * const fragment_file_path,
+		const ShaderDefines& defines, const char * const vertex_header)
+{
+	TRACE_ZONE("ShaderBatch::add");
+
+	int index = (int)_entries.size();
+	_entries.push_back(Entry());
+	Entry& entry = _entries.back();
+
+	// Read both shaders, from the shader pack or the files, with the
+	// defines and the header after #version and their #includes in place.
+	// The preprocessor says what it could not read.
+	if (!preprocessShader(vertex_file_path, defines, vertex_header, &entry.vertexCode) ||
+			!preprocessShader(fragment_file_path, defines, NULL, &entry.fragmentCode)) {
+		entry.vertexCode.clear();
+		entry.fragmentCode.clear();
+		entry.checked = true;
+		return index;
 	}
 
+	// Linked on an earlier run (see ProgramCache)
+	const char * const Sources[] = { entry.vertexCode.c_str(), entry.fragmentCode.c_str() };
+	entry.program = ProgramCache::load(Sources, 2);
+	if (entry.program) {
+		printf("Loaded cached program : %s %s\n", vertex_file_path, fragment_file_path);
+		entry.checked = true;
+		return index;
+	}
 
+	// Compile both shaders and link them; nothing here waits for the
+	// driver, program() checks the results.
+	printf("Compiling shader : %s\n", vertex_file_path);
+	entry.vertexShader = glCreateShader(GL_VERTEX_SHADER);
+	glShaderSource(entry.vertexShader, 1, &Sources[0], NULL);
+	glCompileShader(entry.vertexShader);
 
-	// Compile Fragment Shader
 	printf("Compiling shader : %s\n", fragment_file_path);
-	char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-	glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer , NULL);
-	glCompileShader(FragmentShaderID);
+	entry.fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+	glShaderSource(entry.fragmentShader, 1, &Sources[1], NULL);
+	glCompileShader(entry.fragmentShader);
 
-	// Check Fragment Shader
-	glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-	glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> FragmentShaderErrorMessage(InfoLogLength+1);
-		glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-		printf("%s\n", &FragmentShaderErrorMessage[0]);
+	printf("Linking program\n");
+	entry.program = glCreateProgram();
+	glAttachShader(entry.program, entry.vertexShader);
+	glAttachShader(entry.program, entry.fragmentShader);
+	ProgramCache::markRetrievable(entry.program);
+	glLinkProgram(entry.program);
+
+	return index;
+}
+
+bool ShaderBatch::ready(int index) const
+{
+	const Entry& entry = _entries[index];
+	if (entry.checked || !_parallel)
+		return true;
+
+	GLint Completed = GL_FALSE;
+	glGetProgramiv(entry.program, GL_COMPLETION_STATUS_KHR, &Completed);
+	return Completed == GL_TRUE;
+}
+
+GLuint ShaderBatch::program(int index)
+{
+	Entry& entry = _entries[index];
+	entry.handedOut = true;
+	if (entry.checked)
+		return entry.program;
+
+	TRACE_ZONE("ShaderBatch::program");
+	entry.checked = true;
+
+	// Check the shaders and the program
+	PrintShaderLog(entry.vertexShader);
+	PrintShaderLog(entry.fragmentShader);
+
+	GLint Result = GL_FALSE;
+	glGetProgramiv(entry.program, GL_LINK_STATUS, &Result);
+	PrintProgramLog(entry.program);
+
+	if (Result) {
+		const char * const Sources[] = { entry.vertexCode.c_str(), entry.fragmentCode.c_str() };
+		ProgramCache::store(entry.program, Sources, 2);
 	}
 
+	glDetachShader(entry.program, entry.vertexShader);
+	glDetachShader(entry.program, entry.fragmentShader);
 
+	glDeleteShader(entry.vertexShader);
+	glDeleteShader(entry.fragmentShader);
+	entry.vertexShader = 0;
+	entry.fragmentShader = 0;
 
-	// Link the program
-	printf("Linking program\n");
-	GLuint ProgramID = glCreateProgram();
-	glAttachShader(ProgramID, VertexShaderID);
-	glAttachShader(ProgramID, FragmentShaderID);
-	glLinkProgram(ProgramID);
+	entry.vertexCode.clear();
+	entry.fragmentCode.clear();
 
-	// Check the program
-	glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-	glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-	if ( InfoLogLength > 0 ){
-		std::vector<char> ProgramErrorMessage(InfoLogLength+1);
-		glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-		printf("%s\n", &ProgramErrorMessage[0]);
+	return entry.program;
+}
+
+GLuint LoadShaders(const char * const vertex_file_path, const char * const fragment_file_path,
+		const char * const vertex_header)
+{
+	TRACE_ZONE("LoadShaders");
+
+	ShaderBatch Batch;
+	return Batch.program(Batch.add(vertex_file_path, fragment_file_path, vertex_header));
+}
+
+ShaderVariants::ShaderVariants()
+	: _batch(NULL), _parallelRequested(true)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+	clear();
+}
+
+ShaderVariants::Variant& ShaderVariants::find(const char * const vertex_file_path,
+		const char * const fragment_file_path, const ShaderDefines& defines, const char * const vertex_header)
+{
+	std::string key = std::string(vertex_file_path) + '\n' + fragment_file_path + '\n' + defines.source() +
+		(vertex_header ? vertex_header : "");
+
+	Variant& variant = _variants[key];
+	if (variant.entry < 0) {
+		if (!_batch)
+			_batch = new ShaderBatch(_parallelRequested);
+		variant.entry = _batch->add(vertex_file_path, fragment_file_path, defines, vertex_header);
+	}
+
+	return variant;
+}
+
+void ShaderVariants::prepare(const char * const vertex_file_path, const char * const fragment_file_path,
+		const ShaderDefines& defines, const char * const vertex_header)
+{
+	find(vertex_file_path, fragment_file_path, defines, vertex_header);
+}
+
+GLuint ShaderVariants::program(const char * const vertex_file_path, const char * const fragment_file_path,
+		const ShaderDefines& defines, const char * const vertex_header)
+{
+	Variant& variant = find(vertex_file_path, fragment_file_path, defines, vertex_header);
+	if (!variant.program)
+		variant.program = _batch->program(variant.entry);
+
+	return variant.program;
+}
+
+bool ShaderVariants::replace(GLuint previous, GLuint program)
+{
+	if (!previous)
+		return false;
+
+	for (auto& variant : _variants) {
+		if (variant.second.program == previous) {
+			glDeleteProgram(previous);
+			variant.second.program = program;
+			return true;
+		}
 	}
 
-	
-	glDetachShader(ProgramID, VertexShaderID);
-	glDetachShader(ProgramID, FragmentShaderID);
-	
-	glDeleteShader(VertexShaderID);
-	glDeleteShader(FragmentShaderID);
+	return false;
+}
 
-	return ProgramID;
+void ShaderVariants::clear()
+{
+	// The ones never taken go with the batch.
+	for (auto& variant : _variants) {
+		if (variant.second.program)
+			glDeleteProgram(variant.second.program);
+	}
 
+	_variants.clear();
+	delete _batch;
+	_batch = NULL;
 }
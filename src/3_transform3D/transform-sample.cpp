@@ -17,6 +17,11 @@
 class TransformSample : public Sample
 {
 public:
+	TransformSample()
+		: _vao(0), _vbo(0), _program(0)
+	{
+	}
+
 	virtual bool initContents()
 	{
 		glClearColor(0.0f, 0.0f, 0.3f, 0.0f);
@@ -163,7 +168,16 @@ int main(int argc, char** argv)
 	}
 
 	transformSample = new TransformSample();
-	transformSample->init();
+	if (!transformSample->parseArguments(argc, argv)) {
+		delete transformSample;
+		return EXIT_FAILURE;
+	}
+
+	if (!transformSample->init()) {
+		transformSample->destroy();
+		delete transformSample;
+		return EXIT_FAILURE;
+	}
 
 	transformSample->run();
 
@@ -0,0 +1,121 @@
+#include "benchmark.hpp"
+
+#include <cmath>
+
+#include <algorithm>
+#include <chrono>
+
+static std::string quote(const std::string& text)
+{
+	std::string quoted = "\"";
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	quoted += '"';
+
+	return quoted;
+}
+
+// Nearest-rank percentile over an already sorted series.
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+
+	size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+	if (rank > 0)
+		--rank;
+
+	return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+double Benchmark::now()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Benchmark::setProperty(const std::string& key, const std::string& value)
+{
+	property(key) = quote(value);
+}
+
+void Benchmark::setProperty(const std::string& key, double value)
+{
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "%.17g", value);
+
+	property(key) = buffer;
+}
+
+void Benchmark::record(const std::string& name, double milliseconds)
+{
+	series(name).push_back(milliseconds);
+}
+
+std::string& Benchmark::property(const std::string& key)
+{
+	for (auto& entry : _properties) {
+		if (entry.first == key)
+			return entry.second;
+	}
+
+	_properties.push_back(std::make_pair(key, std::string()));
+	return _properties.back().second;
+}
+
+std::vector<double>& Benchmark::series(const std::string& name)
+{
+	for (auto& entry : _series) {
+		if (entry.first == name)
+			return entry.second;
+	}
+
+	_series.push_back(std::make_pair(name, std::vector<double>()));
+	return _series.back().second;
+}
+
+bool Benchmark::writeJSON(const char* path) const
+{
+	FILE* out = fopen(path, "w");
+	if (!out) {
+		fprintf(stderr, "Error: cannot write benchmark report %s\n", path);
+		return false;
+	}
+
+	writeJSON(out);
+	fclose(out);
+
+	return true;
+}
+
+void Benchmark::writeJSON(FILE* out) const
+{
+	fprintf(out, "{\n");
+
+	for (const auto& property : _properties)
+		fprintf(out, "\t%s: %s,\n", quote(property.first).c_str(), property.second.c_str());
+
+	fprintf(out, "\t\"series\": {");
+
+	for (size_t i = 0; i < _series.size(); ++i) {
+		std::vector<double> sorted = _series[i].second;
+		std::sort(sorted.begin(), sorted.end());
+
+		double sum = 0.0;
+		for (double value : sorted)
+			sum += value;
+
+		fprintf(out, "%s\n\t\t%s: { \"count\": %zu, \"min\": %.4f, \"median\": %.4f, "
+				"\"mean\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+				i ? "," : "", quote(_series[i].first).c_str(), sorted.size(),
+				sorted.empty() ? 0.0 : sorted.front(), percentile(sorted, 50.0),
+				sorted.empty() ? 0.0 : sum / sorted.size(),
+				percentile(sorted, 95.0), percentile(sorted, 99.0),
+				sorted.empty() ? 0.0 : sorted.back());
+	}
+
+	fprintf(out, "\n\t}\n}\n");
+}
@@ -19,6 +19,11 @@
 class InstancingSample : public Sample
 {
 public:
+	InstancingSample()
+		: _vao(0), _vbo(0), _transformBufferObject(0), _transformTBO(0), _program(0)
+	{
+	}
+
 	virtual bool initContents()
 	{
 		glClearColor(0.0f, 0.0f, 0.3f, 0.0f);
@@ -172,7 +177,16 @@ int main(int argc, char** argv)
 	}
 
 	instancingSample = new InstancingSample();
-	instancingSample->init();
+	if (!instancingSample->parseArguments(argc, argv)) {
+		delete instancingSample;
+		return EXIT_FAILURE;
+	}
+
+	if (!instancingSample->init()) {
+		instancingSample->destroy();
+		delete instancingSample;
+		return EXIT_FAILURE;
+	}
 
 	instancingSample->run();
 
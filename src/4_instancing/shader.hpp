@@ -1,6 +1,127 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
-GLuint LoadShaders(const char * const vertex_file_path, const char * const fragment_file_path);
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shaderpreprocessor.hpp"
+
+// vertex_header, when given, is inserted right after the #version line of
+// the vertex shader, e.g. generated defines and declarations.
+GLuint LoadShaders(const char * const vertex_file_path, const char * const fragment_file_path,
+		const char * const vertex_header = nullptr);
+
+// Programs built together. add() reads a program's sources and hands them
+// to the driver without waiting for it; program() waits for one and checks
+// it the first time it is asked for. Adding every program up front lets
+// the driver build them while the sample sets up everything else, on
+// threads of its own with GL_KHR_parallel_shader_compile, when ready()
+// tells whether program() would still wait. Programs program() never
+// handed out go with the batch.
+class ShaderBatch
+{
+public:
+	// parallel false keeps the driver to the calling thread even with
+	// the extension.
+	explicit ShaderBatch(bool parallel = true);
+	~ShaderBatch();
+
+	ShaderBatch(const ShaderBatch&) = delete;
+	ShaderBatch& operator=(const ShaderBatch&) = delete;
+
+	// Takes what LoadShaders() does; the index for ready() and program().
+	int add(const char * const vertex_file_path, const char * const fragment_file_path,
+			const char * const vertex_header = nullptr);
+
+	// The same with defines at the top of both shaders; either may
+	// #include files (see preprocessShader()).
+	int add(const char * const vertex_file_path, const char * const fragment_file_path,
+			const ShaderDefines& defines, const char * const vertex_header = nullptr);
+
+	// Always true without the extension, when there is no telling.
+	bool ready(int index) const;
+
+	// 0 when a shader or a file it includes could not be read.
+	GLuint program(int index);
+
+	bool parallel() const { return _parallel; }
+
+private:
+	struct Entry
+	{
+		Entry() : vertexShader(0), fragmentShader(0), program(0), checked(false), handedOut(false) {}
+
+		// Until program() has stored the program in the ProgramCache.
+		std::string vertexCode;
+		std::string fragmentCode;
+
+		GLuint vertexShader;
+		GLuint fragmentShader;
+		GLuint program;
+		bool checked;
+		bool handedOut;
+	};
+
+	std::vector<Entry> _entries;
+	bool _parallel;
+};
+
+// Programs by what they are built from: the two shaders, the defines and
+// the vertex header, which is where InstanceData, DrawBatch and GpuCuller
+// put the encoding, the submission and culling. prepare() hands a variant
+// to the driver the first time it is asked for and program() waits for
+// it, so a sample prepares every variant it is going to need and then
+// asks for each as it gets used; asked for again, it comes from the
+// cache. The programs are the cache's, deleted by clear().
+class ShaderVariants
+{
+public:
+	ShaderVariants();
+	~ShaderVariants();
+
+	ShaderVariants(const ShaderVariants&) = delete;
+	ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+	// Before the first prepare(); see ShaderBatch.
+	void setParallel(bool parallel) { _parallelRequested = parallel; }
+	bool parallel() const { return _batch ? _batch->parallel() : _parallelRequested; }
+
+	void prepare(const char * const vertex_file_path, const char * const fragment_file_path,
+			const ShaderDefines& defines = ShaderDefines(), const char * const vertex_header = nullptr);
+
+	// Prepares the variant if that was not done yet; 0 when it could not
+	// be read, as from ShaderBatch.
+	GLuint program(const char * const vertex_file_path, const char * const fragment_file_path,
+			const ShaderDefines& defines = ShaderDefines(), const char * const vertex_header = nullptr);
+
+	// Puts program in place of the cached previous one, which it deletes,
+	// e.g. for one ShaderReloader rebuilt; false when previous is not the
+	// cache's.
+	bool replace(GLuint previous, GLuint program);
+
+	// Needs the context the programs were built in current.
+	void clear();
+
+	// Variants built.
+	size_t size() const { return _variants.size(); }
+
+private:
+	struct Variant
+	{
+		Variant() : entry(-1), program(0) {}
+
+		// In _batch until program() takes it.
+		int entry;
+		GLuint program;
+	};
+
+	Variant& find(const char * const vertex_file_path, const char * const fragment_file_path,
+			const ShaderDefines& defines, const char * const vertex_header);
+
+	std::unordered_map<std::string, Variant> _variants;
+	ShaderBatch* _batch;
+	bool _parallelRequested;
+};
 
 #endif // SHADER_HPP
@@ -0,0 +1,171 @@
+#include "trace.hpp"
+
+#include <cstdio>
+
+#include <chrono>
+
+namespace
+{
+	struct Event
+	{
+		const char* name;
+		uint64_t begin, end;
+	};
+
+	struct Chunk
+	{
+		static const size_t kCapacity = 4096;
+
+		Chunk() : count(0), next(nullptr) {}
+
+		Event events[kCapacity];
+		std::atomic<size_t> count;
+		std::atomic<Chunk*> next;
+	};
+
+	// Owned by one thread for writing. Buffers are never freed so events of
+	// threads that already exited still make it into the file.
+	struct ThreadBuffer
+	{
+		ThreadBuffer() : id(0), name(nullptr), head(nullptr), tail(nullptr), next(nullptr) {}
+
+		int id;
+		std::atomic<const char*> name;
+		Chunk* head;
+		Chunk* tail;
+		ThreadBuffer* next;
+	};
+
+	std::atomic<ThreadBuffer*> g_buffers(nullptr);
+	std::atomic<int> g_threadCount(0);
+	std::atomic<uint64_t> g_startTime(0);
+
+	ThreadBuffer* threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer = nullptr;
+
+		if (!buffer) {
+			buffer = new ThreadBuffer();
+			buffer->id = ++g_threadCount;
+			buffer->head = buffer->tail = new Chunk();
+
+			ThreadBuffer* head = g_buffers.load(std::memory_order_relaxed);
+			do {
+				buffer->next = head;
+			} while (!g_buffers.compare_exchange_weak(head, buffer,
+						std::memory_order_release, std::memory_order_relaxed));
+		}
+
+		return buffer;
+	}
+
+	// Names come from callers and may hold quotes or backslashes.
+	void writeString(FILE* out, const char* text)
+	{
+		fputc('"', out);
+		for (const char* c = text; *c; ++c) {
+			if (*c == '"' || *c == '\\')
+				fputc('\\', out);
+
+			if ((unsigned char)*c < 0x20)
+				fprintf(out, "\\u%04x", (unsigned int)*c);
+			else
+				fputc(*c, out);
+		}
+		fputc('"', out);
+	}
+}
+
+std::atomic<bool> Trace::g_enabled(false);
+
+void Trace::start()
+{
+	g_startTime.store(now(), std::memory_order_relaxed);
+	g_enabled.store(true, std::memory_order_relaxed);
+}
+
+bool Trace::enabled()
+{
+	return g_enabled.load(std::memory_order_relaxed);
+}
+
+void Trace::setThreadName(const char* name)
+{
+	threadBuffer()->name.store(name, std::memory_order_release);
+}
+
+uint64_t Trace::now()
+{
+	using namespace std::chrono;
+	return (uint64_t)duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void Trace::record(const char* name, uint64_t begin, uint64_t end)
+{
+	ThreadBuffer* buffer = threadBuffer();
+
+	Chunk* chunk = buffer->tail;
+	size_t count = chunk->count.load(std::memory_order_relaxed);
+	if (count == Chunk::kCapacity) {
+		Chunk* next = new Chunk();
+		chunk->next.store(next, std::memory_order_release);
+		buffer->tail = chunk = next;
+		count = 0;
+	}
+
+	Event& event = chunk->events[count];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+
+	chunk->count.store(count + 1, std::memory_order_release);
+}
+
+bool Trace::write(const char* path)
+{
+	FILE* out = fopen(path, "w");
+	if (!out) {
+		fprintf(stderr, "Error: cannot write trace %s\n", path);
+		return false;
+	}
+
+	uint64_t start = g_startTime.load(std::memory_order_relaxed);
+	bool first = true;
+
+	fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+
+	for (ThreadBuffer* buffer = g_buffers.load(std::memory_order_acquire);
+			buffer; buffer = buffer->next) {
+		const char* name = buffer->name.load(std::memory_order_acquire);
+		if (name) {
+			fprintf(out, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+					"\"tid\": %d, \"args\": {\"name\": ", first ? "" : ",", buffer->id);
+			writeString(out, name);
+			fprintf(out, "}}");
+			first = false;
+		}
+
+		for (Chunk* chunk = buffer->head; chunk;
+				chunk = chunk->next.load(std::memory_order_acquire)) {
+			size_t count = chunk->count.load(std::memory_order_acquire);
+
+			for (size_t i = 0; i < count; ++i) {
+				const Event& event = chunk->events[i];
+				if (event.begin < start)
+					continue;
+
+				fprintf(out, "%s\n{\"name\": ", first ? "" : ",");
+				writeString(out, event.name);
+				fprintf(out, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+						buffer->id,
+						(event.begin - start) / 1000.0, (event.end - event.begin) / 1000.0);
+				first = false;
+			}
+		}
+	}
+
+	fprintf(out, "\n]}\n");
+	fclose(out);
+
+	return true;
+}
@@ -0,0 +1,37 @@
+#ifndef BENCHMARK_H_
+#define BENCHMARK_H_
+
+#include <cstdio>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+// Collects per-frame measurements in named series and reports
+// min/median/p95/p99/max for each of them as JSON.
+class Benchmark
+{
+public:
+	// Monotonic wall clock in seconds, for timing CPU work.
+	static double now();
+
+	// Setting a key again replaces its value.
+	void setProperty(const std::string& key, const std::string& value);
+	void setProperty(const std::string& key, double value);
+
+	void record(const std::string& series, double milliseconds);
+
+	bool writeJSON(const char* path) const;
+	void writeJSON(FILE* out) const;
+
+private:
+	std::string& property(const std::string& key);
+	std::vector<double>& series(const std::string& name);
+
+	// Values are stored already JSON-encoded; both keep insertion order
+	// so reports diff cleanly between runs.
+	std::vector<std::pair<std::string, std::string>> _properties;
+	std::vector<std::pair<std::string, std::vector<double>>> _series;
+};
+
+#endif // BENCHMARK_H_
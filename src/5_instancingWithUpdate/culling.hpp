@@ -0,0 +1,137 @@
+#ifndef CULLING_H_
+#define CULLING_H_
+
+#include <cstddef>
+
+#include "frustumcull.hpp"
+#include "geometrypool.hpp"
+#include "meshfile.hpp"
+
+// How the instancing samples skip instances outside the view frustum.
+enum CullMode
+{
+	// Every instance is drawn.
+	CULL_NONE,
+	// GpuCuller: a compute shader compacts the visible instances and
+	// writes the draw's arguments (GL 4.3).
+	CULL_GPU,
+	// FrustumCuller (frustumcull.hpp): the CPU culls before encoding and
+	// uploads only the visible instances.
+	CULL_CPU,
+	// As CULL_CPU, but walking an InstanceBvh (bvh.hpp) instead of testing
+	// every instance.
+	CULL_BVH,
+	// MeshletCuller: a compute shader tests every meshlet of every
+	// instance's mesh and writes a draw for each one left (GL 4.3).
+	CULL_MESHLET,
+};
+
+bool cullModeSupported(CullMode mode);
+const char* cullModeName(CullMode mode);
+bool parseCullMode(const char* name, CullMode* mode);
+
+// Frustum culling on the GPU. cull() tests every instance's bounding
+// sphere in a compute shader, appends the visible instance indices to a
+// buffer through an atomic counter that is the instanceCount of a
+// DrawArraysIndirectCommand, so the CPU never reads the count back.
+//
+// The vertex shader gets the compacted indices as an instanced uint
+// attribute: vertexShaderSource() declares it and defines
+// INSTANCE_CULLING, and bindVertexArray() sets it up.
+class GpuCuller
+{
+public:
+	static const int kVisibleAttribute = 5;
+
+	GpuCuller();
+
+	// Needs a current context. Every draw is vertexCount vertices per
+	// visible instance.
+	bool init(size_t instanceCount, int vertexCount);
+	void destroy();
+
+	// For LoadShaders(), after InstanceData::vertexShaderSource().
+	const char* vertexShaderSource() const;
+
+	// Points kVisibleAttribute of the bound vertex array at the visible
+	// instance list.
+	void bindVertexArray();
+
+	// Instance i keeps spheres[i] until the next call.
+	void setSpheres(const BoundingSpheres& spheres);
+
+	// Culls against the frustum of viewProjection. Draws reading
+	// commandBuffer() and the visible list may follow right away.
+	void cull(const float* viewProjection);
+
+	unsigned int commandBuffer() const { return _commandBuffer; }
+
+private:
+	size_t _instanceCount;
+	int _vertexCount;
+
+	unsigned int _program;
+	int _planesLocation;
+	int _instanceCountLocation;
+
+	unsigned int _sphereBuffer;
+	unsigned int _visibleBuffer;
+	unsigned int _commandBuffer;
+};
+
+// Cluster culling on the GPU. cull() tests the meshlets of one pool mesh
+// for every instance, against the frustum and, through each meshlet's
+// normal cone, for facing away from the camera, and writes a
+// DrawElementsIndirectCommand for every pair left: the meshlet's index
+// range, one instance, with the instance as base instance. The commands
+// are compacted through an atomic counter that is also the draw count of
+// the multi-draw, so the CPU never reads either back; DrawBatch draws
+// them once given to setGeneratedDraws().
+//
+// Instances are placed by column-major mat4 transforms, rotation and
+// uniform scale only, as the cone is turned with them.
+class MeshletCuller
+{
+public:
+	MeshletCuller();
+
+	// Needs a current context. meshlets are those of mesh, their
+	// firstIndex counted from the mesh's.
+	bool init(const Meshlet* meshlets, size_t meshletCount, const PoolMesh& mesh, size_t instanceCount);
+	void destroy();
+
+	// Instance i is placed by the 16 floats from transforms + 16 * i until
+	// the next call.
+	void setTransforms(const float* transforms);
+
+	// Culls against the frustum of viewProjection as seen from camera.
+	// Draws reading commandBuffer() may follow right away.
+	void cull(const float* viewProjection, const float* camera);
+
+	unsigned int commandBuffer() const { return _commandBuffer; }
+	unsigned int countBuffer() const { return _countBuffer; }
+	size_t maxDraws() const { return _meshletCount * _instanceCount; }
+
+	size_t meshletCount() const { return _meshletCount; }
+
+private:
+	size_t _meshletCount;
+	size_t _instanceCount;
+
+	unsigned int _program;
+	int _planesLocation;
+	int _cameraLocation;
+	int _meshletCountLocation;
+	int _firstInstanceLocation;
+	int _firstIndexLocation;
+	int _baseVertexLocation;
+
+	PoolMesh _mesh;
+
+	unsigned int _meshletBuffer;
+	unsigned int _transformBuffer;
+	unsigned int _commandBuffer;
+	unsigned int _countBuffer;
+};
+
+#endif // CULLING_H_
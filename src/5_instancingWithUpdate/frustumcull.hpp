@@ -0,0 +1,77 @@
+#ifndef FRUSTUMCULL_H_
+#define FRUSTUMCULL_H_
+
+#include <cstddef>
+
+#include <vector>
+
+#include "jobsystem.hpp"
+#include "transformkernel.hpp"
+
+// Per-instance bounding spheres as structure of arrays.
+struct BoundingSpheres
+{
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* radius;
+};
+
+// The six planes of the frustum of a column-major view projection matrix,
+// as normalized (a, b, c, d) with the normals pointing inwards, so a
+// sphere is outside when a * x + b * y + c * z + d < -radius for any plane.
+void frustumPlanes(const float* viewProjection, float* planes);
+
+// Writes the indices of the spheres in [begin, end) that touch the frustum
+// to visible, in increasing order, and returns how many there are. visible
+// needs room for end - begin indices. The kernels are the instruction sets
+// of buildTransforms(); SSE4.1 tests four spheres at a time, AVX2 eight.
+size_t cullSpheres(const BoundingSpheres& spheres, const float* planes,
+		size_t begin, size_t end, unsigned int* visible,
+		TransformKernel kernel = bestTransformKernel());
+
+// Frustum culling on the CPU, for when the visible instances have to be
+// known before upload. cull() splits the instances into chunks of
+// kChunkSize, culls them in parallel and counts the survivors; forEachChunk()
+// then hands every chunk's visible indices out in parallel together with
+// where they start in the compacted order, so the caller can gather and
+// encode only those instances.
+class FrustumCuller
+{
+public:
+	static const size_t kChunkSize = 4096;
+
+	FrustumCuller();
+
+	void cull(JobSystem& jobs, const BoundingSpheres& spheres, size_t count,
+			const float* viewProjection, TransformKernel kernel = bestTransformKernel());
+
+	size_t visibleCount() const { return _visibleCount; }
+
+	// body(offset, indices, count) for every chunk with visible instances;
+	// offset is the number of visible instances in earlier chunks.
+	template <class Body>
+	void forEachChunk(JobSystem& jobs, Body body) const;
+
+private:
+	size_t chunkCount() const { return _chunkOffsets.size(); }
+
+	// Chunk c's indices start at _visible[c * kChunkSize].
+	std::vector<unsigned int> _visible;
+	std::vector<size_t> _chunkCounts;
+	std::vector<size_t> _chunkOffsets;
+	size_t _visibleCount;
+};
+
+template <class Body>
+void FrustumCuller::forEachChunk(JobSystem& jobs, Body body) const
+{
+	jobs.parallelFor(chunkCount(), 1, [&](size_t begin, size_t end) {
+		for (size_t chunk = begin; chunk < end; ++chunk) {
+			if (_chunkCounts[chunk])
+				body(_chunkOffsets[chunk], &_visible[chunk * kChunkSize], _chunkCounts[chunk]);
+		}
+	});
+}
+
+#endif // FRUSTUMCULL_H_
@@ -0,0 +1,31 @@
+#ifndef HALFFLOAT_H_
+#define HALFFLOAT_H_
+
+#include <cstdint>
+#include <cstring>
+
+// Float to IEEE half, for the half instance encoding and vertex layouts.
+// Round to nearest; values too small for a normal half flush to zero.
+inline uint16_t floatToHalf(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+
+	uint32_t sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	if (exponent <= 0)
+		return (uint16_t)sign;
+	if (exponent >= 31)
+		return (uint16_t)(sign | 0x7c00);
+
+	// A carry out of the mantissa correctly bumps the exponent.
+	uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+	if (mantissa & 0x1000)
+		++half;
+
+	return (uint16_t)half;
+}
+
+#endif // HALFFLOAT_H_
@@ -0,0 +1,434 @@
+#include "instancedata.hpp"
+#include "geometrypool.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+
+static const char* const kPathNames[] = {
+	"tbo", "attribute", "ubo", "ssbo",
+};
+
+static const char* const kAnimationNames[] = {
+	"cpu", "gpu",
+};
+
+// Binding point of the Instances uniform or storage block.
+static const GLuint kBlockBinding = 0;
+
+// Texture unit of instanceSpins; Ms uses unit 0.
+static const GLint kSpinTextureUnit = 1;
+
+static size_t gcd(size_t a, size_t b)
+{
+	while (b) {
+		size_t t = a % b;
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static std::string format(const char* pattern, size_t value)
+{
+	char buffer[256];
+	snprintf(buffer, sizeof(buffer), pattern, value);
+
+	return buffer;
+}
+
+bool instancePathSupported(InstancePath path)
+{
+	if (path == INSTANCE_PATH_SSBO)
+		return GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object;
+
+	return true;
+}
+
+const char* instancePathName(InstancePath path)
+{
+	return kPathNames[path];
+}
+
+bool parseInstancePath(const char* name, InstancePath* path)
+{
+	for (int i = 0; i <= INSTANCE_PATH_SSBO; ++i) {
+		if (strcmp(name, kPathNames[i]) == 0) {
+			*path = (InstancePath)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+const char* instanceAnimationName(InstanceAnimation animation)
+{
+	return kAnimationNames[animation];
+}
+
+bool parseInstanceAnimation(const char* name, InstanceAnimation* animation)
+{
+	for (int i = 0; i <= INSTANCE_ANIMATION_GPU; ++i) {
+		if (strcmp(name, kAnimationNames[i]) == 0) {
+			*animation = (InstanceAnimation)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+InstanceData::InstanceData()
+	: _path(INSTANCE_PATH_TBO), _encoding(INSTANCE_ENCODING_MAT4),
+	_animation(INSTANCE_ANIMATION_CPU), _instanceCount(0), _chunkInstances(0),
+	_spinBuffer(0), _spinTexture(0), _timeLocation(-1), _baseLocation(-1)
+{
+}
+
+bool InstanceData::init(InstancePath path, InstanceEncoding encoding, size_t instanceCount,
+		StreamStrategy strategy, InstanceAnimation animation)
+{
+	if (!instancePathSupported(path)) {
+		fprintf(stderr, "Error: instance path %s is not supported\n", instancePathName(path));
+		return false;
+	}
+
+	_path = path;
+	_encoding = encoding;
+	_animation = animation;
+	_instanceCount = instanceCount;
+	_chunkInstances = instanceCount;
+
+	size_t stride = instanceEncodingStride(encoding);
+	int texels = instanceEncodingTexels(encoding);
+	bool packed = encoding == INSTANCE_ENCODING_HALF;
+
+	size_t regionSize = stride * instanceCount;
+
+	if (path == INSTANCE_PATH_UBO) {
+		GLint maxBlockSize = 0, alignment = 1;
+		glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+		// Chunks start on the offset alignment and hold a multiple of four
+		// instances, so gl_InstanceID % 4 matches an unchunked draw.
+		size_t step = (size_t)alignment / gcd(stride, (size_t)alignment);
+		step = step * 4 / gcd(step, 4);
+
+		size_t fit = (size_t)maxBlockSize / stride / step * step;
+		size_t needed = (instanceCount + step - 1) / step * step;
+
+		_chunkInstances = std::min(fit, needed);
+		if (_chunkInstances == 0) {
+			fprintf(stderr, "Error: uniform blocks are too small for one instance\n");
+			return false;
+		}
+
+		// The last chunk is bound whole, like every other one.
+		size_t chunks = (instanceCount + _chunkInstances - 1) / _chunkInstances;
+		regionSize = chunks * _chunkInstances * stride;
+	}
+
+	// Transforms written once need neither a ring nor a staging copy.
+	if (animation == INSTANCE_ANIMATION_GPU)
+		strategy = STREAM_INVALIDATE;
+
+	if (!_stream.init(regionSize, instanceEncodingFormat(encoding), strategy))
+		return false;
+
+	if (animation == INSTANCE_ANIMATION_GPU) {
+		glGenBuffers(1, &_spinBuffer);
+		glGenTextures(1, &_spinTexture);
+
+		glBindBuffer(GL_TEXTURE_BUFFER, _spinBuffer);
+		glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(float) * instanceCount, nullptr, GL_STATIC_DRAW);
+
+		glBindTexture(GL_TEXTURE_BUFFER, _spinTexture);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, _spinBuffer);
+
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+		setSpins(nullptr, nullptr);
+	}
+
+	_vertexSource.clear();
+
+	// #extension has to precede every declaration.
+	if (path == INSTANCE_PATH_SSBO) {
+		_vertexSource +=
+			"#if __VERSION__ < 430\n"
+			"#extension GL_ARB_shader_storage_buffer_object : require\n"
+			"#endif\n";
+	}
+
+	_vertexSource += instanceEncodingDefine(encoding);
+	if (animation == INSTANCE_ANIMATION_GPU) {
+		_vertexSource +=
+			"#define INSTANCE_ANIMATION_GPU\n"
+			"uniform float instanceTime;\n"
+			"uniform samplerBuffer instanceSpins;\n";
+
+		// gl_InstanceID starts over with every uniform block chunk; the
+		// spins are one buffer for all of them.
+		_vertexSource += path == INSTANCE_PATH_UBO ?
+			"uniform int instanceBase;\n" :
+			"#define instanceBase 0\n";
+		_vertexSource +=
+			"vec2 instanceSpin(int instance)\n"
+			"{\n"
+			"\treturn texelFetch(instanceSpins, instanceBase + instance).xy;\n"
+			"}\n";
+	}
+	_vertexSource += format("#define INSTANCE_TEXELS %zu\n", (size_t)texels);
+	_vertexSource += packed ? "#define INSTANCE_TEXEL uvec2\n" : "#define INSTANCE_TEXEL vec4\n";
+
+	switch (path) {
+	case INSTANCE_PATH_TBO:
+		_vertexSource += packed ? "uniform usamplerBuffer Ms;\n" : "uniform samplerBuffer Ms;\n";
+		_vertexSource +=
+			"INSTANCE_TEXEL instanceTexel(int instance, int texel)\n"
+			"{\n";
+		_vertexSource += packed ?
+			"\treturn texelFetch(Ms, INSTANCE_TEXELS * instance + texel).xy;\n" :
+			"\treturn texelFetch(Ms, INSTANCE_TEXELS * instance + texel);\n";
+		_vertexSource += "}\n";
+		break;
+
+	case INSTANCE_PATH_ATTRIBUTE:
+		for (int i = 0; i < texels; ++i) {
+			char declaration[128];
+			snprintf(declaration, sizeof(declaration),
+					"layout(location = %d) in INSTANCE_TEXEL instanceAttribute%d;\n",
+					kFirstAttribute + i, i);
+			_vertexSource += declaration;
+		}
+
+		_vertexSource +=
+			"INSTANCE_TEXEL instanceTexel(int instance, int texel)\n"
+			"{\n";
+		for (int i = 1; i < texels; ++i) {
+			char line[128];
+			snprintf(line, sizeof(line), "\tif (texel == %d)\n\t\treturn instanceAttribute%d;\n", i, i);
+			_vertexSource += line;
+		}
+		_vertexSource +=
+			"\treturn instanceAttribute0;\n"
+			"}\n";
+		break;
+
+	case INSTANCE_PATH_UBO:
+		// std140 pads array elements to 16 bytes, so packed texels are
+		// read as halves of uvec4s.
+		if (packed) {
+			_vertexSource += format("layout(std140) uniform Instances { uvec4 instanceWords[%zu]; };\n",
+					_chunkInstances * stride / 16);
+			_vertexSource +=
+				"INSTANCE_TEXEL instanceTexel(int instance, int texel)\n"
+				"{\n"
+				"\tint word = 2 * (INSTANCE_TEXELS * instance + texel);\n"
+				"\tuvec4 words = instanceWords[word >> 2];\n"
+				"\treturn (word & 2) != 0 ? words.zw : words.xy;\n"
+				"}\n";
+		}
+		else {
+			_vertexSource += format("layout(std140) uniform Instances { vec4 instanceTexels[%zu]; };\n",
+					_chunkInstances * stride / 16);
+			_vertexSource +=
+				"INSTANCE_TEXEL instanceTexel(int instance, int texel)\n"
+				"{\n"
+				"\treturn instanceTexels[INSTANCE_TEXELS * instance + texel];\n"
+				"}\n";
+		}
+		break;
+
+	case INSTANCE_PATH_SSBO:
+		_vertexSource +=
+			"layout(std430) readonly buffer Instances { INSTANCE_TEXEL instanceTexels[]; };\n"
+			"INSTANCE_TEXEL instanceTexel(int instance, int texel)\n"
+			"{\n"
+			"\treturn instanceTexels[INSTANCE_TEXELS * instance + texel];\n"
+			"}\n";
+		break;
+	}
+
+	return true;
+}
+
+void InstanceData::destroy()
+{
+	_stream.destroy();
+	_vertexSource.clear();
+
+	glDeleteTextures(1, &_spinTexture);
+	glDeleteBuffers(1, &_spinBuffer);
+	_spinTexture = 0;
+	_spinBuffer = 0;
+	_timeLocation = -1;
+	_baseLocation = -1;
+}
+
+void InstanceData::bindProgram(unsigned int program)
+{
+	if (_path == INSTANCE_PATH_TBO) {
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "Ms"), 0);
+		glUseProgram(0);
+	}
+	else if (_path == INSTANCE_PATH_UBO) {
+		GLuint index = glGetUniformBlockIndex(program, "Instances");
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, index, kBlockBinding);
+	}
+	else if (_path == INSTANCE_PATH_SSBO) {
+		GLuint index = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, "Instances");
+		if (index != GL_INVALID_INDEX)
+			glShaderStorageBlockBinding(program, index, kBlockBinding);
+	}
+
+	if (_animation == INSTANCE_ANIMATION_GPU) {
+		glUseProgram(program);
+		glUniform1i(glGetUniformLocation(program, "instanceSpins"), kSpinTextureUnit);
+		glUseProgram(0);
+
+		_timeLocation = glGetUniformLocation(program, "instanceTime");
+		_baseLocation = glGetUniformLocation(program, "instanceBase");
+	}
+}
+
+void InstanceData::setSpins(const float* phases, const float* speeds)
+{
+	if (!_spinBuffer)
+		return;
+
+	std::vector<float> spins(2 * _instanceCount);
+	for (size_t i = 0; i < _instanceCount; ++i) {
+		spins[2 * i + 0] = phases ? phases[i] : 0.0f;
+		spins[2 * i + 1] = speeds ? speeds[i] : 1.0f;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _spinBuffer);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, sizeof(float) * spins.size(), &spins[0]);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void InstanceData::setTime(float time)
+{
+	if (_timeLocation != -1)
+		glUniform1f(_timeLocation, time);
+}
+
+void InstanceData::draw(unsigned int mode, int first, int vertexCount)
+{
+	drawRegion(mode, first, vertexCount, _instanceCount, 0, nullptr);
+}
+
+void InstanceData::draw(unsigned int mode, int first, int vertexCount, size_t instanceCount)
+{
+	assert(instanceCount <= _instanceCount);
+
+	drawRegion(mode, first, vertexCount, instanceCount, 0, nullptr);
+}
+
+void InstanceData::drawIndirect(unsigned int mode, unsigned int commandBuffer)
+{
+	assert(indexable());
+
+	drawRegion(mode, 0, 0, _instanceCount, commandBuffer, nullptr);
+}
+
+void InstanceData::draw(unsigned int mode, const DrawBatch& batch)
+{
+	assert(_path != INSTANCE_PATH_UBO);
+
+	drawRegion(mode, 0, 0, _instanceCount, 0, &batch);
+}
+
+void InstanceData::drawInstances(unsigned int mode, int first, int vertexCount,
+		size_t instanceCount, unsigned int commandBuffer, const DrawBatch* batch)
+{
+	if (batch) {
+		batch->draw(mode);
+	}
+	else if (commandBuffer) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+		glDrawArraysIndirect(mode, nullptr);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+	else {
+		glDrawArraysInstanced(mode, first, vertexCount, (GLsizei)instanceCount);
+	}
+}
+
+void InstanceData::drawRegion(unsigned int mode, int first, int vertexCount,
+		size_t instanceCount, unsigned int commandBuffer, const DrawBatch* batch)
+{
+	size_t stride = instanceEncodingStride(_encoding);
+	size_t offset = _stream.offset();
+
+	if (_spinTexture) {
+		glActiveTexture(GL_TEXTURE0 + kSpinTextureUnit);
+		glBindTexture(GL_TEXTURE_BUFFER, _spinTexture);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	switch (_path) {
+	case INSTANCE_PATH_TBO:
+		glActiveTexture(GL_TEXTURE0);
+		glBindTexture(GL_TEXTURE_BUFFER, _stream.texture());
+		drawInstances(mode, first, vertexCount, instanceCount, commandBuffer, batch);
+		break;
+
+	case INSTANCE_PATH_ATTRIBUTE: {
+		int texels = instanceEncodingTexels(_encoding);
+		bool packed = _encoding == INSTANCE_ENCODING_HALF;
+		size_t texelSize = stride / texels;
+
+		// The region moves every frame, so the pointers are set per draw.
+		glBindBuffer(GL_ARRAY_BUFFER, _stream.buffer());
+		for (int i = 0; i < texels; ++i) {
+			GLuint location = kFirstAttribute + i;
+			const void* pointer = (const void*)(offset + texelSize * i);
+
+			glEnableVertexAttribArray(location);
+			if (packed)
+				glVertexAttribIPointer(location, 2, GL_UNSIGNED_INT, (GLsizei)stride, pointer);
+			else
+				glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, (GLsizei)stride, pointer);
+			glVertexAttribDivisor(location, 1);
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		drawInstances(mode, first, vertexCount, instanceCount, commandBuffer, batch);
+
+		for (int i = 0; i < texels; ++i)
+			glDisableVertexAttribArray(kFirstAttribute + i);
+		break;
+	}
+
+	case INSTANCE_PATH_UBO:
+		for (size_t begin = 0; begin < instanceCount; begin += _chunkInstances) {
+			size_t count = std::min(_chunkInstances, instanceCount - begin);
+
+			glBindBufferRange(GL_UNIFORM_BUFFER, kBlockBinding, _stream.buffer(),
+					offset + begin * stride, _chunkInstances * stride);
+			if (_baseLocation != -1)
+				glUniform1i(_baseLocation, (GLint)begin);
+			drawInstances(mode, first, vertexCount, count, 0, nullptr);
+		}
+		break;
+
+	case INSTANCE_PATH_SSBO:
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, kBlockBinding, _stream.buffer(),
+				offset, _instanceCount * stride);
+		drawInstances(mode, first, vertexCount, instanceCount, commandBuffer, batch);
+		break;
+	}
+}
@@ -2,8 +2,10 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
+#include <string>
 #include <vector>
 
 #include <signal.h>
@@ -11,14 +13,41 @@
 #include <GL/glew.h>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.hpp"
+#include "benchmark.hpp"
+#include "instancingscene.hpp"
+#include "shaderreload.hpp"
+#include "trace.hpp"
+#include "triplebuffer.hpp"
 
 class InstancingSample : public Sample
 {
 public:
+	InstancingSample()
+		: _vao(0), _program(0), _hotReload(false), _programReload(-1)
+	{
+	}
+
+	// The scene takes the instance, culling and mesh options, see
+	// InstancingScene::parseArguments().
+	// --hot-reload rebuilds the program whenever instancing.vert or
+	// instancing.frag is saved, see ShaderReloader.
+	virtual bool parseArguments(int argc, char** argv)
+	{
+		if (!_scene.parseArguments(argc, argv))
+			return false;
+
+		for (int i = 1; i < argc; ++i) {
+			if (strcmp(argv[i], "--hot-reload") == 0) {
+				_hotReload = true;
+			}
+		}
+
+		return Sample::parseArguments(argc, argv);
+	}
+
 	virtual bool initContents()
 	{
 		glClearColor(0.0f, 0.0f, 0.3f, 0.0f);
@@ -28,111 +57,73 @@ public:
 
 		glBindVertexArray(_vao);
 		{
-			_program = LoadShaders("instancing.vert", "instancing.frag");
-			assert(_program != -1);
-
-			static const GLfloat g_vertex_buffer_data[] = {
-				-1.0f, -1.0f, 0.0f,
-				 1.0f, -1.0f, 0.0f,
-				 0.0f,  1.0f, 0.0f,
-			};
-
-			glGenBuffers(1, &_vbo);
-			assert(_vbo != -1);
-
-			glBindBuffer(GL_ARRAY_BUFFER, _vbo);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
-
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-			GLfloat* transform_buffer_data = new float[16 * 4];
-			{
-				for (int i = 0; i < 4; ++i) {
-					auto T = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, (float)i, 0.0f));
-					auto R = glm::rotate(glm::mat4(1.0f), _globalTimer, glm::vec3(0.0f, 1.0f, 0.0f));
-					auto S = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+			if (!_scene.init(this))
+				return false;
 
-					auto M = T * R * S;
-
-					memcpy(transform_buffer_data + 16 * i, glm::value_ptr(M), sizeof(float) * 16);
-				}
+			_program = LoadShaders("instancing.vert", "instancing.frag",
+					_scene.vertexShaderSource().c_str());
+			assert(_program != -1);
 
-				glGenBuffers(1, &_transformBufferObject);
-				glBindBuffer(GL_TEXTURE_BUFFER, _transformBufferObject);
-				glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * 16 * 4,
-						transform_buffer_data, GL_STATIC_DRAW);
+			bindProgram();
 
-				glGenTextures(1, &_transformTBO);
-				glBindTexture(GL_TEXTURE_BUFFER, _transformTBO);
-				glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _transformBufferObject);
-			}
-			if (transform_buffer_data) {
-				delete[] transform_buffer_data;
-				transform_buffer_data = nullptr;
-			}
+			if (_hotReload)
+				_programReload = _reloader.watch("instancing.vert", "instancing.frag", ShaderDefines(),
+						_scene.vertexShaderSource().c_str());
 		}
 		glBindVertexArray(0);
 
-		_VPID = glGetUniformLocation(_program, "VP");
-		_MsID = glGetUniformLocation(_program, "Ms");
-
 		_globalTimer = 0.0f;
 
+		setBenchmarkProperty("hot_reload", _hotReload ? "yes" : "no");
+		if (_hotReload && !_reloader.start(this))
+			return false;
+
 		return true;
 	}
 
 	virtual void destroyContents()
 	{
-		glDeleteVertexArrays(1, &_vao);
-		glDeleteBuffers(1, &_vbo);
-		glDeleteBuffers(1, &_transformBufferObject);
+		_reloader.stop();
 
-		glDeleteTextures(1, &_transformTBO);
+		glDeleteVertexArrays(1, &_vao);
+		_scene.destroy();
 
 		glDeleteProgram(_program);
 	}
 
-	virtual void update(float dt)
+	virtual bool supportsThreadedUpdate() const
 	{
-		glBindVertexArray(_vao);
-		glBindBuffer(GL_TEXTURE_BUFFER, _transformBufferObject);
-
-		float* pointer = (float*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, sizeof(float) * 16 * 4, GL_MAP_WRITE_BIT);
-		assert(pointer);
+		return true;
+	}
 
-		for (int i = 0; i < 4; ++i) {
-			auto T = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, (float)i, 0.0f));
-			auto R = glm::rotate(glm::mat4(1.0f), _globalTimer, glm::vec3(0.0f, 1.0f, 0.0f));
-			auto S = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+	virtual void update(float dt)
+	{
+		FramePacket& packet = _packets.writeBuffer();
+		_scene.update(packet, _globalTimer, (float)windowWidth() / windowHeight());
+		_packets.publish();
 
-			auto M = T * R * S;
+		_globalTimer += dt;
+	}
 
-			memcpy(pointer + 16 * i, glm::value_ptr(M), sizeof(float) * 16);
+	virtual void render()
+	{
+		// Between frames, so a frame never draws with both the old and the
+		// new program; takeProgram() returns 0 rather than wait for one.
+		if (_reloader.running()) {
+			if (GLuint program = _reloader.takeProgram(_programReload)) {
+				glDeleteProgram(_program);
+				_program = program;
+				bindProgram();
+			}
 		}
 
-		glUnmapBuffer(GL_TEXTURE_BUFFER);
-
-		auto V = glm::lookAt(
-				glm::vec3(3,4,10),
-				glm::vec3(0,0,0),
-				glm::vec3(0,1,0)
-				);
-
-		auto P = glm::perspective(45.0f, (float)windowWidth() / windowHeight(),
-				0.1f, 100.0f);
-
-		auto VP = P * V;
+		_packets.acquire();
 
-		glUseProgram(_program);
-		glUniform1i(_MsID, 0);
-		glUniformMatrix4fv(_VPID, 1, false, glm::value_ptr(VP));
-		glUseProgram(0);
+		const FramePacket& packet = _packets.readBuffer();
+		upload(packet);
 
-		_globalTimer += dt;
-	}
+		_scene.cull(packet, gpuProfiler());
 
-	virtual void render()
-	{
 		glViewport(windowWidth() / 2, windowHeight() / 2, windowWidth(), windowHeight());
 		glClear(GL_COLOR_BUFFER_BIT);
 
@@ -142,9 +133,7 @@ public:
 		{
 			glEnableVertexAttribArray(0);
 
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_BUFFER, _transformTBO);
-			glDrawArraysInstanced(GL_TRIANGLES, 0, 3, 4);
+			_scene.draw(packet);
 
 			glDisableVertexAttribArray(0);
 		}
@@ -153,15 +142,38 @@ public:
 	}
 
 private:
-	GLuint _vao, _vbo;
-	GLuint _transformBufferObject;
-	GLuint _transformTBO;
+	// Uniform locations and bindings of _program, again after a reload.
+	void bindProgram()
+	{
+		_scene.bindProgram(_program);
+
+		_VPID = glGetUniformLocation(_program, "VP");
+	}
+
+	void upload(const FramePacket& packet)
+	{
+		_scene.upload(packet, benchmark());
+
+		glUseProgram(_program);
+		glUniformMatrix4fv(_VPID, 1, false, glm::value_ptr(packet.VP));
+		if (_scene.animation() == INSTANCE_ANIMATION_GPU)
+			_scene.instances().setTime(packet.time);
+		glUseProgram(0);
+	}
+
+	GLuint _vao;
+	InstancingScene _scene;
 
 	GLuint _program;
 	GLuint _VPID;
-	GLuint _MsID;
 
 	float _globalTimer;
+
+	bool _hotReload;
+	ShaderReloader _reloader;
+	int _programReload;
+
+	TripleBuffer<FramePacket> _packets;
 };
 
 Sample* instancingSample = nullptr;
@@ -190,7 +202,16 @@ int main(int argc, char** argv)
 	}
 
 	instancingSample = new InstancingSample();
-	instancingSample->init();
+	if (!instancingSample->parseArguments(argc, argv)) {
+		delete instancingSample;
+		return EXIT_FAILURE;
+	}
+
+	if (!instancingSample->init()) {
+		instancingSample->destroy();
+		delete instancingSample;
+		return EXIT_FAILURE;
+	}
 
 	instancingSample->run();
 
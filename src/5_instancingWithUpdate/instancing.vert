@@ -1,18 +1,23 @@
 #version 330 core
 
+// Meshes bring their own vertex layout (see VertexLayout); the triangle is
+// plain floats.
+#if !defined(VERTEX_LAYOUT)
 layout (location = 0) in vec3 position;
 
-uniform samplerBuffer Ms;
+vec3 vertexPosition()
+{
+	return position;
+}
+#endif
+
 uniform mat4 VP;
 
+#include "instance.glsl"
+
 void main(void)
 {
-	vec4 col0 = texelFetch(Ms, 4 * gl_InstanceID + 0);
-	vec4 col1 = texelFetch(Ms, 4 * gl_InstanceID + 1);
-	vec4 col2 = texelFetch(Ms, 4 * gl_InstanceID + 2);
-	vec4 col3 = texelFetch(Ms, 4 * gl_InstanceID + 3);
-
-	mat4 M = mat4(col0, col1, col2, col3);
+	int instance = drawnInstance();
 
-	gl_Position = VP * M * vec4(position, 1.0);
+	gl_Position = VP * vec4(instanceToWorld(instance, animate(instance, vertexPosition())), 1.0);
 }
@@ -0,0 +1,647 @@
+#include "instancingscene.hpp"
+#include "benchmark.hpp"
+#include "gpuprofiler.hpp"
+#include "meshfile.hpp"
+#include "sample.hpp"
+#include "transformkernel.hpp"
+
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace
+{
+	// Instances handed to one job at a time by update().
+	const size_t kTransformGrainSize = 4096;
+
+	// Bounding sphere radius of the triangle about its origin.
+	const float kInstanceRadius = 1.4143f;
+
+	// Deterministic value in [0, 1) for instance index and seed.
+	float instanceRandom(unsigned int index, unsigned int seed)
+	{
+		unsigned int x = index * 0x9e3779b9u + seed;
+		x ^= x >> 16;
+		x *= 0x7feb352du;
+		x ^= x >> 15;
+		x *= 0x846ca68bu;
+		x ^= x >> 16;
+
+		return (float)(x >> 8) / 16777216.0f;
+	}
+
+	// Columns of four instances, as in the original sample, laid out on a
+	// grid that grows away from the camera as the instance count increases.
+	glm::vec3 instancePosition(int index, int count)
+	{
+		int columns = (count + 3) / 4;
+		int side = 1;
+		while (side * side < columns)
+			++side;
+
+		int column = index / 4;
+
+		return glm::vec3(3.0f * (column % side) - 1.5f * (side - 1),
+				(float)(index % 4), -3.0f * (column / side));
+	}
+
+	// A regular polygon with corners on the unit circle, turned by angle, as a
+	// fan around its first corner.
+	void polygonMesh(int corners, float angle, std::vector<float>& vertices,
+			std::vector<unsigned int>& indices)
+	{
+		vertices.clear();
+		indices.clear();
+
+		for (int i = 0; i < corners; ++i) {
+			float a = angle + 6.2831853f * i / corners;
+			vertices.push_back(-sinf(a));
+			vertices.push_back(cosf(a));
+			vertices.push_back(0.0f);
+		}
+
+		for (int i = 1; i + 1 < corners; ++i) {
+			indices.push_back(0);
+			indices.push_back(i);
+			indices.push_back(i + 1);
+		}
+	}
+}
+
+InstancingScene::InstancingScene()
+	: _vbo(0), _instanceCount(4), _workerCount(-1), _jobs(nullptr),
+	_encoding(INSTANCE_ENCODING_MAT4), _path(INSTANCE_PATH_TBO),
+	_animation(INSTANCE_ANIMATION_CPU), _spinVariation(0.0f), _cullMode(CULL_NONE),
+	_meshCount(0), _submission(DRAW_SUBMISSION_MULTI_INDIRECT),
+	_vertexFormat(VERTEX_FORMAT_FLOAT), _uploadStrategySet(false)
+{
+}
+
+// --instances <n> sets the instance count, --workers <n> the number of
+// job system threads besides the one running update(), --upload <name>
+// the StreamBuffer strategy (subdata, orphan, invalidate, unsynchronized,
+// persistent); the fastest supported one is the default. --encoding <name>
+// picks the instance transform layout (mat4, affine, quat, half) and
+// --path <name> how the shader reads it (tbo, attribute, ubo, ssbo).
+// --animation gpu uploads the transforms once and spins the instances in
+// the vertex shader instead of re-encoding them every frame (cpu), and
+// --spin-variation <0..1> randomizes each instance's phase and speed.
+// --cull gpu draws only the instances in the view frustum, picked by a
+// compute shader (tbo and ssbo paths); --cull cpu picks them before
+// encoding and uploads only those (cpu animation), and --cull bvh does the
+// same walking a bounding volume hierarchy built at startup. --cull meshlet
+// draws only the meshlets of the --mesh file that face the camera within
+// the frustum, picked for every instance by a compute shader (mat4
+// encoding, cpu animation).
+// --meshes <n> splits the instances between n polygons packed into one
+// GeometryPool and --submit <name> draws them with one call per mesh
+// (direct) or a single multi-draw indirect (mdi, the default); --mesh
+// <file> draws the .mesh file (see meshconvert) mapped at startup instead.
+// --vertex-format quantized stores the polygons' vertices as normalized
+// int16 (a file's format is its own).
+bool InstancingScene::parseArguments(int argc, char** argv)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) {
+			_instanceCount = atoi(argv[++i]);
+			if (_instanceCount <= 0) {
+				fprintf(stderr, "Error: invalid instance count %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+			_workerCount = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--encoding") == 0 && i + 1 < argc) {
+			if (!parseInstanceEncoding(argv[++i], &_encoding)) {
+				fprintf(stderr, "Error: unknown instance encoding %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--path") == 0 && i + 1 < argc) {
+			if (!parseInstancePath(argv[++i], &_path)) {
+				fprintf(stderr, "Error: unknown instance path %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--animation") == 0 && i + 1 < argc) {
+			if (!parseInstanceAnimation(argv[++i], &_animation)) {
+				fprintf(stderr, "Error: unknown animation mode %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--spin-variation") == 0 && i + 1 < argc) {
+			_spinVariation = (float)atof(argv[++i]);
+			if (_spinVariation < 0.0f || _spinVariation > 1.0f) {
+				fprintf(stderr, "Error: invalid spin variation %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+			if (!parseCullMode(argv[++i], &_cullMode)) {
+				fprintf(stderr, "Error: unknown cull mode %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--meshes") == 0 && i + 1 < argc) {
+			_meshCount = atoi(argv[++i]);
+			if (_meshCount < 0) {
+				fprintf(stderr, "Error: invalid mesh count %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+			_meshPath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+			if (!parseVertexFormat(argv[++i], &_vertexFormat)) {
+				fprintf(stderr, "Error: unknown vertex format %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--submit") == 0 && i + 1 < argc) {
+			if (!parseDrawSubmission(argv[++i], &_submission)) {
+				fprintf(stderr, "Error: unknown draw submission %s\n", argv[i]);
+				return false;
+			}
+		}
+		else if (strcmp(argv[i], "--upload") == 0 && i + 1 < argc) {
+			if (!parseStreamStrategy(argv[++i], &_uploadStrategy)) {
+				fprintf(stderr, "Error: unknown upload strategy %s\n", argv[i]);
+				return false;
+			}
+			_uploadStrategySet = true;
+		}
+	}
+
+	return true;
+}
+
+bool InstancingScene::init(Sample* sample)
+{
+	if (!_uploadStrategySet)
+		_uploadStrategy = bestStreamStrategy();
+
+	if ((_cullMode == CULL_CPU || _cullMode == CULL_BVH) && _animation != INSTANCE_ANIMATION_CPU) {
+		fprintf(stderr, "Error: CPU and BVH culling need CPU animation\n");
+		return false;
+	}
+
+	// Filled by the first update() before anything is drawn, or below for
+	// GPU animation; also decides how the vertex shader reads the instances.
+	if (!_instances.init(_path, _encoding, _instanceCount, _uploadStrategy, _animation))
+		return false;
+
+	if (!_meshPath.empty())
+		_meshCount = 1;
+
+	if (_meshCount > 0 && ((_cullMode != CULL_NONE && _cullMode != CULL_MESHLET) ||
+			_path == INSTANCE_PATH_UBO)) {
+		fprintf(stderr, "Error: meshes need --cull none or meshlet and the tbo, attribute or ssbo path\n");
+		return false;
+	}
+
+	// The culling shader places the meshlets with the transforms update()
+	// encodes.
+	if (_cullMode == CULL_MESHLET && (_meshPath.empty() || _encoding != INSTANCE_ENCODING_MAT4 ||
+			_animation != INSTANCE_ANIMATION_CPU || _submission != DRAW_SUBMISSION_MULTI_INDIRECT)) {
+		fprintf(stderr, "Error: meshlet culling needs --mesh, the mat4 encoding, CPU animation and mdi\n");
+		return false;
+	}
+
+	_vertexHeader = _instances.vertexShaderSource();
+
+	// The meshes come first: their vertex layout is part of the shader.
+	if (_meshCount > 0) {
+		if (!_batch.init(_submission) || !buildMeshBatch(sample))
+			return false;
+
+		_vertexHeader = _batch.vertexShaderSource() + _vertexHeader +
+			_geometry.layout().vertexShaderSource();
+	}
+
+	if (_cullMode == CULL_GPU) {
+		if (!_instances.indexable()) {
+			fprintf(stderr, "Error: culling needs the tbo or ssbo instance path\n");
+			return false;
+		}
+
+		if (!_culler.init(_instanceCount, 3))
+			return false;
+
+		_vertexHeader += _culler.vertexShaderSource();
+		_culler.bindVertexArray();
+	}
+
+	if (_meshCount == 0) {
+		static const GLfloat g_vertex_buffer_data[] = {
+			-1.0f, -1.0f, 0.0f,
+			 1.0f, -1.0f, 0.0f,
+			 0.0f,  1.0f, 0.0f,
+		};
+
+		glGenBuffers(1, &_vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, _vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
+
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
+	}
+
+	_positionX.resize(_instanceCount);
+	_positionY.resize(_instanceCount);
+	_positionZ.resize(_instanceCount);
+	for (int i = 0; i < _instanceCount; ++i) {
+		glm::vec3 position = instancePosition(i, _instanceCount);
+		_positionX[i] = position.x;
+		_positionY[i] = position.y;
+		_positionZ[i] = position.z;
+	}
+
+	if (_spinVariation > 0.0f) {
+		_spinPhase.resize(_instanceCount);
+		_spinSpeed.resize(_instanceCount);
+		_spinAngle.resize(_instanceCount);
+		for (int i = 0; i < _instanceCount; ++i) {
+			_spinPhase[i] = 6.2831853f * _spinVariation * instanceRandom(i, 1);
+			_spinSpeed[i] = 1.0f + _spinVariation * (2.0f * instanceRandom(i, 2) - 1.0f);
+		}
+	}
+
+	if (_animation == INSTANCE_ANIMATION_GPU)
+		uploadBaseTransforms();
+
+	if (_cullMode != CULL_NONE)
+		_radius.assign(_instanceCount, kInstanceRadius);
+
+	if (_cullMode == CULL_GPU)
+		_culler.setSpheres(boundingSpheres());
+
+	if (_cullMode == CULL_CPU || _cullMode == CULL_BVH) {
+		_visibleX.resize(_instanceCount);
+		_visibleY.resize(_instanceCount);
+		_visibleZ.resize(_instanceCount);
+		if (!_spinPhase.empty())
+			_visibleAngle.resize(_instanceCount);
+	}
+
+	// The instances never move, so the tree is built once and never refit.
+	if (_cullMode == CULL_BVH) {
+		double start = Benchmark::now();
+		_bvh.build(boundingSpheres(), _instanceCount);
+
+		sample->setBenchmarkProperty("bvh_build_ms", (Benchmark::now() - start) * 1000.0);
+		sample->setBenchmarkProperty("bvh_nodes", (double)_bvh.nodeCount());
+	}
+
+	_jobs = new JobSystem(_workerCount);
+
+	sample->setBenchmarkProperty("instances", _instanceCount);
+	sample->setBenchmarkProperty("job_threads", _jobs->threadCount());
+	sample->setBenchmarkProperty("upload_strategy", streamStrategyName(_instances.strategy()));
+	sample->setBenchmarkProperty("transform_kernel", transformKernelName(bestTransformKernel()));
+	sample->setBenchmarkProperty("encoding", instanceEncodingName(_encoding));
+	sample->setBenchmarkProperty("instance_path", instancePathName(_path));
+	sample->setBenchmarkProperty("animation", instanceAnimationName(_animation));
+	sample->setBenchmarkProperty("spin_variation", _spinVariation);
+	sample->setBenchmarkProperty("cull", cullModeName(_cullMode));
+	sample->setBenchmarkProperty("meshes", _meshCount);
+	if (_meshCount > 0) {
+		sample->setBenchmarkProperty("draw_submission", drawSubmissionName(_submission));
+		sample->setBenchmarkProperty("draw_parameters", _batch.drawParameters() ? "yes" : "no");
+		sample->setBenchmarkProperty("draw_calls", (double)_batch.callCount());
+		sample->setBenchmarkProperty("vertex_format", vertexFormatName(_geometry.layout().format()));
+		sample->setBenchmarkProperty("vertex_stride", (double)_geometry.vertexStride());
+		sample->setBenchmarkProperty("vertex_bytes", (double)_geometry.vertexBytes());
+		if (_cullMode == CULL_MESHLET)
+			sample->setBenchmarkProperty("meshlets", (double)_meshletCuller.meshletCount());
+	}
+	sample->setBenchmarkProperty("bytes_per_instance", (double)instanceEncodingStride(_encoding));
+	sample->setBenchmarkProperty("upload_bytes_per_frame", _animation == INSTANCE_ANIMATION_GPU ?
+			0.0 : (double)(instanceEncodingStride(_encoding) * _instanceCount));
+
+	return true;
+}
+
+void InstancingScene::destroy()
+{
+	delete _jobs;
+	_jobs = nullptr;
+
+	glDeleteBuffers(1, &_vbo);
+	_vbo = 0;
+
+	_instances.destroy();
+	_culler.destroy();
+	_meshletCuller.destroy();
+	_geometry.destroy();
+	_batch.destroy();
+}
+
+void InstancingScene::bindProgram(unsigned int program)
+{
+	_instances.bindProgram(program);
+	if (_meshCount > 0) {
+		_batch.bindProgram(program);
+		_geometry.bindProgram(program);
+	}
+}
+
+void InstancingScene::update(FramePacket& packet, float time, float aspect)
+{
+	packet.time = time;
+	packet.instanceCount = _instanceCount;
+
+	glm::vec3 eye(3,4,10);
+	auto V = glm::lookAt(
+			eye,
+			glm::vec3(0,0,0),
+			glm::vec3(0,1,0)
+			);
+
+	auto P = glm::perspective(45.0f, aspect, 0.1f, 100.0f);
+
+	packet.VP = P * V;
+	packet.eye = eye;
+
+	if (_cullMode == CULL_BVH) {
+		// What a click in the middle of the window would select.
+		double start = Benchmark::now();
+		glm::vec3 direction = -eye;
+		_bvh.raycast(&eye.x, &direction.x);
+		packet.pickMilliseconds = (Benchmark::now() - start) * 1000.0;
+	}
+
+	if (_cullMode == CULL_CPU || _cullMode == CULL_BVH) {
+		encodeVisibleInstances(packet, time);
+	}
+	else if (_animation == INSTANCE_ANIMATION_CPU) {
+		packet.instances.resize(instanceEncodingStride(_encoding) * _instanceCount);
+
+		InstanceTransforms instances = baseTransforms();
+		float angle = time;
+
+		if (!_spinAngle.empty()) {
+			instances.angle = &_spinAngle[0];
+			angle = 0.0f;
+		}
+
+		unsigned char* out = &packet.instances[0];
+
+		_jobs->parallelFor(_instanceCount, kTransformGrainSize, [&](size_t begin, size_t end) {
+			// Each job fills the angles it is about to encode.
+			for (size_t i = begin; instances.angle && i < end; ++i)
+				_spinAngle[i] = _spinPhase[i] + _spinSpeed[i] * time;
+
+			encodeInstances(_encoding, instances, angle, begin, end, out);
+		});
+	}
+}
+
+void InstancingScene::upload(const FramePacket& packet, Benchmark* benchmark)
+{
+	if (!packet.instances.empty()) {
+		double start = Benchmark::now();
+
+		void* pointer = _instances.map(packet.instanceCount);
+		assert(pointer);
+
+		memcpy(pointer, &packet.instances[0], packet.instances.size());
+
+		_instances.unmap();
+
+		if (benchmark) {
+			benchmark->record("upload_ms", (Benchmark::now() - start) * 1000.0);
+			benchmark->record("stream_wait_ms", _instances.waitMilliseconds());
+		}
+	}
+
+	if ((_cullMode == CULL_CPU || _cullMode == CULL_BVH) && benchmark) {
+		benchmark->record("cull_ms", packet.cullMilliseconds);
+		benchmark->record("visible_instances", (double)packet.instanceCount);
+	}
+
+	if (_cullMode == CULL_BVH && benchmark)
+		benchmark->record("pick_ms", packet.pickMilliseconds);
+}
+
+void InstancingScene::cull(const FramePacket& packet, GpuProfiler* profiler)
+{
+	if (_cullMode == CULL_GPU) {
+		GpuZone zone(profiler, "cull");
+		_culler.cull(glm::value_ptr(packet.VP));
+	}
+
+	if (_cullMode == CULL_MESHLET && !packet.instances.empty()) {
+		GpuZone zone(profiler, "cull");
+		_meshletCuller.setTransforms((const float*)&packet.instances[0]);
+		_meshletCuller.cull(glm::value_ptr(packet.VP), glm::value_ptr(packet.eye));
+	}
+}
+
+void InstancingScene::draw(const FramePacket& packet)
+{
+	// Meshlet culling drops the clusters facing away, which is only right
+	// when back faces are not drawn anyway.
+	if (_cullMode == CULL_MESHLET)
+		glEnable(GL_CULL_FACE);
+
+	if (_cullMode == CULL_GPU)
+		_instances.drawIndirect(GL_TRIANGLES, _culler.commandBuffer());
+	else if (_meshCount > 0)
+		_instances.draw(GL_TRIANGLES, _batch);
+	else
+		_instances.draw(GL_TRIANGLES, 0, 3, packet.instanceCount);
+
+	glDisable(GL_CULL_FACE);
+
+	// The region may only be rewritten once this draw has consumed it.
+	_instances.fence();
+}
+
+InstanceTransforms InstancingScene::baseTransforms() const
+{
+	InstanceTransforms instances = {};
+	instances.x = &_positionX[0];
+	instances.y = &_positionY[0];
+	instances.z = &_positionZ[0];
+
+	return instances;
+}
+
+BoundingSpheres InstancingScene::boundingSpheres() const
+{
+	BoundingSpheres spheres = { &_positionX[0], &_positionY[0], &_positionZ[0], &_radius[0] };
+
+	return spheres;
+}
+
+// CPU and BVH culling: gathers the visible instances in culled order, a
+// chunk per job, and encodes only those, so they are all the frame uploads.
+void InstancingScene::encodeVisibleInstances(FramePacket& packet, float time)
+{
+	double start = Benchmark::now();
+
+	if (_cullMode == CULL_BVH) {
+		float planes[24];
+		frustumPlanes(glm::value_ptr(packet.VP), planes);
+
+		_bvhVisible.clear();
+		packet.instanceCount = _bvh.cullFrustum(planes, _bvhVisible);
+
+		// Back in instance order, which is the order they are blended in.
+		std::sort(_bvhVisible.begin(), _bvhVisible.end());
+	}
+	else {
+		_frustumCuller.cull(*_jobs, boundingSpheres(), _instanceCount, glm::value_ptr(packet.VP));
+		packet.instanceCount = _frustumCuller.visibleCount();
+	}
+
+	packet.instances.resize(instanceEncodingStride(_encoding) * packet.instanceCount);
+
+	if (packet.instanceCount > 0) {
+		InstanceTransforms visible = {};
+		visible.x = &_visibleX[0];
+		visible.y = &_visibleY[0];
+		visible.z = &_visibleZ[0];
+
+		float angle = time;
+
+		if (!_visibleAngle.empty()) {
+			visible.angle = &_visibleAngle[0];
+			angle = 0.0f;
+		}
+
+		unsigned char* out = &packet.instances[0];
+
+		auto encodeChunk = [&](size_t offset, const unsigned int* indices, size_t count) {
+			for (size_t k = 0; k < count; ++k) {
+				unsigned int i = indices[k];
+
+				_visibleX[offset + k] = _positionX[i];
+				_visibleY[offset + k] = _positionY[i];
+				_visibleZ[offset + k] = _positionZ[i];
+				if (visible.angle)
+					_visibleAngle[offset + k] = _spinPhase[i] + _spinSpeed[i] * time;
+			}
+
+			encodeInstances(_encoding, visible, angle, offset, offset + count, out);
+		};
+
+		if (_cullMode == CULL_BVH) {
+			_jobs->parallelFor(packet.instanceCount, kTransformGrainSize, [&](size_t begin, size_t end) {
+				encodeChunk(begin, &_bvhVisible[begin], end - begin);
+			});
+		}
+		else {
+			_frustumCuller.forEachChunk(*_jobs, encodeChunk);
+		}
+	}
+
+	packet.cullMilliseconds = (Benchmark::now() - start) * 1000.0;
+}
+
+// --meshes: polygons of three to ten corners, each at a few turns, packed
+// into one pool, and the instances split between them in order. --mesh:
+// the first level of detail of the file, uploaded from its mapping.
+bool InstancingScene::buildMeshBatch(Sample* sample)
+{
+	if (!_meshPath.empty()) {
+		double start = Benchmark::now();
+
+		MeshFile file;
+		if (!file.open(_meshPath.c_str()))
+			return false;
+
+		const MeshLod& lod = file.lod(0);
+		VertexLayout layout;
+		layout.init(file.header());
+		_geometry.init(layout);
+		_geometry.addMeshView(file.lodVertices(0), lod.vertexCount, file.indices() + lod.firstIndex, lod.indexCount);
+		_geometry.upload();
+
+		sample->setBenchmarkProperty("mesh_load_ms", (Benchmark::now() - start) * 1000.0);
+		sample->setBenchmarkProperty("mesh_bytes", (double)file.size());
+
+		if (_cullMode == CULL_MESHLET) {
+			if (!_batch.drawParameters()) {
+				fprintf(stderr, "Error: meshlet culling needs GL_ARB_shader_draw_parameters\n");
+				return false;
+			}
+
+			if (lod.meshletCount == 0) {
+				fprintf(stderr, "Error: %s has no meshlets\n", _meshPath.c_str());
+				return false;
+			}
+
+			if (!_meshletCuller.init(file.meshlets() + lod.firstMeshlet, lod.meshletCount,
+					_geometry.mesh(0), _instanceCount))
+				return false;
+
+			_batch.setGeneratedDraws(_meshletCuller.commandBuffer(), _meshletCuller.countBuffer(),
+					_meshletCuller.maxDraws());
+		}
+	}
+	else {
+		// Every polygon lies within the unit circle.
+		static const float kBoundsMin[] = { -1.0f, -1.0f, 0.0f };
+		static const float kBoundsMax[] = { 1.0f, 1.0f, 0.0f };
+
+		VertexLayout layout;
+		layout.init(MESH_ATTRIBUTE_POSITION, _vertexFormat, kBoundsMin, kBoundsMax);
+		_geometry.init(layout);
+
+		std::vector<float> vertices;
+		std::vector<unsigned int> indices;
+		std::vector<unsigned char> encoded;
+		for (int m = 0; m < _meshCount; ++m) {
+			polygonMesh(3 + m % 8, 0.1f * (m / 8), vertices, indices);
+
+			size_t count = vertices.size() / 3;
+			encoded.resize(count * layout.stride());
+			layout.encode(&vertices[0], count, &encoded[0]);
+			_geometry.addMesh(&encoded[0], count, &indices[0], indices.size());
+		}
+
+		_geometry.upload();
+	}
+
+	_geometry.bindVertexArray();
+
+	_batch.bindVertexArray();
+
+	_batch.clear();
+	for (int m = 0; m < _meshCount; ++m) {
+		unsigned int begin = (unsigned int)((long long)_instanceCount * m / _meshCount);
+		unsigned int end = (unsigned int)((long long)_instanceCount * (m + 1) / _meshCount);
+		if (end > begin)
+			_batch.add(_geometry.mesh(m), end - begin, begin);
+	}
+	_batch.upload();
+
+	return true;
+}
+
+// GPU animation: the transforms at angle zero, written once; the spins
+// carry everything that changes.
+void InstancingScene::uploadBaseTransforms()
+{
+	void* pointer = _instances.map();
+	assert(pointer);
+
+	InstanceTransforms instances = baseTransforms();
+	encodeInstances(_encoding, instances, 0.0f, 0, _instanceCount, pointer);
+
+	_instances.unmap();
+
+	_instances.setSpins(_spinPhase.empty() ? nullptr : &_spinPhase[0],
+			_spinSpeed.empty() ? nullptr : &_spinSpeed[0]);
+}
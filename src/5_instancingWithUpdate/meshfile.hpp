@@ -0,0 +1,133 @@
+#ifndef MESHFILE_H_
+#define MESHFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+// Binary mesh container (.mesh), written by meshconvert and read in place
+// from a memory mapping: a MeshFileHeader, then the vertex stream, the
+// 32-bit index stream and the LOD table, each starting on its own
+// kMeshStreamAlignment boundary. Everything is little endian and laid out
+// the way GL takes it, so loading is mapping the file and pointing
+// glBufferData() at the streams.
+static const char kMeshFileMagic[4] = { 'O', 'G', 'C', 'M' };
+static const uint32_t kMeshFileVersion = 2;
+static const uint32_t kMeshStreamAlignment = 4096;
+
+// Vertex attributes, interleaved in this order: position (3 floats),
+// normal (3 floats), texture coordinate (2 floats), tangent (3 floats and
+// the bitangent sign). The file may hold them quantized; see VertexLayout.
+enum MeshAttribute
+{
+	MESH_ATTRIBUTE_POSITION = 1 << 0,
+	MESH_ATTRIBUTE_NORMAL = 1 << 1,
+	MESH_ATTRIBUTE_TEXCOORD = 1 << 2,
+	MESH_ATTRIBUTE_TANGENT = 1 << 3,
+};
+
+// Bytes per float vertex of an attribute mask, and where in the vertex one
+// of them starts (-1 when absent).
+uint32_t meshVertexStride(uint32_t attributes);
+int meshAttributeOffset(uint32_t attributes, MeshAttribute attribute);
+
+struct MeshFileHeader
+{
+	char magic[4];
+	uint32_t version;
+
+	// Byte offsets from the start of the file.
+	uint64_t fileSize;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint64_t lodOffset;
+	uint64_t meshletOffset;
+
+	uint32_t attributes;
+	uint32_t vertexStride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t lodCount;
+	// A VertexFormat; vertexStride follows from it and attributes.
+	uint32_t vertexFormat;
+	uint32_t meshletCount;
+
+	// Of all vertices, and the frame quantized positions are relative to.
+	float boundsMin[3];
+	float boundsMax[3];
+	float sphereCenter[3];
+	float sphereRadius;
+};
+
+// One level of detail: indexCount indices from firstIndex, counting from
+// vertex baseVertex, like a PoolMesh. Level 0 is the full mesh; level n is
+// meant from distance on. Its triangles are split into meshletCount
+// meshlets from firstMeshlet.
+struct MeshLod
+{
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	int32_t baseVertex;
+	uint32_t vertexCount;
+	float distance;
+	uint32_t firstMeshlet;
+	uint32_t meshletCount;
+};
+
+// A cluster of neighbouring triangles of one level of detail, culled as a
+// whole (see meshlet.hpp and MeshletCuller): triangleCount triangles from
+// index firstIndex of the level, using vertexCount distinct vertices. In
+// mesh space, its bounding sphere and the cone around coneAxis holding
+// every triangle's normal; coneCutoff is the sine of the cone's half
+// angle, or 1 when the normals spread too far to ever cull. Laid out as
+// std430 (vec4, vec4, uvec4) for the culling shader.
+struct Meshlet
+{
+	float center[3];
+	float radius;
+	float coneAxis[3];
+	float coneCutoff;
+	uint32_t firstIndex;
+	uint32_t triangleCount;
+	uint32_t vertexCount;
+	uint32_t reserved;
+};
+
+// A .mesh file mapped read-only. open() checks that the header and the
+// streams it describes fit the file, but reads none of the streams: their
+// pages only come in when something touches them, which for a mesh going
+// to the GPU is the driver copying them out in glBufferData().
+class MeshFile
+{
+public:
+	MeshFile();
+	~MeshFile();
+
+	MeshFile(const MeshFile&) = delete;
+	MeshFile& operator=(const MeshFile&) = delete;
+
+	bool open(const char* path);
+	void close();
+
+	const MeshFileHeader& header() const { return *(const MeshFileHeader*)_data; }
+
+	const void* vertices() const { return _data + header().vertexOffset; }
+	const uint32_t* indices() const { return (const uint32_t*)(_data + header().indexOffset); }
+	const MeshLod& lod(int level) const { return ((const MeshLod*)(_data + header().lodOffset))[level]; }
+	const Meshlet* meshlets() const { return (const Meshlet*)(_data + header().meshletOffset); }
+
+	// The vertices of one level, from its base vertex.
+	const void* lodVertices(int level) const;
+
+	size_t size() const { return _size; }
+
+private:
+	const unsigned char* _data;
+	size_t _size;
+
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#endif
+};
+
+#endif // MESHFILE_H_
@@ -0,0 +1,38 @@
+#ifndef SHADERPREPROCESSOR_H_
+#define SHADERPREPROCESSOR_H_
+
+#include <map>
+#include <string>
+#include <vector>
+
+// Feature switches a shader is built with, each a #define right after
+// #version. Kept sorted, so the same set gives the same source, and the
+// same ShaderVariants key, whatever order it was made in.
+class ShaderDefines
+{
+public:
+	ShaderDefines& set(const std::string& name, const std::string& value = "1");
+	ShaderDefines& set(const std::string& name, int value);
+	ShaderDefines& unset(const std::string& name);
+
+	bool empty() const { return _values.empty(); }
+
+	// The #define lines.
+	std::string source() const;
+
+private:
+	std::map<std::string, std::string> _values;
+};
+
+// The shader at path ready for glShaderSource(): defines and then header
+// (e.g. InstanceData's declarations) right after #version, and every
+// #include "file" line replaced by file, found next to the file including
+// it. A file goes in once per shader, so shared ones need no guards.
+// #line directives keep the driver's log pointing into the files: source
+// n is the nth file read, 0 being path. Files come from ShaderSource, so
+// from the shader pack when there is one; files gets their paths, path
+// first, e.g. to watch them.
+bool preprocessShader(const char* path, const ShaderDefines& defines, const char* header,
+		std::string* source, std::vector<std::string>* files = nullptr);
+
+#endif // SHADERPREPROCESSOR_H_
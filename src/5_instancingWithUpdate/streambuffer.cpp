@@ -0,0 +1,291 @@
+#include "streambuffer.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+#include <GL/glew.h>
+
+#include "benchmark.hpp"
+#include "trace.hpp"
+
+static const char* const kStrategyNames[] = {
+	"subdata", "orphan", "invalidate", "unsynchronized", "persistent",
+};
+
+StreamStrategy bestStreamStrategy()
+{
+	return streamStrategySupported(STREAM_PERSISTENT) ? STREAM_PERSISTENT : STREAM_UNSYNCHRONIZED;
+}
+
+bool streamStrategySupported(StreamStrategy strategy)
+{
+	if (strategy == STREAM_PERSISTENT) {
+		return (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage) &&
+			(GLEW_VERSION_4_3 || GLEW_ARB_texture_buffer_range);
+	}
+
+	return true;
+}
+
+const char* streamStrategyName(StreamStrategy strategy)
+{
+	return kStrategyNames[strategy];
+}
+
+bool parseStreamStrategy(const char* name, StreamStrategy* strategy)
+{
+	for (int i = 0; i <= STREAM_PERSISTENT; ++i) {
+		if (strcmp(name, kStrategyNames[i]) == 0) {
+			*strategy = (StreamStrategy)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+StreamBuffer::StreamBuffer()
+	: _strategy(STREAM_BUFFER_SUBDATA), _regionSize(0), _regionCount(0), _current(0),
+	_mappedBytes(0), _mapped(nullptr), _waitMilliseconds(0.0)
+{
+	for (int i = 0; i < kMaxRegions; ++i) {
+		_buffers[i] = 0;
+		_textures[i] = 0;
+		_fences[i] = nullptr;
+	}
+}
+
+StreamBuffer::~StreamBuffer()
+{
+}
+
+bool StreamBuffer::init(size_t regionSize, unsigned int format,
+		StreamStrategy strategy, int regionCount)
+{
+	if (!streamStrategySupported(strategy)) {
+		fprintf(stderr, "Error: upload strategy %s is not supported\n", streamStrategyName(strategy));
+		return false;
+	}
+
+	_strategy = strategy;
+	if (!ring())
+		regionCount = 1;
+
+	if (regionCount < 1 || regionCount > kMaxRegions || regionSize == 0) {
+		fprintf(stderr, "Error: invalid stream buffer layout %d x %zu\n", regionCount, regionSize);
+		return false;
+	}
+
+	_regionCount = regionCount;
+	_current = 0;
+
+	glGenTextures(regionCount, _textures);
+
+	if (_strategy == STREAM_PERSISTENT) {
+		// Every region starts where a texture buffer view, uniform block or
+		// storage block may start.
+		GLint alignment = 1, uniformAlignment = 1, storageAlignment = 1;
+		glGetIntegerv(GL_TEXTURE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+		if (GLEW_VERSION_4_3 || GLEW_ARB_shader_storage_buffer_object)
+			glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+
+		alignment = std::max(alignment, std::max(uniformAlignment, storageAlignment));
+		if (alignment < 1)
+			alignment = 1;
+
+		_regionSize = (regionSize + alignment - 1) / alignment * alignment;
+
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+		glGenBuffers(1, _buffers);
+		glBindBuffer(GL_TEXTURE_BUFFER, _buffers[0]);
+		glBufferStorage(GL_TEXTURE_BUFFER, _regionSize * regionCount, nullptr, flags);
+
+		_mapped = (unsigned char*)glMapBufferRange(GL_TEXTURE_BUFFER, 0,
+				_regionSize * regionCount, flags);
+		if (!_mapped) {
+			fprintf(stderr, "Error: cannot map stream buffer persistently\n");
+			destroy();
+			return false;
+		}
+
+		for (int i = 0; i < regionCount; ++i) {
+			glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+			glTexBufferRange(GL_TEXTURE_BUFFER, format, _buffers[0],
+					_regionSize * i, regionSize);
+		}
+	}
+	else {
+		_regionSize = regionSize;
+
+		glGenBuffers(regionCount, _buffers);
+		for (int i = 0; i < regionCount; ++i) {
+			glBindBuffer(GL_TEXTURE_BUFFER, _buffers[i]);
+			glBufferData(GL_TEXTURE_BUFFER, _regionSize, nullptr, GL_STREAM_DRAW);
+
+			glBindTexture(GL_TEXTURE_BUFFER, _textures[i]);
+			glTexBuffer(GL_TEXTURE_BUFFER, format, _buffers[i]);
+		}
+
+		if (_strategy == STREAM_BUFFER_SUBDATA)
+			_staging.resize(_regionSize);
+	}
+
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return true;
+}
+
+void StreamBuffer::destroy()
+{
+	for (int i = 0; i < kMaxRegions; ++i) {
+		if (_fences[i])
+			glDeleteSync((GLsync)_fences[i]);
+		_fences[i] = nullptr;
+	}
+
+	if (_mapped) {
+		glBindBuffer(GL_TEXTURE_BUFFER, _buffers[0]);
+		glUnmapBuffer(GL_TEXTURE_BUFFER);
+		glBindBuffer(GL_TEXTURE_BUFFER, 0);
+		_mapped = nullptr;
+	}
+
+	glDeleteTextures(kMaxRegions, _textures);
+	glDeleteBuffers(kMaxRegions, _buffers);
+
+	for (int i = 0; i < kMaxRegions; ++i) {
+		_buffers[i] = 0;
+		_textures[i] = 0;
+	}
+
+	_staging.clear();
+	_regionCount = 0;
+	_regionSize = 0;
+}
+
+bool StreamBuffer::waitRegion(int region)
+{
+	GLsync fence = (GLsync)_fences[region];
+	_waitMilliseconds = 0.0;
+
+	if (!fence)
+		return true;
+
+	// Polling first keeps the common, already signalled case free of a
+	// flush and of the trace zone.
+	GLenum status = glClientWaitSync(fence, 0, 0);
+
+	if (status == GL_TIMEOUT_EXPIRED) {
+		TRACE_ZONE("StreamBuffer wait");
+
+		double start = Benchmark::now();
+		do {
+			status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		} while (status == GL_TIMEOUT_EXPIRED);
+
+		_waitMilliseconds = (Benchmark::now() - start) * 1000.0;
+	}
+
+	glDeleteSync(fence);
+	_fences[region] = nullptr;
+
+	if (status == GL_WAIT_FAILED) {
+		fprintf(stderr, "Error: stream buffer fence wait failed\n");
+		return false;
+	}
+
+	return true;
+}
+
+void* StreamBuffer::map(size_t bytes)
+{
+	// glMapBufferRange() takes no empty range.
+	assert(bytes > 0 && bytes <= _regionSize);
+	_mappedBytes = bytes;
+
+	switch (_strategy) {
+	case STREAM_PERSISTENT:
+		if (!waitRegion(_current))
+			return nullptr;
+
+		return _mapped + _regionSize * _current;
+
+	case STREAM_BUFFER_SUBDATA:
+		_waitMilliseconds = 0.0;
+		return &_staging[0];
+
+	default:
+		break;
+	}
+
+	if (_strategy == STREAM_UNSYNCHRONIZED && !waitRegion(_current))
+		return nullptr;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _buffers[_current]);
+
+	// Implicit synchronization, if the driver needs any, happens in here.
+	double start = Benchmark::now();
+	void* pointer = nullptr;
+
+	if (_strategy == STREAM_ORPHAN) {
+		glBufferData(GL_TEXTURE_BUFFER, _regionSize, nullptr, GL_STREAM_DRAW);
+		pointer = glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT);
+	}
+	else if (_strategy == STREAM_INVALIDATE) {
+		pointer = glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	}
+	else {
+		// Our fence already guarantees the GPU is done with this region.
+		// No invalidate bit: that lets the driver orphan the store, which
+		// is STREAM_INVALIDATE again rather than the ring on its own.
+		pointer = glMapBufferRange(GL_TEXTURE_BUFFER, 0, bytes,
+				GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	}
+
+	if (_strategy != STREAM_UNSYNCHRONIZED)
+		_waitMilliseconds = (Benchmark::now() - start) * 1000.0;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	return pointer;
+}
+
+void StreamBuffer::unmap()
+{
+	// Coherent persistent writes become visible without any call.
+	if (_strategy == STREAM_PERSISTENT)
+		return;
+
+	glBindBuffer(GL_TEXTURE_BUFFER, _buffers[_current]);
+
+	if (_strategy == STREAM_BUFFER_SUBDATA) {
+		double start = Benchmark::now();
+		glBufferSubData(GL_TEXTURE_BUFFER, 0, _mappedBytes, &_staging[0]);
+		_waitMilliseconds = (Benchmark::now() - start) * 1000.0;
+	}
+	else {
+		glUnmapBuffer(GL_TEXTURE_BUFFER);
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void StreamBuffer::fence()
+{
+	// The single buffer strategies leave synchronization to the driver.
+	if (!ring() || _regionCount == 0)
+		return;
+
+	if (_fences[_current])
+		glDeleteSync((GLsync)_fences[_current]);
+
+	_fences[_current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	_current = (_current + 1) % _regionCount;
+}
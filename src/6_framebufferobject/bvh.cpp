@@ -0,0 +1,562 @@
+#include "bvh.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+
+// Deepest level build() splits; the queries' fixed traversal stacks rely on
+// it. A range still too large there becomes one bigger leaf.
+static const int kMaxDepth = 64;
+
+// Levels of the tree refit() walks serially; the subtrees below are the
+// parallel tasks, up to 2^kRefitDepth of them.
+static const int kRefitDepth = 8;
+
+// Spheres copied per job by refit().
+static const size_t kRefitGrainSize = 16384;
+
+static const unsigned int kNoParent = ~0u;
+
+// Four lanes, the last one unused, so the compiler keeps a box in one
+// vector register and grows it with vector min and max.
+struct Box
+{
+	float min[4], max[4];
+
+	Box()
+	{
+		for (int lane = 0; lane < 4; ++lane) {
+			min[lane] = FLT_MAX;
+			max[lane] = -FLT_MAX;
+		}
+	}
+
+	void grow(const float* low, const float* high)
+	{
+		for (int lane = 0; lane < 4; ++lane) {
+			min[lane] = min[lane] < low[lane] ? min[lane] : low[lane];
+			max[lane] = max[lane] > high[lane] ? max[lane] : high[lane];
+		}
+	}
+
+	void grow(const float* point) { grow(point, point); }
+
+	void grow(const BvhNode& node)
+	{
+		for (int axis = 0; axis < 3; ++axis) {
+			min[axis] = std::min(min[axis], node.min[axis]);
+			max[axis] = std::max(max[axis], node.max[axis]);
+		}
+	}
+
+	// Half the surface area, which is all the heuristic compares.
+	float area() const
+	{
+		if (min[0] > max[0])
+			return 0.0f;
+
+		float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+		return dx * dy + dy * dz + dz * dx;
+	}
+};
+
+// A sphere (x, y, z, radius) and its box, in four lanes each.
+static void sphereBounds(const float* sphere, float* low, float* high)
+{
+	for (int lane = 0; lane < 4; ++lane) {
+		low[lane] = sphere[lane] - sphere[3];
+		high[lane] = sphere[lane] + sphere[3];
+	}
+}
+
+InstanceBvh::InstanceBvh()
+{
+}
+
+void InstanceBvh::build(const BoundingSpheres& spheres, size_t count)
+{
+	_nodes.clear();
+	_instances.resize(count);
+	_slots.resize(count);
+	_spheres.resize(4 * count);
+
+	if (count == 0) {
+		planRefit();
+		return;
+	}
+
+	// The spheres are partitioned together with their indices, so every
+	// pass over a range reads it sequentially.
+	struct Item
+	{
+		float sphere[4];
+		unsigned int instance;
+	};
+
+	std::vector<Item> items(count);
+	for (size_t i = 0; i < count; ++i) {
+		Item& item = items[i];
+		item.sphere[0] = spheres.x[i];
+		item.sphere[1] = spheres.y[i];
+		item.sphere[2] = spheres.z[i];
+		item.sphere[3] = spheres.radius[i];
+		item.instance = (unsigned int)i;
+	}
+
+	struct Range
+	{
+		unsigned int begin, end;
+		unsigned int parent;
+		int depth;
+	};
+
+	// Depth first: the left half is always taken next, so it lands right
+	// after its parent, and the right half's parent learns its index when
+	// it is finally taken.
+	std::vector<Range> stack;
+	Range top = { 0, (unsigned int)count, kNoParent, 0 };
+	stack.push_back(top);
+
+	_nodes.reserve(2 * count / kMaxLeafSize + 1);
+
+	while (!stack.empty()) {
+		Range range = stack.back();
+		stack.pop_back();
+
+		unsigned int index = (unsigned int)_nodes.size();
+		if (range.parent != kNoParent)
+			_nodes[range.parent].first = index;
+
+		Box box, centroids;
+		for (unsigned int k = range.begin; k < range.end; ++k) {
+			float low[4], high[4];
+			sphereBounds(items[k].sphere, low, high);
+			box.grow(low, high);
+			centroids.grow(items[k].sphere);
+		}
+
+		BvhNode node;
+		for (int axis = 0; axis < 3; ++axis) {
+			node.min[axis] = box.min[axis];
+			node.max[axis] = box.max[axis];
+		}
+
+		unsigned int size = range.end - range.begin;
+		if (size <= kMaxLeafSize || range.depth >= kMaxDepth - 1) {
+			node.first = range.begin;
+			node.count = size;
+			_nodes.push_back(node);
+			continue;
+		}
+
+		// Bin the centroids on all three axes in one pass and take the
+		// boundary with the lowest area times count summed over both sides.
+		float scales[3];
+		for (int axis = 0; axis < 3; ++axis) {
+			float extent = centroids.max[axis] - centroids.min[axis];
+			scales[axis] = extent > 0.0f ? kBinCount / extent : 0.0f;
+		}
+
+		Box binBoxes[3][kBinCount];
+		unsigned int binCounts[3][kBinCount] = {};
+
+		for (unsigned int k = range.begin; k < range.end; ++k) {
+			float low[4], high[4];
+			sphereBounds(items[k].sphere, low, high);
+
+			for (int axis = 0; axis < 3; ++axis) {
+				int bin = std::min(kBinCount - 1,
+						(int)((items[k].sphere[axis] - centroids.min[axis]) * scales[axis]));
+				binBoxes[axis][bin].grow(low, high);
+				++binCounts[axis][bin];
+			}
+		}
+
+		int bestAxis = -1, bestSplit = 0;
+		float bestCost = FLT_MAX;
+
+		for (int axis = 0; axis < 3; ++axis) {
+			if (scales[axis] == 0.0f)
+				continue;
+
+			// rightCosts[s]: bins s and above.
+			float rightCosts[kBinCount];
+			Box right;
+			unsigned int rightCount = 0;
+			for (int bin = kBinCount - 1; bin > 0; --bin) {
+				right.grow(binBoxes[axis][bin].min, binBoxes[axis][bin].max);
+				rightCount += binCounts[axis][bin];
+				rightCosts[bin] = right.area() * rightCount;
+			}
+
+			Box left;
+			unsigned int leftCount = 0;
+			for (int split = 1; split < kBinCount; ++split) {
+				left.grow(binBoxes[axis][split - 1].min, binBoxes[axis][split - 1].max);
+				leftCount += binCounts[axis][split - 1];
+				if (leftCount == 0 || leftCount == size)
+					continue;
+
+				float cost = left.area() * leftCount + rightCosts[split];
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = split;
+				}
+			}
+		}
+
+		unsigned int middle;
+		if (bestAxis >= 0) {
+			int axis = bestAxis;
+			float low = centroids.min[axis];
+			float scale = scales[axis];
+
+			middle = (unsigned int)(std::partition(&items[0] + range.begin, &items[0] + range.end,
+					[&](const Item& item) {
+						return std::min(kBinCount - 1, (int)((item.sphere[axis] - low) * scale)) < bestSplit;
+					}) - &items[0]);
+		}
+		else {
+			// Every center in the same spot; any halving is as good.
+			middle = range.begin + size / 2;
+		}
+
+		node.first = 0;
+		node.count = 0;
+		_nodes.push_back(node);
+
+		Range rightRange = { middle, range.end, index, range.depth + 1 };
+		Range leftRange = { range.begin, middle, kNoParent, range.depth + 1 };
+		stack.push_back(rightRange);
+		stack.push_back(leftRange);
+	}
+
+	for (size_t k = 0; k < count; ++k) {
+		_instances[k] = items[k].instance;
+		_slots[items[k].instance] = (unsigned int)k;
+		memcpy(&_spheres[4 * k], items[k].sphere, sizeof(items[k].sphere));
+	}
+
+	planRefit();
+}
+
+void InstanceBvh::planRefit()
+{
+	_refitTasks.clear();
+	_refitTop.clear();
+
+	if (_nodes.empty())
+		return;
+
+	// One past the last node of every subtree; children come after their
+	// parent, so walking backwards has them ready.
+	std::vector<unsigned int> subtreeEnd(_nodes.size());
+	for (size_t n = _nodes.size(); n-- > 0;) {
+		const BvhNode& node = _nodes[n];
+		subtreeEnd[n] = node.leaf() ? (unsigned int)n + 1 : subtreeEnd[node.first];
+	}
+
+	struct Level
+	{
+		unsigned int node;
+		int depth;
+	};
+
+	std::vector<Level> stack;
+	Level root = { 0, 0 };
+	stack.push_back(root);
+
+	while (!stack.empty()) {
+		Level level = stack.back();
+		stack.pop_back();
+
+		const BvhNode& node = _nodes[level.node];
+		if (node.leaf() || level.depth == kRefitDepth) {
+			RefitTask task = { level.node, subtreeEnd[level.node] };
+			_refitTasks.push_back(task);
+			continue;
+		}
+
+		_refitTop.push_back(level.node);
+
+		Level left = { level.node + 1, level.depth + 1 };
+		Level right = { node.first, level.depth + 1 };
+		stack.push_back(left);
+		stack.push_back(right);
+	}
+
+	std::sort(_refitTop.begin(), _refitTop.end(), [](unsigned int a, unsigned int b) { return a > b; });
+}
+
+void InstanceBvh::refitNode(unsigned int index)
+{
+	BvhNode& node = _nodes[index];
+	Box box;
+
+	if (node.leaf()) {
+		for (unsigned int k = node.first; k < node.first + node.count; ++k) {
+			float low[4], high[4];
+			sphereBounds(&_spheres[4 * k], low, high);
+			box.grow(low, high);
+		}
+	}
+	else {
+		box.grow(_nodes[index + 1]);
+		box.grow(_nodes[node.first]);
+	}
+
+	for (int axis = 0; axis < 3; ++axis) {
+		node.min[axis] = box.min[axis];
+		node.max[axis] = box.max[axis];
+	}
+}
+
+void InstanceBvh::refit(JobSystem& jobs, const BoundingSpheres& spheres)
+{
+	// Reading the spheres in instance order and scattering them to their
+	// leaves touches one cache line per instance rather than four.
+	jobs.parallelFor(_slots.size(), kRefitGrainSize, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			float* sphere = &_spheres[4 * _slots[i]];
+			sphere[0] = spheres.x[i];
+			sphere[1] = spheres.y[i];
+			sphere[2] = spheres.z[i];
+			sphere[3] = spheres.radius[i];
+		}
+	});
+
+	jobs.parallelFor(_refitTasks.size(), 1, [&](size_t begin, size_t end) {
+		for (size_t t = begin; t < end; ++t) {
+			for (unsigned int n = _refitTasks[t].end; n-- > _refitTasks[t].begin;)
+				refitNode(n);
+		}
+	});
+
+	for (unsigned int n : _refitTop)
+		refitNode(n);
+}
+
+size_t InstanceBvh::cullFrustum(const float* planes, std::vector<unsigned int>& visible) const
+{
+	if (_nodes.empty())
+		return 0;
+
+	size_t before = visible.size();
+
+	// Bit p of a mask is set while plane p still cuts through the subtree.
+	struct Entry
+	{
+		unsigned int node;
+		unsigned int mask;
+	};
+
+	Entry stack[kMaxDepth];
+	int depth = 0;
+	stack[depth++] = Entry{ 0, 63 };
+
+	while (depth > 0) {
+		Entry entry = stack[--depth];
+		const BvhNode& node = _nodes[entry.node];
+		unsigned int mask = entry.mask;
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			if (!(mask & (1u << p)))
+				continue;
+
+			// The box corners furthest along and against the normal.
+			const float* plane = planes + 4 * p;
+			float farthest = plane[0] * (plane[0] > 0.0f ? node.max[0] : node.min[0]) +
+				plane[1] * (plane[1] > 0.0f ? node.max[1] : node.min[1]) +
+				plane[2] * (plane[2] > 0.0f ? node.max[2] : node.min[2]) + plane[3];
+			float nearest = plane[0] * (plane[0] > 0.0f ? node.min[0] : node.max[0]) +
+				plane[1] * (plane[1] > 0.0f ? node.min[1] : node.max[1]) +
+				plane[2] * (plane[2] > 0.0f ? node.min[2] : node.max[2]) + plane[3];
+
+			if (farthest < 0.0f)
+				outside = true;
+			else if (nearest >= 0.0f)
+				mask &= ~(1u << p);
+		}
+
+		if (outside)
+			continue;
+
+		if (!node.leaf()) {
+			stack[depth++] = Entry{ node.first, mask };
+			stack[depth++] = Entry{ entry.node + 1, mask };
+			continue;
+		}
+
+		for (unsigned int k = node.first; k < node.first + node.count; ++k) {
+			const float* sphere = &_spheres[4 * k];
+
+			bool inside = true;
+			for (int p = 0; p < 6 && inside; ++p) {
+				if (!(mask & (1u << p)))
+					continue;
+
+				// As in cullSpheres(), so both keep the same instances.
+				const float* plane = planes + 4 * p;
+				float distance = plane[0] * sphere[0] + plane[1] * sphere[1] +
+					plane[2] * sphere[2] + plane[3];
+				inside = !(distance < -sphere[3]);
+			}
+
+			if (inside)
+				visible.push_back(_instances[k]);
+		}
+	}
+
+	return visible.size() - before;
+}
+
+// Where the ray enters the box, or FLT_MAX when it misses it or only
+// enters beyond limit.
+static float rayBox(const BvhNode& node, const float* origin, const float* inverse, float limit)
+{
+	float enter = 0.0f, leave = limit;
+
+	for (int axis = 0; axis < 3; ++axis) {
+		float t0 = (node.min[axis] - origin[axis]) * inverse[axis];
+		float t1 = (node.max[axis] - origin[axis]) * inverse[axis];
+		if (t0 > t1)
+			std::swap(t0, t1);
+
+		// A NaN from a zero direction on the slab plane keeps the old bounds.
+		enter = t0 > enter ? t0 : enter;
+		leave = t1 < leave ? t1 : leave;
+	}
+
+	return enter <= leave ? enter : FLT_MAX;
+}
+
+int InstanceBvh::raycast(const float* origin, const float* direction, float* distance) const
+{
+	if (_nodes.empty())
+		return -1;
+
+	float inverse[3];
+	for (int axis = 0; axis < 3; ++axis)
+		inverse[axis] = 1.0f / direction[axis];
+
+	float lengthSquared = direction[0] * direction[0] + direction[1] * direction[1] +
+		direction[2] * direction[2];
+
+	int hit = -1;
+	float best = FLT_MAX;
+
+	// Nodes still to visit with where the ray enters them.
+	struct Entry
+	{
+		unsigned int node;
+		float enter;
+	};
+
+	Entry stack[kMaxDepth];
+	int depth = 0;
+
+	float rootEnter = rayBox(_nodes[0], origin, inverse, best);
+	if (rootEnter != FLT_MAX)
+		stack[depth++] = Entry{ 0, rootEnter };
+
+	while (depth > 0) {
+		Entry entry = stack[--depth];
+
+		// A hit found since it was queued may already be closer.
+		if (entry.enter > best)
+			continue;
+
+		const BvhNode& node = _nodes[entry.node];
+
+		if (!node.leaf()) {
+			Entry first = { entry.node + 1, rayBox(_nodes[entry.node + 1], origin, inverse, best) };
+			Entry second = { node.first, rayBox(_nodes[node.first], origin, inverse, best) };
+
+			if (second.enter < first.enter)
+				std::swap(first, second);
+
+			// The nearer child is taken first, so it may shorten the ray
+			// before the other one is looked at.
+			if (second.enter != FLT_MAX)
+				stack[depth++] = second;
+			if (first.enter != FLT_MAX)
+				stack[depth++] = first;
+			continue;
+		}
+
+		for (unsigned int k = node.first; k < node.first + node.count; ++k) {
+			const float* sphere = &_spheres[4 * k];
+
+			float toCenter[3] = { sphere[0] - origin[0], sphere[1] - origin[1], sphere[2] - origin[2] };
+			float along = toCenter[0] * direction[0] + toCenter[1] * direction[1] + toCenter[2] * direction[2];
+			float outside = toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] +
+				toCenter[2] * toCenter[2] - sphere[3] * sphere[3];
+
+			float t;
+			if (outside <= 0.0f) {
+				t = 0.0f;
+			}
+			else {
+				float discriminant = along * along - lengthSquared * outside;
+				if (along <= 0.0f || discriminant < 0.0f)
+					continue;
+
+				t = (along - std::sqrt(discriminant)) / lengthSquared;
+			}
+
+			if (t < best) {
+				best = t;
+				hit = (int)_instances[k];
+			}
+		}
+
+	}
+
+	if (hit >= 0 && distance)
+		*distance = best;
+
+	return hit;
+}
+
+size_t InstanceBvh::queryPoint(const float* point, std::vector<unsigned int>& hits) const
+{
+	if (_nodes.empty())
+		return 0;
+
+	size_t before = hits.size();
+
+	unsigned int stack[kMaxDepth];
+	int depth = 0;
+	stack[depth++] = 0;
+
+	while (depth > 0) {
+		unsigned int index = stack[--depth];
+		const BvhNode& node = _nodes[index];
+
+		bool inside = true;
+		for (int axis = 0; axis < 3; ++axis)
+			inside = inside && point[axis] >= node.min[axis] && point[axis] <= node.max[axis];
+
+		if (!inside)
+			continue;
+
+		if (!node.leaf()) {
+			stack[depth++] = node.first;
+			stack[depth++] = index + 1;
+			continue;
+		}
+
+		for (unsigned int k = node.first; k < node.first + node.count; ++k) {
+			const float* sphere = &_spheres[4 * k];
+			float dx = point[0] - sphere[0], dy = point[1] - sphere[1], dz = point[2] - sphere[2];
+
+			if (dx * dx + dy * dy + dz * dz <= sphere[3] * sphere[3])
+				hits.push_back(_instances[k]);
+		}
+	}
+
+	return hits.size() - before;
+}
@@ -1,22 +1,52 @@
 #version 430 core
 
+// Meshes bring their own vertex layout (see VertexLayout); the triangle is
+// plain floats.
+#if !defined(VERTEX_LAYOUT)
 layout (location = 0) in vec3 position;
 
-uniform samplerBuffer Ms;
+vec3 vertexPosition()
+{
+	return position;
+}
+#endif
+
 uniform mat4 VP;
 
+#include "instance.glsl"
+
 out vec4 vsOutColor;
 
-void main(void)
+#if defined(LIGHTING) && defined(VERTEX_NORMAL)
+
+// A fixed light from above and in front; the normal goes through the same
+// transform as the position, as the difference of two points, which holds
+// for the uniform scales instances have.
+const vec3 lightDirection = vec3(0.267, 0.535, 0.802);
+
+float lighting(int instance, vec3 position)
 {
-	vec4 col0 = texelFetch(Ms, 4 * gl_InstanceID + 0);
-	vec4 col1 = texelFetch(Ms, 4 * gl_InstanceID + 1);
-	vec4 col2 = texelFetch(Ms, 4 * gl_InstanceID + 2);
-	vec4 col3 = texelFetch(Ms, 4 * gl_InstanceID + 3);
+	vec3 world = instanceToWorld(instance, animate(instance, position));
+	vec3 normal = instanceToWorld(instance, animate(instance, position + vertexNormal())) - world;
 
-	mat4 M = mat4(col0, col1, col2, col3);
+	return 0.25 + 0.75 * max(dot(normalize(normal), lightDirection), 0.0);
+}
 
-	gl_Position = VP * M * vec4(position, 1.0);
+#else
+
+float lighting(int instance, vec3 position)
+{
+	return 1.0;
+}
+
+#endif
+
+void main(void)
+{
+	int instance = drawnInstance();
+	vec3 position = vertexPosition();
+
+	gl_Position = VP * vec4(instanceToWorld(instance, animate(instance, position)), 1.0);
 
 	vec4 colors[4] = {
 		vec4(1.0, 0.0, 0.0, 0.5),
@@ -25,5 +55,16 @@ void main(void)
 		vec4(1.0, 1.0, 1.0, 0.5),
 	};
 
-	vsOutColor = colors[gl_InstanceID % 4];
+#if defined(DRAW_BATCH)
+	// By mesh.
+	vsOutColor = colors[DRAW_ID % 4];
+#else
+	// By row, which is what instance % 4 gave before CPU culling started
+	// compacting instances; the row is the y of the instance's origin.
+	int row = int(instanceToWorld(instance, vec3(0.0)).y + 0.5);
+
+	vsOutColor = colors[row % 4];
+#endif
+
+	vsOutColor.rgb *= lighting(instance, position);
 }
\ No newline at end of file
@@ -0,0 +1,418 @@
+#include "culling.hpp"
+#include "programcache.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+
+static const char* const kCullModeNames[] = {
+	"none", "gpu", "cpu", "bvh", "meshlet",
+};
+
+// Instances per work group of the culling shader.
+static const GLuint kGroupSize = 64;
+
+// Binding points; the atomic counter is the instanceCount word of the
+// DrawArraysIndirectCommand {count, instanceCount, first, baseInstance}.
+static const GLuint kSphereBinding = 0;
+static const GLuint kVisibleBinding = 1;
+static const GLuint kCommandBinding = 0;
+
+static const char* const kCullShaderSource =
+	"#version 430 core\n"
+	"\n"
+	"layout(local_size_x = 64) in;\n"
+	"\n"
+	"layout(std430, binding = 0) readonly buffer Spheres { vec4 spheres[]; };\n"
+	"layout(std430, binding = 1) writeonly buffer Visible { uint visibleInstances[]; };\n"
+	"layout(binding = 0, offset = 4) uniform atomic_uint visibleCount;\n"
+	"\n"
+	"uniform vec4 planes[6];\n"
+	"uniform uint instanceCount;\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"\tuint instance = gl_GlobalInvocationID.x;\n"
+	"\tif (instance >= instanceCount)\n"
+	"\t\treturn;\n"
+	"\n"
+	"\tvec4 sphere = spheres[instance];\n"
+	"\tfor (int i = 0; i < 6; ++i) {\n"
+	"\t\tif (dot(planes[i].xyz, sphere.xyz) + planes[i].w < -sphere.w)\n"
+	"\t\t\treturn;\n"
+	"\t}\n"
+	"\n"
+	"\tvisibleInstances[atomicCounterIncrement(visibleCount)] = instance;\n"
+	"}\n";
+
+// Meshlets per work group of the cluster culling shader, one instance per
+// row of groups; rows are dispatched at most kMaxGroupRows at a time.
+static const GLuint kMeshletGroupSize = 64;
+static const size_t kMaxGroupRows = 65535;
+
+static const GLuint kMeshletBinding = 0;
+static const GLuint kTransformBinding = 1;
+static const GLuint kDrawBinding = 2;
+static const GLuint kDrawCountBinding = 0;
+
+static const char* const kMeshletShaderSource =
+	"#version 430 core\n"
+	"\n"
+	"layout(local_size_x = 64) in;\n"
+	"\n"
+	"struct Meshlet { vec4 sphere; vec4 cone; uvec4 range; };\n"
+	"struct Command { uint count; uint instanceCount; uint firstIndex; int baseVertex; uint baseInstance; };\n"
+	"\n"
+	"layout(std430, binding = 0) readonly buffer Meshlets { Meshlet meshlets[]; };\n"
+	"layout(std430, binding = 1) readonly buffer Transforms { mat4 transforms[]; };\n"
+	"layout(std430, binding = 2) writeonly buffer Commands { Command commands[]; };\n"
+	"layout(binding = 0, offset = 0) uniform atomic_uint drawCount;\n"
+	"\n"
+	"uniform vec4 planes[6];\n"
+	"uniform vec3 camera;\n"
+	"uniform uint meshletCount;\n"
+	"uniform uint firstInstance;\n"
+	"uniform uint firstIndex;\n"
+	"uniform int baseVertex;\n"
+	"\n"
+	"void main(void)\n"
+	"{\n"
+	"\tuint m = gl_GlobalInvocationID.x;\n"
+	"\tuint instance = firstInstance + gl_GlobalInvocationID.y;\n"
+	"\tif (m >= meshletCount)\n"
+	"\t\treturn;\n"
+	"\n"
+	"\tMeshlet meshlet = meshlets[m];\n"
+	"\tmat4 M = transforms[instance];\n"
+	"\n"
+	"\tvec3 center = (M * vec4(meshlet.sphere.xyz, 1.0)).xyz;\n"
+	"\tfloat scale = length(M[0].xyz);\n"
+	"\tfloat radius = meshlet.sphere.w * scale;\n"
+	"\tfor (int i = 0; i < 6; ++i) {\n"
+	"\t\tif (dot(planes[i].xyz, center) + planes[i].w < -radius)\n"
+	"\t\t\treturn;\n"
+	"\t}\n"
+	"\n"
+	"\t// Every triangle faces away: see meshletVisible().\n"
+	"\tvec3 axis = mat3(M) * meshlet.cone.xyz / scale;\n"
+	"\tvec3 direction = center - camera;\n"
+	"\tif (dot(direction, axis) >= meshlet.cone.w * length(direction) + radius)\n"
+	"\t\treturn;\n"
+	"\n"
+	"\tcommands[atomicCounterIncrement(drawCount)] =\n"
+	"\t\tCommand(3u * meshlet.range.y, 1u, firstIndex + meshlet.range.x, baseVertex, instance);\n"
+	"}\n";
+
+static const char* const kVertexSource =
+	"#define INSTANCE_CULLING\n"
+	"layout(location = 5) in uint visibleInstance;\n";
+
+static GLuint compileComputeProgram(const char* source)
+{
+	GLuint cached = ProgramCache::load(&source, 1);
+	if (cached)
+		return cached;
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &source, NULL);
+	glCompileShader(shader);
+
+	GLint result = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &result);
+	if (!result) {
+		char log[4096];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		fprintf(stderr, "Error: cannot compile culling shader\n%s\n", log);
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	ProgramCache::markRetrievable(program);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &result);
+	if (!result) {
+		char log[4096];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		fprintf(stderr, "Error: cannot link culling shader\n%s\n", log);
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	ProgramCache::store(program, &source, 1);
+
+	return program;
+}
+
+bool cullModeSupported(CullMode mode)
+{
+	if (mode == CULL_GPU || mode == CULL_MESHLET)
+		return GLEW_VERSION_4_3 != 0;
+
+	return true;
+}
+
+const char* cullModeName(CullMode mode)
+{
+	return kCullModeNames[mode];
+}
+
+bool parseCullMode(const char* name, CullMode* mode)
+{
+	for (int i = 0; i <= CULL_MESHLET; ++i) {
+		if (strcmp(name, kCullModeNames[i]) == 0) {
+			*mode = (CullMode)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+GpuCuller::GpuCuller()
+	: _instanceCount(0), _vertexCount(0), _program(0), _planesLocation(-1),
+	_instanceCountLocation(-1), _sphereBuffer(0), _visibleBuffer(0), _commandBuffer(0)
+{
+}
+
+bool GpuCuller::init(size_t instanceCount, int vertexCount)
+{
+	if (!cullModeSupported(CULL_GPU)) {
+		fprintf(stderr, "Error: GPU culling needs OpenGL 4.3\n");
+		return false;
+	}
+
+	_instanceCount = instanceCount;
+	_vertexCount = vertexCount;
+
+	_program = compileComputeProgram(kCullShaderSource);
+	if (!_program)
+		return false;
+
+	_planesLocation = glGetUniformLocation(_program, "planes");
+	_instanceCountLocation = glGetUniformLocation(_program, "instanceCount");
+
+	glGenBuffers(1, &_sphereBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _sphereBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(float) * instanceCount, nullptr, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &_visibleBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _visibleBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * instanceCount, nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &_commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, 4 * sizeof(GLuint), nullptr, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	return true;
+}
+
+void GpuCuller::destroy()
+{
+	glDeleteProgram(_program);
+	glDeleteBuffers(1, &_sphereBuffer);
+	glDeleteBuffers(1, &_visibleBuffer);
+	glDeleteBuffers(1, &_commandBuffer);
+
+	_program = 0;
+	_sphereBuffer = 0;
+	_visibleBuffer = 0;
+	_commandBuffer = 0;
+}
+
+const char* GpuCuller::vertexShaderSource() const
+{
+	return kVertexSource;
+}
+
+void GpuCuller::bindVertexArray()
+{
+	glBindBuffer(GL_ARRAY_BUFFER, _visibleBuffer);
+	glVertexAttribIPointer(kVisibleAttribute, 1, GL_UNSIGNED_INT, 0, (void*)0);
+	glVertexAttribDivisor(kVisibleAttribute, 1);
+	glEnableVertexAttribArray(kVisibleAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GpuCuller::setSpheres(const BoundingSpheres& spheres)
+{
+	std::vector<float> packed(4 * _instanceCount);
+	for (size_t i = 0; i < _instanceCount; ++i) {
+		packed[4 * i + 0] = spheres.x[i];
+		packed[4 * i + 1] = spheres.y[i];
+		packed[4 * i + 2] = spheres.z[i];
+		packed[4 * i + 3] = spheres.radius[i];
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _sphereBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * packed.size(), &packed[0]);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void GpuCuller::cull(const float* viewProjection)
+{
+	float planes[24];
+	frustumPlanes(viewProjection, planes);
+
+	// instanceCount starts at zero and is counted up by the shader.
+	const GLuint command[4] = { (GLuint)_vertexCount, 0, 0, 0 };
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, sizeof(command), command);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	glUseProgram(_program);
+	glUniform4fv(_planesLocation, 6, planes);
+	glUniform1ui(_instanceCountLocation, (GLuint)_instanceCount);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kSphereBinding, _sphereBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kVisibleBinding, _visibleBuffer);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, kCommandBinding, _commandBuffer);
+
+	glDispatchCompute((GLuint)((_instanceCount + kGroupSize - 1) / kGroupSize), 1, 1);
+
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, kCommandBinding, 0);
+	glUseProgram(0);
+
+	// The draw reads the command and the visible list as vertex data.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+MeshletCuller::MeshletCuller()
+	: _meshletCount(0), _instanceCount(0), _program(0), _planesLocation(-1), _cameraLocation(-1),
+	_meshletCountLocation(-1), _firstInstanceLocation(-1), _firstIndexLocation(-1),
+	_baseVertexLocation(-1), _mesh(), _meshletBuffer(0), _transformBuffer(0), _commandBuffer(0),
+	_countBuffer(0)
+{
+}
+
+bool MeshletCuller::init(const Meshlet* meshlets, size_t meshletCount, const PoolMesh& mesh, size_t instanceCount)
+{
+	if (!cullModeSupported(CULL_MESHLET)) {
+		fprintf(stderr, "Error: meshlet culling needs OpenGL 4.3\n");
+		return false;
+	}
+
+	// Every pair may be visible at once.
+	GLint64 maxBlockSize = 0;
+	glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &maxBlockSize);
+	if ((double)meshletCount * instanceCount * 5 * sizeof(GLuint) > (double)maxBlockSize) {
+		fprintf(stderr, "Error: %zu meshlets of %zu instances do not fit a storage buffer\n",
+				meshletCount, instanceCount);
+		return false;
+	}
+
+	_meshletCount = meshletCount;
+	_instanceCount = instanceCount;
+	_mesh = mesh;
+
+	_program = compileComputeProgram(kMeshletShaderSource);
+	if (!_program)
+		return false;
+
+	_planesLocation = glGetUniformLocation(_program, "planes");
+	_cameraLocation = glGetUniformLocation(_program, "camera");
+	_meshletCountLocation = glGetUniformLocation(_program, "meshletCount");
+	_firstInstanceLocation = glGetUniformLocation(_program, "firstInstance");
+	_firstIndexLocation = glGetUniformLocation(_program, "firstIndex");
+	_baseVertexLocation = glGetUniformLocation(_program, "baseVertex");
+
+	glGenBuffers(1, &_meshletBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _meshletBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Meshlet) * meshletCount, meshlets, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &_transformBuffer);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _transformBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, 16 * sizeof(float) * instanceCount, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glGenBuffers(1, &_commandBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, 5 * sizeof(GLuint) * maxDraws(), nullptr, GL_DYNAMIC_COPY);
+	glClearBufferData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	// Nothing is drawn until the first cull().
+	const GLuint zero = 0;
+	glGenBuffers(1, &_countBuffer);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, _countBuffer);
+	glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(zero), &zero, GL_DYNAMIC_COPY);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	return true;
+}
+
+void MeshletCuller::destroy()
+{
+	glDeleteProgram(_program);
+	glDeleteBuffers(1, &_meshletBuffer);
+	glDeleteBuffers(1, &_transformBuffer);
+	glDeleteBuffers(1, &_commandBuffer);
+	glDeleteBuffers(1, &_countBuffer);
+
+	_program = 0;
+	_meshletBuffer = 0;
+	_transformBuffer = 0;
+	_commandBuffer = 0;
+	_countBuffer = 0;
+}
+
+void MeshletCuller::setTransforms(const float* transforms)
+{
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, _transformBuffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, 16 * sizeof(float) * _instanceCount, transforms);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void MeshletCuller::cull(const float* viewProjection, const float* camera)
+{
+	float planes[24];
+	frustumPlanes(viewProjection, planes);
+
+	const GLuint zero = 0;
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, _countBuffer);
+	glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(zero), &zero);
+	glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, 0);
+
+	// Without GL_ARB_indirect_parameters every slot is drawn, so the ones
+	// past the count have to be empty draws.
+	if (!GLEW_ARB_indirect_parameters) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+		glClearBufferData(GL_DRAW_INDIRECT_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	glUseProgram(_program);
+	glUniform4fv(_planesLocation, 6, planes);
+	glUniform3fv(_cameraLocation, 1, camera);
+	glUniform1ui(_meshletCountLocation, (GLuint)_meshletCount);
+	glUniform1ui(_firstIndexLocation, _mesh.firstIndex);
+	glUniform1i(_baseVertexLocation, _mesh.baseVertex);
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kMeshletBinding, _meshletBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kTransformBinding, _transformBuffer);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kDrawBinding, _commandBuffer);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, kDrawCountBinding, _countBuffer);
+
+	GLuint groups = (GLuint)((_meshletCount + kMeshletGroupSize - 1) / kMeshletGroupSize);
+	for (size_t first = 0; first < _instanceCount; first += kMaxGroupRows) {
+		size_t rows = std::min(_instanceCount - first, kMaxGroupRows);
+		glUniform1ui(_firstInstanceLocation, (GLuint)first);
+		glDispatchCompute(groups, (GLuint)rows, 1);
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, kDrawBinding, 0);
+	glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, kDrawCountBinding, 0);
+	glUseProgram(0);
+
+	// The draw reads the commands and, as its parameter buffer, the count.
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+}
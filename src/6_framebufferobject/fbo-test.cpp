@@ -2,8 +2,10 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 
+#include <string>
 #include <vector>
 
 #include <signal.h>
@@ -11,30 +13,58 @@
 #include <GL/glew.h>
 
 #include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
 #include "shader.hpp"
+#include "benchmark.hpp"
+#include "instancingscene.hpp"
+#include "shaderreload.hpp"
+#include "trace.hpp"
+#include "triplebuffer.hpp"
 
 class FBOSample : public Sample
 {
 public:
+	FBOSample()
+		: Sample(4, 3), _contentVAO(0), _contentProgram(0), _serialCompile(false),
+		_hotReload(false), _contentReload(-1), _fboReload(-1), _lighting(false),
+		_fboVAO(0), _fboVBO(0), _fboFBO(0), _fboRenderedTBO(0), _fboProgram(0)
+	{
+	}
+
+	virtual bool parseArguments(int argc, char** argv);
 	virtual bool initContents();
 	virtual void destroyContents();
+	virtual bool supportsThreadedUpdate() const { return true; }
 	virtual void update(float dt);
 	virtual void render();
 
 private:
-	GLuint _contentVAO, _contentVBO;
-	GLuint _contentTransformBO;
-	GLuint _contentTransformTBO;
+	void upload(const FramePacket& packet);
+	void bindContentProgram();
+	void bindFboProgram();
+	void reloadPrograms();
+
+	GLuint _contentVAO;
+	InstancingScene _scene;
 
 	GLuint _contentProgram;
 	GLuint _contentVPID;
-	GLuint _contentMsID;
 
 	float _globalTimer;
 
+	bool _serialCompile;
+
+	bool _hotReload;
+	ShaderReloader _reloader;
+	int _contentReload, _fboReload;
+
+	// Both programs, by the variant initContents() picks.
+	ShaderVariants _shaders;
+	bool _lighting;
+
+	TripleBuffer<FramePacket> _packets;
+
 	GLuint _fboVAO, _fboVBO;
 	GLuint _fboFBO, _fboRenderedTBO;
 
@@ -69,7 +99,16 @@ int main(int argc, char** argv)
 	}
 
 	sample = new FBOSample();
-	sample->init();
+	if (!sample->parseArguments(argc, argv)) {
+		delete sample;
+		return EXIT_FAILURE;
+	}
+
+	if (!sample->init()) {
+		sample->destroy();
+		delete sample;
+		return EXIT_FAILURE;
+	}
 
 	sample->run();
 
@@ -83,64 +122,90 @@ int main(int argc, char** argv)
 	return 0;
 }
 
+// The scene takes the instance, culling and mesh options, see
+// InstancingScene::parseArguments().
+// --serial-compile keeps the driver from building the two programs on
+// threads of its own (GL_KHR_parallel_shader_compile), for comparison.
+// --hot-reload rebuilds the programs whenever their shader files are
+// saved, see ShaderReloader.
+// --lighting shades the content with the normals of a --mesh file that has
+// them, through the LIGHTING variant of content.vert.
+bool FBOSample::parseArguments(int argc, char** argv)
+{
+	if (!_scene.parseArguments(argc, argv))
+		return false;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--serial-compile") == 0) {
+			_serialCompile = true;
+		}
+		else if (strcmp(argv[i], "--hot-reload") == 0) {
+			_hotReload = true;
+		}
+		else if (strcmp(argv[i], "--lighting") == 0) {
+			_lighting = true;
+		}
+	}
+
+	return Sample::parseArguments(argc, argv);
+}
+
 bool FBOSample::initContents()
 {
 	glClearColor(0.0f, 0.0f, 0.3f, 0.0f);
 
+	// Both programs build while the rest is set up; the first use of each
+	// waits for it.
+	_shaders.setParallel(!_serialCompile);
+	ShaderDefines contentDefines;
+	std::string contentHeader;
+	double shaderWait = 0.0;
+
 	// Init Content
 	glGenVertexArrays(1, &_contentVAO);
 	assert(_contentVAO != -1);
 
 	glBindVertexArray(_contentVAO);
 	{
-		_contentProgram = LoadShaders("content.vert", "content.frag");
-		assert(_contentProgram != -1);
-
-		_contentVPID = glGetUniformLocation(_contentProgram, "VP");
-		_contentMsID = glGetUniformLocation(_contentProgram, "Ms");
-
-		static const GLfloat g_vertex_buffer_data[] = {
-			-1.0f, -1.0f, 0.0f,
-			 1.0f, -1.0f, 0.0f,
-			 0.0f,  1.0f, 0.0f,
-		};
-
-		glGenBuffers(1, &_contentVBO);
-		assert(_contentVBO != -1);
-
-		glBindBuffer(GL_ARRAY_BUFFER, _contentVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(g_vertex_buffer_data), g_vertex_buffer_data, GL_STATIC_DRAW);
-
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, (void*)0);
-
-		GLfloat* transform_buffer_data = new float[16 * 4];
-		{
-			for (int i = 0; i < 4; ++i) {
-				auto T = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, (float)i, 0.0f));
-				auto R = glm::rotate(glm::mat4(1.0f), _globalTimer, glm::vec3(0.0f, 1.0f, 0.0f));
-				auto S = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
-
-				auto M = T * R * S;
+		if (!_scene.init(this))
+			return false;
 
-				memcpy(transform_buffer_data + 16 * i, glm::value_ptr(M), sizeof(float) * 16);
+		if (_lighting) {
+			if (_scene.meshCount() == 0 || !(_scene.geometry().layout().attributes() & MESH_ATTRIBUTE_NORMAL)) {
+				fprintf(stderr, "Error: lighting needs a --mesh file with normals\n");
+				return false;
 			}
 
-			glGenBuffers(1, &_contentTransformBO);
-			glBindBuffer(GL_TEXTURE_BUFFER, _contentTransformBO);
-			glBufferData(GL_TEXTURE_BUFFER, sizeof(float) * 16 * 4,
-					transform_buffer_data, GL_STATIC_DRAW);
-
-			glGenTextures(1, &_contentTransformTBO);
-			glBindTexture(GL_TEXTURE_BUFFER, _contentTransformTBO);
-			glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, _contentTransformBO);
+			contentDefines.set("LIGHTING");
 		}
-		if (transform_buffer_data) {
-			delete[] transform_buffer_data;
-			transform_buffer_data = nullptr;
+
+		// The encoding, submission and culling are in the header, so part
+		// of the variant too. Drivers compiling on the calling thread
+		// spend their time here.
+		contentHeader = _scene.vertexShaderSource();
+		double start = Benchmark::now();
+		_shaders.prepare("content.vert", "content.frag", contentDefines, contentHeader.c_str());
+		_shaders.prepare("fbo.vert", "fbo.frag");
+		setBenchmarkProperty("shader_submit_ms", (Benchmark::now() - start) * 1000.0);
+
+		if (_hotReload) {
+			_contentReload = _reloader.watch("content.vert", "content.frag", contentDefines,
+					contentHeader.c_str());
+			_fboReload = _reloader.watch("fbo.vert", "fbo.frag", ShaderDefines());
 		}
 	}
 	glBindVertexArray(0);
 
+	double start = Benchmark::now();
+	_contentProgram = _shaders.program("content.vert", "content.frag", contentDefines, contentHeader.c_str());
+	assert(_contentProgram != -1);
+	shaderWait += Benchmark::now() - start;
+
+	bindContentProgram();
+
+	setBenchmarkProperty("shader_compile", _shaders.parallel() ? "parallel" : "serial");
+	setBenchmarkProperty("lighting", _lighting ? "yes" : "no");
+
 	glGenVertexArrays(1, &_fboVAO);
 	glBindVertexArray(_fboVAO);
 	{
@@ -165,16 +230,14 @@ bool FBOSample::initContents()
 		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 			return false;
 
-		_fboProgram = LoadShaders("fbo.vert", "fbo.frag");
+		start = Benchmark::now();
+		_fboProgram = _shaders.program("fbo.vert", "fbo.frag");
 		assert(_fboProgram != -1);
+		setBenchmarkProperty("shader_wait_ms", (shaderWait + Benchmark::now() - start) * 1000.0);
 
-		_fboRenderedTBOID = glGetUniformLocation(_fboProgram, "renderedTextureSampler");
+		bindFboProgram();
 		assert(_fboRenderedTBOID != -1);
 
-		glUseProgram(_fboProgram);
-		glUniform1i(_fboRenderedTBOID, 0);
-		glUseProgram(0);
-
 		float vertices[] = 
 		{
 			-1.0f,  1.0f,	0.0f, 1.0f,
@@ -195,66 +258,97 @@ bool FBOSample::initContents()
 
 	_globalTimer = 0.0f;
 
+	setBenchmarkProperty("hot_reload", _hotReload ? "yes" : "no");
+	if (_hotReload && !_reloader.start(this))
+		return false;
+
 	return true;
 }
 
-void FBOSample::destroyContents()
+// Uniform locations and bindings of the content program, again after a
+// reload.
+void FBOSample::bindContentProgram()
 {
-	glDeleteVertexArrays(1, &_fboVAO);
-	glDeleteBuffers(1, &_fboVBO);
+	_scene.bindProgram(_contentProgram);
 
-	glDeleteProgram(_fboProgram);
-
-	glDeleteVertexArrays(1, &_contentVAO);
-	glDeleteBuffers(1, &_contentVBO);
-	glDeleteBuffers(1, &_contentTransformBO);
+	_contentVPID = glGetUniformLocation(_contentProgram, "VP");
+}
 
-	glDeleteTextures(1, &_contentTransformTBO);
+void FBOSample::bindFboProgram()
+{
+	_fboRenderedTBOID = glGetUniformLocation(_fboProgram, "renderedTextureSampler");
 
-	glDeleteProgram(_contentProgram);
+	glUseProgram(_fboProgram);
+	glUniform1i(_fboRenderedTBOID, 0);
+	glUseProgram(0);
 }
 
-void FBOSample::update(float dt)
+// Between frames, so a frame never draws with both the old and the new
+// program; takeProgram() returns 0 rather than wait for one.
+void FBOSample::reloadPrograms()
 {
-	glBindVertexArray(_contentVAO);
-	glBindBuffer(GL_TEXTURE_BUFFER, _contentTransformBO);
+	if (GLuint program = _reloader.takeProgram(_contentReload)) {
+		_shaders.replace(_contentProgram, program);
+		_contentProgram = program;
+		bindContentProgram();
+	}
 
-	float* pointer = (float*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, sizeof(float) * 16 * 4, GL_MAP_WRITE_BIT);
-	assert(pointer);
+	if (GLuint program = _reloader.takeProgram(_fboReload)) {
+		_shaders.replace(_fboProgram, program);
+		_fboProgram = program;
+		bindFboProgram();
+	}
+}
 
-	for (int i = 0; i < 4; ++i) {
-		auto T = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, (float)i, 0.0f));
-		auto R = glm::rotate(glm::mat4(1.0f), _globalTimer, glm::vec3(0.0f, 1.0f, 0.0f));
-		auto S = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+void FBOSample::destroyContents()
+{
+	_reloader.stop();
 
-		auto M = T * R * S;
+	glDeleteVertexArrays(1, &_fboVAO);
+	glDeleteBuffers(1, &_fboVBO);
+	glDeleteFramebuffers(1, &_fboFBO);
+	glDeleteTextures(1, &_fboRenderedTBO);
 
-		memcpy(pointer + 16 * i, glm::value_ptr(M), sizeof(float) * 16);
-	}
+	glDeleteVertexArrays(1, &_contentVAO);
+	_scene.destroy();
 
-	glUnmapBuffer(GL_TEXTURE_BUFFER);
+	_shaders.clear();
+}
 
-	auto V = glm::lookAt(
-			glm::vec3(3,4,10),
-			glm::vec3(0,0,0),
-			glm::vec3(0,1,0)
-			);
+void FBOSample::update(float dt)
+{
+	FramePacket& packet = _packets.writeBuffer();
+	_scene.update(packet, _globalTimer, (float)windowWidth() / windowHeight());
+	_packets.publish();
 
-	auto P = glm::perspective(45.0f, (float)windowWidth() / windowHeight(),
-			0.1f, 100.0f);
+	_globalTimer += dt;
+}
 
-	auto VP = P * V;
+void FBOSample::upload(const FramePacket& packet)
+{
+	_scene.upload(packet, benchmark());
 
 	glUseProgram(_contentProgram);
-	glUniform1i(_contentMsID, 0);
-	glUniformMatrix4fv(_contentVPID, 1, false, glm::value_ptr(VP));
+	glUniformMatrix4fv(_contentVPID, 1, false, glm::value_ptr(packet.VP));
+	if (_scene.animation() == INSTANCE_ANIMATION_GPU)
+		_scene.instances().setTime(packet.time);
 	glUseProgram(0);
-
-	_globalTimer += dt;
 }
 
 void FBOSample::render()
 {
+	if (_reloader.running())
+		reloadPrograms();
+
+	_packets.acquire();
+
+	const FramePacket& packet = _packets.readBuffer();
+	upload(packet);
+
+	_scene.cull(packet, gpuProfiler());
+
+	gpuProfiler()->beginZone("content");
+
 	glBindFramebuffer(GL_FRAMEBUFFER, _fboFBO);
 	glViewport(0, 0, windowWidth(), windowHeight());
 	glClear(GL_COLOR_BUFFER_BIT);
@@ -268,9 +362,7 @@ void FBOSample::render()
 		glEnable(GL_BLEND);
 		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_BUFFER, _contentTransformTBO);
-		glDrawArraysInstanced(GL_TRIANGLES, 0, 3, 4);
+		_scene.draw(packet);
 
 		glDisable(GL_BLEND);
 
@@ -279,7 +371,10 @@ void FBOSample::render()
 
 	glUseProgram(0);
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gpuProfiler()->endZone();
+	gpuProfiler()->beginZone("blit");
+
+	glBindFramebuffer(GL_FRAMEBUFFER, defaultFramebuffer());
 	glViewport(0, 0, windowWidth(), windowHeight());
 	glClear(GL_COLOR_BUFFER_BIT);
 
@@ -301,6 +396,8 @@ void FBOSample::render()
 		glBindVertexArray(0);
 	}
 	glUseProgram(0);
+
+	gpuProfiler()->endZone();
 }
 
 
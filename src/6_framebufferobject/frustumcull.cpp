@@ -0,0 +1,257 @@
+#include "frustumcull.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define FRUSTUMCULL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the instruction set enabled per function so the rest
+// of the program keeps running on CPUs without it; MSVC always allows them.
+#if defined(FRUSTUMCULL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define FRUSTUMCULL_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FRUSTUMCULL_TARGET(isa)
+#endif
+
+void frustumPlanes(const float* viewProjection, float* planes)
+{
+	const float* m = viewProjection;
+
+	// Plane 2k is row 3 + row k of the matrix, plane 2k + 1 row 3 - row k.
+	for (int i = 0; i < 6; ++i) {
+		int row = i / 2;
+		float sign = (i & 1) ? -1.0f : 1.0f;
+		float* plane = planes + 4 * i;
+
+		for (int column = 0; column < 4; ++column)
+			plane[column] = m[4 * column + 3] + sign * m[4 * column + row];
+
+		float length = std::sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+		for (int k = 0; k < 4; ++k)
+			plane[k] /= length;
+	}
+}
+
+static inline bool sphereVisible(const BoundingSpheres& spheres, const float* planes, size_t i)
+{
+	for (int p = 0; p < 6; ++p) {
+		const float* plane = planes + 4 * p;
+		float distance = plane[0] * spheres.x[i] + plane[1] * spheres.y[i] +
+			plane[2] * spheres.z[i] + plane[3];
+
+		if (distance < -spheres.radius[i])
+			return false;
+	}
+
+	return true;
+}
+
+static size_t cullSpheresScalar(const BoundingSpheres& spheres, const float* planes,
+		size_t begin, size_t end, unsigned int* visible)
+{
+	size_t count = 0;
+
+	for (size_t i = begin; i < end; ++i) {
+		if (sphereVisible(spheres, planes, i))
+			visible[count++] = (unsigned int)i;
+	}
+
+	return count;
+}
+
+#ifdef FRUSTUMCULL_X86
+
+static inline int popCount(unsigned int mask)
+{
+#ifdef _MSC_VER
+	return (int)__popcnt(mask);
+#else
+	return __builtin_popcount(mask);
+#endif
+}
+
+// Left-packing tables, indexed by the visibility mask of a group: the
+// byte shuffle that moves the visible lanes of four indices to the front,
+// and the lane numbers that do the same for eight, three bits each.
+struct PackTables
+{
+	uint8_t shuffle4[16][16];
+	uint32_t lanes8[256];
+
+	PackTables()
+	{
+		for (int mask = 0; mask < 16; ++mask) {
+			int n = 0;
+			for (int lane = 0; lane < 4; ++lane) {
+				if (mask & (1 << lane)) {
+					for (int b = 0; b < 4; ++b)
+						shuffle4[mask][4 * n + b] = (uint8_t)(4 * lane + b);
+					++n;
+				}
+			}
+			for (; n < 4; ++n) {
+				for (int b = 0; b < 4; ++b)
+					shuffle4[mask][4 * n + b] = 0x80;
+			}
+		}
+
+		for (int mask = 0; mask < 256; ++mask) {
+			uint32_t lanes = 0;
+			int n = 0;
+			for (int lane = 0; lane < 8; ++lane) {
+				if (mask & (1 << lane))
+					lanes |= (uint32_t)lane << (4 * n++);
+			}
+			lanes8[mask] = lanes;
+		}
+	}
+};
+
+static const PackTables kPackTables;
+
+FRUSTUMCULL_TARGET("sse4.1")
+static size_t cullSpheresSSE41(const BoundingSpheres& spheres, const float* planes,
+		size_t begin, size_t end, unsigned int* visible)
+{
+	__m128 a[6], b[6], c[6], d[6];
+	for (int p = 0; p < 6; ++p) {
+		a[p] = _mm_set1_ps(planes[4 * p + 0]);
+		b[p] = _mm_set1_ps(planes[4 * p + 1]);
+		c[p] = _mm_set1_ps(planes[4 * p + 2]);
+		d[p] = _mm_set1_ps(planes[4 * p + 3]);
+	}
+
+	size_t count = 0;
+	size_t i = begin;
+
+	__m128i indices = _mm_add_epi32(_mm_set1_epi32((int)begin), _mm_setr_epi32(0, 1, 2, 3));
+	const __m128i step = _mm_set1_epi32(4);
+
+	for (; i + 4 <= end; i += 4) {
+		__m128 x = _mm_loadu_ps(spheres.x + i);
+		__m128 y = _mm_loadu_ps(spheres.y + i);
+		__m128 z = _mm_loadu_ps(spheres.z + i);
+		__m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(spheres.radius + i));
+
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p) {
+			// Same order of operations as sphereVisible(), so every
+			// kernel keeps the same spheres.
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(a[p], x), _mm_mul_ps(b[p], y)), _mm_mul_ps(c[p], z)), d[p]);
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+		}
+
+		// All four lanes are stored; only the visible ones are kept.
+		int mask = ~_mm_movemask_ps(outside) & 15;
+		__m128i shuffle = _mm_loadu_si128((const __m128i*)kPackTables.shuffle4[mask]);
+		_mm_storeu_si128((__m128i*)(visible + count), _mm_shuffle_epi8(indices, shuffle));
+
+		count += popCount(mask);
+		indices = _mm_add_epi32(indices, step);
+	}
+
+	return count + cullSpheresScalar(spheres, planes, i, end, visible + count);
+}
+
+FRUSTUMCULL_TARGET("avx2")
+static size_t cullSpheresAVX2(const BoundingSpheres& spheres, const float* planes,
+		size_t begin, size_t end, unsigned int* visible)
+{
+	__m256 a[6], b[6], c[6], d[6];
+	for (int p = 0; p < 6; ++p) {
+		a[p] = _mm256_set1_ps(planes[4 * p + 0]);
+		b[p] = _mm256_set1_ps(planes[4 * p + 1]);
+		c[p] = _mm256_set1_ps(planes[4 * p + 2]);
+		d[p] = _mm256_set1_ps(planes[4 * p + 3]);
+	}
+
+	size_t count = 0;
+	size_t i = begin;
+
+	__m256i indices = _mm256_add_epi32(_mm256_set1_epi32((int)begin),
+			_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+	const __m256i step = _mm256_set1_epi32(8);
+	const __m256i laneShifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+	const __m256i laneMask = _mm256_set1_epi32(7);
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 x = _mm256_loadu_ps(spheres.x + i);
+		__m256 y = _mm256_loadu_ps(spheres.y + i);
+		__m256 z = _mm256_loadu_ps(spheres.z + i);
+		__m256 negativeRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(spheres.radius + i));
+
+		__m256 outside = _mm256_setzero_ps();
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(
+					_mm256_mul_ps(a[p], x), _mm256_mul_ps(b[p], y)), _mm256_mul_ps(c[p], z)), d[p]);
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(distance, negativeRadius, _CMP_LT_OQ));
+		}
+
+		int mask = ~_mm256_movemask_ps(outside) & 255;
+		__m256i lanes = _mm256_and_si256(
+				_mm256_srlv_epi32(_mm256_set1_epi32((int)kPackTables.lanes8[mask]), laneShifts),
+				laneMask);
+		_mm256_storeu_si256((__m256i*)(visible + count), _mm256_permutevar8x32_epi32(indices, lanes));
+
+		count += popCount(mask);
+		indices = _mm256_add_epi32(indices, step);
+	}
+
+	return count + cullSpheresSSE41(spheres, planes, i, end, visible + count);
+}
+
+#endif // FRUSTUMCULL_X86
+
+size_t cullSpheres(const BoundingSpheres& spheres, const float* planes,
+		size_t begin, size_t end, unsigned int* visible, TransformKernel kernel)
+{
+#ifdef FRUSTUMCULL_X86
+	if (kernel == TRANSFORM_KERNEL_AVX2)
+		return cullSpheresAVX2(spheres, planes, begin, end, visible);
+
+	if (kernel == TRANSFORM_KERNEL_SSE41)
+		return cullSpheresSSE41(spheres, planes, begin, end, visible);
+#endif
+
+	return cullSpheresScalar(spheres, planes, begin, end, visible);
+}
+
+FrustumCuller::FrustumCuller()
+	: _visibleCount(0)
+{
+}
+
+void FrustumCuller::cull(JobSystem& jobs, const BoundingSpheres& spheres, size_t count,
+		const float* viewProjection, TransformKernel kernel)
+{
+	float planes[24];
+	frustumPlanes(viewProjection, planes);
+
+	size_t chunks = (count + kChunkSize - 1) / kChunkSize;
+
+	_visible.resize(count);
+	_chunkCounts.resize(chunks);
+	_chunkOffsets.resize(chunks);
+
+	jobs.parallelFor(chunks, 1, [&](size_t begin, size_t end) {
+		for (size_t chunk = begin; chunk < end; ++chunk) {
+			size_t first = chunk * kChunkSize;
+			size_t last = first + kChunkSize < count ? first + kChunkSize : count;
+
+			_chunkCounts[chunk] = cullSpheres(spheres, planes, first, last, &_visible[first], kernel);
+		}
+	});
+
+	_visibleCount = 0;
+	for (size_t chunk = 0; chunk < chunks; ++chunk) {
+		_chunkOffsets[chunk] = _visibleCount;
+		_visibleCount += _chunkCounts[chunk];
+	}
+}
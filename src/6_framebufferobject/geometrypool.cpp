@@ -0,0 +1,341 @@
+#include "geometrypool.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <vector>
+
+#include <GL/glew.h>
+
+static const char* const kSubmissionNames[] = {
+	"direct", "mdi",
+};
+
+GeometryPool::GeometryPool()
+	: _vertexStride(0), _vertexBytes(0), _indexBytes(0), _vertexBuffer(0), _indexBuffer(0)
+{
+}
+
+void GeometryPool::init(const VertexLayout& layout)
+{
+	_layout = layout;
+	_vertexStride = layout.stride();
+}
+
+void GeometryPool::destroy()
+{
+	glDeleteBuffers(1, &_vertexBuffer);
+	glDeleteBuffers(1, &_indexBuffer);
+	_vertexBuffer = 0;
+	_indexBuffer = 0;
+
+	_sources.clear();
+	_vertexCopies.clear();
+	_indexCopies.clear();
+	_meshes.clear();
+	_vertexBytes = 0;
+	_indexBytes = 0;
+}
+
+int GeometryPool::addMesh(const void* vertices, size_t vertexCount,
+		const unsigned int* indices, size_t indexCount)
+{
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	_vertexCopies.push_back(std::vector<unsigned char>(bytes, bytes + vertexCount * _vertexStride));
+	_indexCopies.push_back(std::vector<unsigned int>(indices, indices + indexCount));
+
+	// Moving the vectors around keeps their storage where it is.
+	return addMeshView(_vertexCopies.back().data(), vertexCount, _indexCopies.back().data(), indexCount);
+}
+
+int GeometryPool::addMeshView(const void* vertices, size_t vertexCount,
+		const unsigned int* indices, size_t indexCount)
+{
+	assert(!_vertexBuffer);
+
+	PoolMesh mesh;
+	mesh.firstIndex = (unsigned int)(_indexBytes / sizeof(unsigned int));
+	mesh.indexCount = (unsigned int)indexCount;
+	mesh.baseVertex = (int)(_vertexBytes / _vertexStride);
+	mesh.vertexCount = (unsigned int)vertexCount;
+
+	_vertexBytes += vertexCount * _vertexStride;
+	_indexBytes += sizeof(unsigned int) * indexCount;
+
+	Source source = { vertices, indices };
+	_sources.push_back(source);
+	_meshes.push_back(mesh);
+
+	return (int)_meshes.size() - 1;
+}
+
+void GeometryPool::upload()
+{
+	glGenBuffers(1, &_vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, _vertexBytes, nullptr, GL_STATIC_DRAW);
+
+	// GL_ELEMENT_ARRAY_BUFFER would land in whatever vertex array is bound.
+	glGenBuffers(1, &_indexBuffer);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, _indexBuffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, _indexBytes, nullptr, GL_STATIC_DRAW);
+
+	for (size_t i = 0; i < _meshes.size(); ++i) {
+		const PoolMesh& mesh = _meshes[i];
+
+		glBufferSubData(GL_ARRAY_BUFFER, mesh.baseVertex * _vertexStride,
+				mesh.vertexCount * _vertexStride, _sources[i].vertices);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, sizeof(unsigned int) * mesh.firstIndex,
+				sizeof(unsigned int) * mesh.indexCount, _sources[i].indices);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	std::vector<Source>().swap(_sources);
+	std::vector<std::vector<unsigned char>>().swap(_vertexCopies);
+	std::vector<std::vector<unsigned int>>().swap(_indexCopies);
+}
+
+void GeometryPool::bindVertexArray() const
+{
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _indexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _vertexBuffer);
+
+	for (int a = 0; a < _layout.attributeCount(); ++a) {
+		const VertexAttributeLayout& attribute = _layout.attribute(a);
+		const void* offset = (const void*)(size_t)attribute.offset;
+
+		switch (attribute.component) {
+		case VERTEX_COMPONENT_FLOAT:
+			glVertexAttribPointer(attribute.location, attribute.components, GL_FLOAT, GL_FALSE,
+					(GLsizei)_vertexStride, offset);
+			break;
+		case VERTEX_COMPONENT_HALF:
+			glVertexAttribPointer(attribute.location, attribute.components, GL_HALF_FLOAT, GL_FALSE,
+					(GLsizei)_vertexStride, offset);
+			break;
+		case VERTEX_COMPONENT_SNORM16:
+			glVertexAttribPointer(attribute.location, attribute.components, GL_SHORT, GL_TRUE,
+					(GLsizei)_vertexStride, offset);
+			break;
+		case VERTEX_COMPONENT_SNORM_10_10_10_2:
+			glVertexAttribPointer(attribute.location, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+					(GLsizei)_vertexStride, offset);
+			break;
+		}
+
+		glEnableVertexAttribArray(attribute.location);
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void GeometryPool::bindProgram(unsigned int program) const
+{
+	if (_layout.format() != VERTEX_FORMAT_QUANTIZED)
+		return;
+
+	glUseProgram(program);
+	glUniform3fv(glGetUniformLocation(program, "vertexPositionOffset"), 1, _layout.positionOffset());
+	glUniform3fv(glGetUniformLocation(program, "vertexPositionScale"), 1, _layout.positionScale());
+	glUseProgram(0);
+}
+
+bool drawSubmissionSupported(DrawSubmission submission)
+{
+	if (submission == DRAW_SUBMISSION_MULTI_INDIRECT)
+		return GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect;
+
+	return GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+}
+
+const char* drawSubmissionName(DrawSubmission submission)
+{
+	return kSubmissionNames[submission];
+}
+
+bool parseDrawSubmission(const char* name, DrawSubmission* submission)
+{
+	for (int i = 0; i <= DRAW_SUBMISSION_MULTI_INDIRECT; ++i) {
+		if (strcmp(name, kSubmissionNames[i]) == 0) {
+			*submission = (DrawSubmission)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+DrawBatch::DrawBatch()
+	: _submission(DRAW_SUBMISSION_MULTI_INDIRECT), _drawParameters(false),
+	_drawIndexLocation(-1), _commandBuffer(0), _drawBuffer(0), _generatedCommands(0),
+	_generatedCount(0), _generatedMax(0)
+{
+}
+
+bool DrawBatch::init(DrawSubmission submission)
+{
+	if (!drawSubmissionSupported(submission)) {
+		fprintf(stderr, "Error: draw submission %s is not supported\n", drawSubmissionName(submission));
+		return false;
+	}
+
+	_submission = submission;
+	_drawParameters = GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters;
+
+	_vertexSource = "#define DRAW_BATCH\n";
+	if (_drawParameters) {
+		_vertexSource +=
+			"#extension GL_ARB_shader_draw_parameters : require\n"
+			"#define DRAW_INSTANCE (gl_BaseInstanceARB + gl_InstanceID)\n";
+
+		// gl_DrawIDARB only counts within one multi-draw.
+		_vertexSource += submission == DRAW_SUBMISSION_MULTI_INDIRECT ?
+			"#define DRAW_ID gl_DrawIDARB\n" :
+			"uniform int drawIndex;\n#define DRAW_ID drawIndex\n";
+	}
+	else {
+		_vertexSource +=
+			"layout(location = 6) in uvec2 drawInstance;\n"
+			"#define DRAW_INSTANCE int(drawInstance.x)\n"
+			"#define DRAW_ID int(drawInstance.y)\n";
+	}
+
+	if (submission == DRAW_SUBMISSION_MULTI_INDIRECT)
+		glGenBuffers(1, &_commandBuffer);
+
+	if (!_drawParameters)
+		glGenBuffers(1, &_drawBuffer);
+
+	return true;
+}
+
+void DrawBatch::destroy()
+{
+	glDeleteBuffers(1, &_commandBuffer);
+	glDeleteBuffers(1, &_drawBuffer);
+	_commandBuffer = 0;
+	_drawBuffer = 0;
+	_generatedCommands = 0;
+
+	_commands.clear();
+	_vertexSource.clear();
+}
+
+void DrawBatch::bindProgram(unsigned int program)
+{
+	_drawIndexLocation = glGetUniformLocation(program, "drawIndex");
+}
+
+void DrawBatch::bindVertexArray()
+{
+	if (!_drawBuffer)
+		return;
+
+	glBindBuffer(GL_ARRAY_BUFFER, _drawBuffer);
+	glVertexAttribIPointer(kDrawAttribute, 2, GL_UNSIGNED_INT, 0, (void*)0);
+	glVertexAttribDivisor(kDrawAttribute, 1);
+	glEnableVertexAttribArray(kDrawAttribute);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void DrawBatch::clear()
+{
+	_commands.clear();
+}
+
+void DrawBatch::add(const PoolMesh& mesh, unsigned int instanceCount, unsigned int baseInstance)
+{
+	Command command = { mesh.indexCount, instanceCount, mesh.firstIndex, mesh.baseVertex, baseInstance };
+	_commands.push_back(command);
+}
+
+void DrawBatch::upload()
+{
+	if (_commandBuffer) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(Command) * _commands.size(),
+				_commands.empty() ? nullptr : &_commands[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	if (_drawBuffer) {
+		unsigned int end = 0;
+		for (const Command& command : _commands)
+			end = std::max(end, command.baseInstance + command.instanceCount);
+
+		std::vector<unsigned int> pairs(2 * end);
+		for (size_t d = 0; d < _commands.size(); ++d) {
+			const Command& command = _commands[d];
+			for (unsigned int i = command.baseInstance; i < command.baseInstance + command.instanceCount; ++i) {
+				pairs[2 * i + 0] = i;
+				pairs[2 * i + 1] = (unsigned int)d;
+			}
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, _drawBuffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(unsigned int) * pairs.size(),
+				pairs.empty() ? nullptr : &pairs[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+void DrawBatch::setGeneratedDraws(unsigned int commandBuffer, unsigned int countBuffer, size_t maxDraws)
+{
+	assert(!commandBuffer || (_submission == DRAW_SUBMISSION_MULTI_INDIRECT && _drawParameters));
+
+	_generatedCommands = commandBuffer;
+	_generatedCount = countBuffer;
+	_generatedMax = maxDraws;
+
+	if (_submission == DRAW_SUBMISSION_MULTI_INDIRECT && _drawParameters) {
+		_vertexSource.replace(_vertexSource.find("#define DRAW_ID"), std::string::npos,
+				commandBuffer ? "#define DRAW_ID 0\n" : "#define DRAW_ID gl_DrawIDARB\n");
+	}
+}
+
+void DrawBatch::draw(unsigned int mode) const
+{
+	if (_generatedCommands) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _generatedCommands);
+		if (GLEW_ARB_indirect_parameters) {
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, _generatedCount);
+			glMultiDrawElementsIndirectCountARB(mode, GL_UNSIGNED_INT, nullptr, 0, (GLsizei)_generatedMax, 0);
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+		}
+		else {
+			glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr, (GLsizei)_generatedMax, 0);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		return;
+	}
+
+	if (_commands.empty())
+		return;
+
+	if (_submission == DRAW_SUBMISSION_MULTI_INDIRECT) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, _commandBuffer);
+		glMultiDrawElementsIndirect(mode, GL_UNSIGNED_INT, nullptr, (GLsizei)_commands.size(), 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		return;
+	}
+
+	for (size_t d = 0; d < _commands.size(); ++d) {
+		const Command& command = _commands[d];
+
+		if (_drawIndexLocation != -1)
+			glUniform1i(_drawIndexLocation, (GLint)d);
+
+		glDrawElementsInstancedBaseVertexBaseInstance(mode, (GLsizei)command.count, GL_UNSIGNED_INT,
+				(const void*)(sizeof(unsigned int) * command.firstIndex), (GLsizei)command.instanceCount,
+				command.baseVertex, command.baseInstance);
+	}
+}
+
+size_t DrawBatch::callCount() const
+{
+	return _submission == DRAW_SUBMISSION_MULTI_INDIRECT ? 1 : _commands.size();
+}
@@ -0,0 +1,153 @@
+#ifndef INSTANCEDATA_H_
+#define INSTANCEDATA_H_
+
+#include <cstddef>
+
+#include <string>
+
+#include "instanceencoding.hpp"
+#include "streambuffer.hpp"
+
+class DrawBatch;
+
+// How encoded instances reach the vertex shader.
+enum InstancePath
+{
+	// texelFetch from a samplerBuffer named Ms.
+	INSTANCE_PATH_TBO,
+	// One instanced vertex attribute per texel (glVertexAttribDivisor),
+	// starting at location kFirstAttribute.
+	INSTANCE_PATH_ATTRIBUTE,
+	// std140 uniform block Instances, drawn in chunks that fit
+	// GL_MAX_UNIFORM_BLOCK_SIZE.
+	INSTANCE_PATH_UBO,
+	// std430 shader storage block Instances (GL 4.3).
+	INSTANCE_PATH_SSBO,
+};
+
+bool instancePathSupported(InstancePath path);
+const char* instancePathName(InstancePath path);
+bool parseInstancePath(const char* name, InstancePath* path);
+
+// Where the per-frame rotation about +Y is applied.
+enum InstanceAnimation
+{
+	// The CPU encodes and uploads every transform each frame.
+	INSTANCE_ANIMATION_CPU,
+	// Base transforms are uploaded once; the vertex shader rotates each
+	// instance by phase + speed * instanceTime before applying its base
+	// transform, so a frame only uploads one uniform.
+	INSTANCE_ANIMATION_GPU,
+};
+
+const char* instanceAnimationName(InstanceAnimation animation);
+bool parseInstanceAnimation(const char* name, InstanceAnimation* animation);
+
+// Streams encoded per-instance data and hides which path the shader reads
+// it through. vertexShaderSource() generates the matching declarations and
+//
+//	INSTANCE_TEXEL instanceTexel(int instance, int texel)
+//
+// which the vertex shader's decoding functions build on; the rest of the
+// shader is the same for every path.
+//
+// With INSTANCE_ANIMATION_GPU it also defines INSTANCE_ANIMATION_GPU, the
+// instanceTime uniform and instanceSpins, a samplerBuffer of per-instance
+// (phase, speed) pairs read the same way on every path, through
+//
+//	vec2 instanceSpin(int instance)
+class InstanceData
+{
+public:
+	static const int kFirstAttribute = 1;
+
+	InstanceData();
+
+	// Needs a current context.
+	// strategy is ignored with INSTANCE_ANIMATION_GPU, where the transforms
+	// are written once into a single buffer.
+	bool init(InstancePath path, InstanceEncoding encoding, size_t instanceCount,
+			StreamStrategy strategy = bestStreamStrategy(),
+			InstanceAnimation animation = INSTANCE_ANIMATION_CPU);
+	void destroy();
+
+	InstancePath path() const { return _path; }
+	InstanceEncoding encoding() const { return _encoding; }
+	InstanceAnimation animation() const { return _animation; }
+	StreamStrategy strategy() const { return _stream.strategy(); }
+
+	// Whether instanceTexel() can read any instance rather than only the
+	// one gl_InstanceID names, as drawing a compacted list of instances
+	// needs. The attribute path follows gl_InstanceID and the uniform
+	// block path sees one chunk at a time.
+	bool indexable() const { return _path == INSTANCE_PATH_TBO || _path == INSTANCE_PATH_SSBO; }
+
+	// For LoadShaders(); only valid after init().
+	const char* vertexShaderSource() const { return _vertexSource.c_str(); }
+
+	// Connects a program linked from vertexShaderSource() to the data.
+	void bindProgram(unsigned int program);
+
+	// Write instanceEncodingStride() * instanceCount bytes in between;
+	// once in total with INSTANCE_ANIMATION_GPU, with the angle at zero.
+	// With count, only the first count instances are written, e.g. the
+	// visible ones, and only those are copied.
+	void* map() { return _stream.map(); }
+	void* map(size_t count) { return _stream.map(instanceEncodingStride(_encoding) * count); }
+	void unmap() { _stream.unmap(); }
+
+	// INSTANCE_ANIMATION_GPU only. Per-instance phase and speed of the
+	// rotation; either may be null for 0 and 1, which init() starts with.
+	void setSpins(const float* phases, const float* speeds);
+
+	// INSTANCE_ANIMATION_GPU only, with the program bound.
+	void setTime(float time);
+
+	// Draws vertexCount vertices per instance from the region last written;
+	// the caller binds the program and vertex array.
+	void draw(unsigned int mode, int first, int vertexCount);
+
+	// Same for only the first instanceCount instances written.
+	void draw(unsigned int mode, int first, int vertexCount, size_t instanceCount);
+
+	// Same, with the counts taken from the DrawArraysIndirectCommand at
+	// the start of commandBuffer; indexable() paths only.
+	void drawIndirect(unsigned int mode, unsigned int commandBuffer);
+
+	// Same for the draws of batch (geometrypool.hpp), whose instance
+	// ranges index the instances written; not on the uniform block path.
+	void draw(unsigned int mode, const DrawBatch& batch);
+
+	// Call once the frame's draws are submitted.
+	void fence() { _stream.fence(); }
+
+	double waitMilliseconds() const { return _stream.waitMilliseconds(); }
+
+private:
+	// commandBuffer is 0 and batch null for a direct draw of instanceCount
+	// instances.
+	void drawRegion(unsigned int mode, int first, int vertexCount, size_t instanceCount,
+			unsigned int commandBuffer, const DrawBatch* batch);
+	void drawInstances(unsigned int mode, int first, int vertexCount, size_t instanceCount,
+			unsigned int commandBuffer, const DrawBatch* batch);
+
+	InstancePath _path;
+	InstanceEncoding _encoding;
+	InstanceAnimation _animation;
+	size_t _instanceCount;
+
+	// Instances per draw on the uniform block path.
+	size_t _chunkInstances;
+
+	StreamBuffer _stream;
+	std::string _vertexSource;
+
+	// (phase, speed) texture buffer and instanceTime, for GPU animation;
+	// instanceBase is the first instance of a uniform block chunk.
+	unsigned int _spinBuffer;
+	unsigned int _spinTexture;
+	int _timeLocation;
+	int _baseLocation;
+};
+
+#endif // INSTANCEDATA_H_
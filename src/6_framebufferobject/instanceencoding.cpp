@@ -0,0 +1,205 @@
+#include "instanceencoding.hpp"
+#include "halffloat.hpp"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include <GL/glew.h>
+
+static const char* const kEncodingNames[] = {
+	"mat4", "affine", "quat", "half",
+};
+
+static const char* const kEncodingDefines[] = {
+	"#define INSTANCE_ENCODING_MAT4\n",
+	"#define INSTANCE_ENCODING_AFFINE\n",
+	"#define INSTANCE_ENCODING_QUAT\n",
+	"#define INSTANCE_ENCODING_HALF\n",
+};
+
+// Instances per buildTransforms() call when an encoding is derived from
+// full matrices; small enough for the block to stay in L1.
+static const size_t kMatrixBlock = 64;
+
+const char* instanceEncodingName(InstanceEncoding encoding)
+{
+	return kEncodingNames[encoding];
+}
+
+bool parseInstanceEncoding(const char* name, InstanceEncoding* encoding)
+{
+	for (int i = 0; i <= INSTANCE_ENCODING_HALF; ++i) {
+		if (strcmp(name, kEncodingNames[i]) == 0) {
+			*encoding = (InstanceEncoding)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t instanceEncodingStride(InstanceEncoding encoding)
+{
+	switch (encoding) {
+	case INSTANCE_ENCODING_AFFINE:
+		return 48;
+	case INSTANCE_ENCODING_QUAT:
+		return 32;
+	case INSTANCE_ENCODING_HALF:
+		return 24;
+	default:
+		return 64;
+	}
+}
+
+int instanceEncodingTexels(InstanceEncoding encoding)
+{
+	switch (encoding) {
+	case INSTANCE_ENCODING_AFFINE:
+		return 3;
+	case INSTANCE_ENCODING_QUAT:
+		return 2;
+	case INSTANCE_ENCODING_HALF:
+		return 3;
+	default:
+		return 4;
+	}
+}
+
+unsigned int instanceEncodingFormat(InstanceEncoding encoding)
+{
+	return encoding == INSTANCE_ENCODING_HALF ? GL_RG32UI : GL_RGBA32F;
+}
+
+const char* instanceEncodingDefine(InstanceEncoding encoding)
+{
+	return kEncodingDefines[encoding];
+}
+
+// Same layout as GLSL packHalf2x16: a in the low bits.
+static uint32_t packHalf2(float a, float b)
+{
+	return (uint32_t)floatToHalf(a) | ((uint32_t)floatToHalf(b) << 16);
+}
+
+static InstanceTransforms offsetInstances(const InstanceTransforms& instances, size_t offset)
+{
+	InstanceTransforms view = instances;
+
+	view.x += offset;
+	view.y += offset;
+	view.z += offset;
+
+	if (view.angle)
+		view.angle += offset;
+
+	if (view.qx) {
+		view.qx += offset;
+		view.qy += offset;
+		view.qz += offset;
+		view.qw += offset;
+	}
+
+	if (view.scale)
+		view.scale += offset;
+
+	return view;
+}
+
+// Rotation as (x, y, z, w), either given or built from the +Y angle.
+static void instanceRotation(const InstanceTransforms& instances, float angle, size_t i, float* q)
+{
+	if (instances.qx) {
+		q[0] = instances.qx[i];
+		q[1] = instances.qy[i];
+		q[2] = instances.qz[i];
+		q[3] = instances.qw[i];
+		return;
+	}
+
+	float a = instances.angle ? angle + instances.angle[i] : angle;
+
+	q[0] = 0.0f;
+	q[1] = std::sin(0.5f * a);
+	q[2] = 0.0f;
+	q[3] = std::cos(0.5f * a);
+}
+
+static void encodeAffine(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out)
+{
+	float matrices[16 * kMatrixBlock];
+
+	for (size_t block = begin; block < end; block += kMatrixBlock) {
+		size_t count = end - block < kMatrixBlock ? end - block : kMatrixBlock;
+
+		buildTransforms(offsetInstances(instances, block), angle, 0, count, matrices);
+
+		// Row r of the 3x4 is element r of each column-major column.
+		for (size_t i = 0; i < count; ++i) {
+			const float* m = matrices + 16 * i;
+			float* rows = out + 12 * (block + i);
+
+			for (int r = 0; r < 3; ++r) {
+				rows[4 * r + 0] = m[r];
+				rows[4 * r + 1] = m[4 + r];
+				rows[4 * r + 2] = m[8 + r];
+				rows[4 * r + 3] = m[12 + r];
+			}
+		}
+	}
+}
+
+static void encodeQuat(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out)
+{
+	for (size_t i = begin; i < end; ++i) {
+		float* texels = out + 8 * i;
+
+		instanceRotation(instances, angle, i, texels);
+
+		texels[4] = instances.x[i];
+		texels[5] = instances.y[i];
+		texels[6] = instances.z[i];
+		texels[7] = instances.scale ? instances.scale[i] : 1.0f;
+	}
+}
+
+static void encodeHalf(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, uint32_t* out)
+{
+	for (size_t i = begin; i < end; ++i) {
+		uint32_t* texels = out + 6 * i;
+
+		memcpy(&texels[0], &instances.x[i], sizeof(float));
+		memcpy(&texels[1], &instances.y[i], sizeof(float));
+		memcpy(&texels[2], &instances.z[i], sizeof(float));
+
+		float q[4];
+		instanceRotation(instances, angle, i, q);
+
+		texels[3] = packHalf2(q[0], q[1]);
+		texels[4] = packHalf2(q[2], q[3]);
+		texels[5] = packHalf2(instances.scale ? instances.scale[i] : 1.0f, 0.0f);
+	}
+}
+
+void encodeInstances(InstanceEncoding encoding, const InstanceTransforms& instances,
+		float angle, size_t begin, size_t end, void* out)
+{
+	switch (encoding) {
+	case INSTANCE_ENCODING_AFFINE:
+		encodeAffine(instances, angle, begin, end, (float*)out);
+		break;
+	case INSTANCE_ENCODING_QUAT:
+		encodeQuat(instances, angle, begin, end, (float*)out);
+		break;
+	case INSTANCE_ENCODING_HALF:
+		encodeHalf(instances, angle, begin, end, (uint32_t*)out);
+		break;
+	default:
+		buildTransforms(instances, angle, begin, end, (float*)out);
+		break;
+	}
+}
@@ -0,0 +1,159 @@
+#ifndef INSTANCINGSCENE_H_
+#define INSTANCINGSCENE_H_
+
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "bvh.hpp"
+#include "culling.hpp"
+#include "frustumcull.hpp"
+#include "geometrypool.hpp"
+#include "instancedata.hpp"
+#include "instanceencoding.hpp"
+#include "jobsystem.hpp"
+#include "streambuffer.hpp"
+
+class Benchmark;
+class GpuProfiler;
+class Sample;
+
+// Everything render() needs from one update(), so update() can run on the
+// simulation thread without touching GL.
+struct FramePacket
+{
+	// Encoded with the scene's InstanceEncoding; empty with GPU animation,
+	// where only time changes.
+	std::vector<unsigned char> instances;
+	glm::mat4 VP;
+	glm::vec3 eye;
+	float time;
+
+	// All instances, or the visible ones with CPU culling.
+	size_t instanceCount;
+	double cullMilliseconds;
+
+	// BVH culling also picks the instance in the middle of the view.
+	double pickMilliseconds;
+
+	// A packet no update() has written yet draws nothing.
+	FramePacket()
+		: VP(0.0f), eye(0.0f), time(0.0f), instanceCount(0), cullMilliseconds(0.0),
+		pickMilliseconds(0.0)
+	{
+	}
+};
+
+// The spinning instances the instancing and framebuffer samples draw: their
+// options, placement and animation, the meshes and culling picked on the
+// command line, and the InstanceData they stream through. The sample owns
+// the program, builds it with vertexShaderSource() and calls the rest in
+// the order of a frame: update() on the simulation thread, then upload(),
+// cull() and draw() on the render thread.
+class InstancingScene
+{
+public:
+	InstancingScene();
+
+	InstancingScene(const InstancingScene&) = delete;
+	InstancingScene& operator=(const InstancingScene&) = delete;
+
+	// The instance, culling and mesh options; others are left for the
+	// sample.
+	bool parseArguments(int argc, char** argv);
+
+	// With the sample's vertex array bound, which the instances, meshes and
+	// culler set up their attributes in. Checks the options go together and
+	// records them as benchmark properties of sample.
+	bool init(Sample* sample);
+	void destroy();
+
+	// What the sample's vertex shader is built behind.
+	const std::string& vertexShaderSource() const { return _vertexHeader; }
+
+	// Uniform locations and bindings of program, again after a reload.
+	void bindProgram(unsigned int program);
+
+	// The camera and instances at time for a view of the given aspect.
+	void update(FramePacket& packet, float time, float aspect);
+
+	// Streams the packet's instances; the program's uniforms are the
+	// sample's, apart from setTime() through instances().
+	void upload(const FramePacket& packet, Benchmark* benchmark);
+
+	// GPU and meshlet culling, before draw().
+	void cull(const FramePacket& packet, GpuProfiler* profiler);
+
+	// With the program in use and the vertex array of init() bound.
+	void draw(const FramePacket& packet);
+
+	InstanceData& instances() { return _instances; }
+	InstanceAnimation animation() const { return _animation; }
+	int meshCount() const { return _meshCount; }
+	const GeometryPool& geometry() const { return _geometry; }
+
+private:
+	InstanceTransforms baseTransforms() const;
+	BoundingSpheres boundingSpheres() const;
+	void encodeVisibleInstances(FramePacket& packet, float time);
+	bool buildMeshBatch(Sample* sample);
+	void uploadBaseTransforms();
+
+	// The triangle every instance is without --meshes or --mesh.
+	unsigned int _vbo;
+	InstanceData _instances;
+	std::string _vertexHeader;
+
+	int _instanceCount;
+	// Structure of arrays, so the transform kernel loads whole registers.
+	std::vector<float> _positionX;
+	std::vector<float> _positionY;
+	std::vector<float> _positionZ;
+
+	// Per-instance phase and speed with --spin-variation, and the angles
+	// the CPU animation derives from them each frame.
+	std::vector<float> _spinPhase;
+	std::vector<float> _spinSpeed;
+	std::vector<float> _spinAngle;
+
+	int _workerCount;
+	JobSystem* _jobs;
+
+	InstanceEncoding _encoding;
+	InstancePath _path;
+	InstanceAnimation _animation;
+	float _spinVariation;
+
+	CullMode _cullMode;
+	GpuCuller _culler;
+	MeshletCuller _meshletCuller;
+	FrustumCuller _frustumCuller;
+	InstanceBvh _bvh;
+	std::vector<unsigned int> _bvhVisible;
+	std::vector<float> _radius;
+
+	// The visible instances in culled order, for encoding with CPU and BVH
+	// culling.
+	std::vector<float> _visibleX;
+	std::vector<float> _visibleY;
+	std::vector<float> _visibleZ;
+	std::vector<float> _visibleAngle;
+
+	// With --meshes the instances are split between meshes from one pool,
+	// all drawn by _batch, instead of all being the triangle; --mesh is one
+	// mesh from a file.
+	int _meshCount;
+	std::string _meshPath;
+	DrawSubmission _submission;
+	VertexFormat _vertexFormat;
+	GeometryPool _geometry;
+	DrawBatch _batch;
+
+	StreamStrategy _uploadStrategy;
+	bool _uploadStrategySet;
+};
+
+#endif // INSTANCINGSCENE_H_
@@ -0,0 +1,163 @@
+#include "jobsystem.hpp"
+#include "trace.hpp"
+
+JobSystem::JobSystem(int workerCount)
+	: _queuedTasks(0), _stopping(false)
+{
+	if (workerCount < 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? (int)hardwareThreads - 1 : 0;
+	}
+
+	for (int i = 0; i < workerCount + 1; ++i)
+		_queues.push_back(new Queue());
+
+	for (int i = 0; i < workerCount; ++i)
+		_workers.push_back(std::thread(&JobSystem::workerMain, this, i + 1));
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stopping = true;
+	}
+	_wakeUp.notify_all();
+
+	for (auto& worker : _workers)
+		worker.join();
+
+	for (auto queue : _queues)
+		delete queue;
+}
+
+void JobSystem::parallelFor(size_t count, size_t grainSize, const RangeFunction& body)
+{
+	if (count == 0)
+		return;
+
+	if (grainSize == 0)
+		grainSize = 1;
+
+	if (_workers.empty() || count <= grainSize) {
+		body(0, count);
+		return;
+	}
+
+	std::atomic<size_t> remaining(count);
+
+	Task root;
+	root.body = &body;
+	root.begin = 0;
+	root.end = count;
+	root.grainSize = grainSize;
+	root.remaining = &remaining;
+
+	execute(0, root);
+
+	// Help out until the last range, possibly stolen by a worker, is done.
+	while (remaining.load(std::memory_order_acquire) > 0) {
+		Task task;
+		if (findTask(0, task))
+			execute(0, task);
+		else
+			std::this_thread::yield();
+	}
+}
+
+void JobSystem::workerMain(int index)
+{
+	if (Trace::enabled())
+		Trace::setThreadName("worker");
+
+	for (;;) {
+		Task task;
+		if (findTask(index, task)) {
+			execute(index, task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_wakeUp.wait(lock, [this]() {
+			return _stopping || _queuedTasks.load(std::memory_order_acquire) > 0;
+		});
+
+		if (_stopping)
+			return;
+	}
+}
+
+void JobSystem::push(int queue, const Task& task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_queues[queue]->mutex);
+		_queues[queue]->tasks.push_back(task);
+	}
+
+	_queuedTasks.fetch_add(1, std::memory_order_release);
+
+	// Taking the lock orders this with a worker checking the predicate.
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+	}
+	_wakeUp.notify_one();
+}
+
+bool JobSystem::pop(int queue, Task& task)
+{
+	std::lock_guard<std::mutex> lock(_queues[queue]->mutex);
+
+	std::deque<Task>& tasks = _queues[queue]->tasks;
+	if (tasks.empty())
+		return false;
+
+	task = tasks.back();
+	tasks.pop_back();
+
+	_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+
+	return true;
+}
+
+bool JobSystem::steal(int thief, Task& task)
+{
+	int queueCount = (int)_queues.size();
+
+	for (int i = 1; i < queueCount; ++i) {
+		Queue* victim = _queues[(thief + i) % queueCount];
+
+		std::lock_guard<std::mutex> lock(victim->mutex);
+		if (victim->tasks.empty())
+			continue;
+
+		task = victim->tasks.front();
+		victim->tasks.pop_front();
+
+		_queuedTasks.fetch_sub(1, std::memory_order_relaxed);
+
+		return true;
+	}
+
+	return false;
+}
+
+bool JobSystem::findTask(int queue, Task& task)
+{
+	return pop(queue, task) || steal(queue, task);
+}
+
+void JobSystem::execute(int queue, Task task)
+{
+	while (task.end - task.begin > task.grainSize) {
+		Task upper = task;
+		upper.begin = task.begin + (task.end - task.begin) / 2;
+
+		push(queue, upper);
+
+		task.end = upper.begin;
+	}
+
+	(*task.body)(task.begin, task.end);
+
+	task.remaining->fetch_sub(task.end - task.begin, std::memory_order_acq_rel);
+}
@@ -1,14 +1,39 @@
 #ifndef SAMPLE_H_
 #define SAMPLE_H_
 
+#include <vector>
+
+#include "gpuprofiler.hpp"
+
 class Sample_Impl;
+class Benchmark;
+
+enum SampleBackend
+{
+	SAMPLE_BACKEND_WINDOW,		// GLFW window, presented with glfwSwapBuffers
+	SAMPLE_BACKEND_OFFSCREEN,	// EGL context without a display, rendered into an FBO
+};
 
 class Sample
 {
 public:
-	Sample();
+	Sample(int contextMajor = 3, int contextMinor = 3);
 	virtual ~Sample();
 
+	// Understands --offscreen, --frames <n>, --size <w>x<h> and the benchmark
+	// switches --bench, --warmup <n>, --bench-output <path|->. --gpu-profile
+	// prints GPU zone timings periodically (benchmarks record them anyway).
+	// --trace <path> writes a chrome://tracing timeline of CPU zones on destroy().
+	// --threaded runs update() on a simulation thread, see supportsThreadedUpdate().
+	// --program-cache <dir|none> keeps linked programs in dir (programcache
+	// by default) for later runs to load instead of building, see
+	// ProgramCache.
+	// Shaders come from the pack built into the sample, or else shaders.pack
+	// next to the executable when there is one (see ShaderPack);
+	// --shader-pack <file|none> names another, or reads them from files.
+	// Must be called before init(); unknown arguments are left for subclasses.
+	virtual bool parseArguments(int argc, char** argv);
+
 	virtual bool init();
 	virtual void destroy();
 
@@ -20,10 +45,49 @@ public:
 
 	virtual bool is_running() const;
 
+	// Samples whose update() only touches CPU state and hands its results
+	// to render() through a TripleBuffer can have update() run on a
+	// simulation thread with --threaded, overlapping the next frame's
+	// simulation with this frame's GL submission. render() keeps the context.
+	virtual bool supportsThreadedUpdate() const { return false; }
+
 	virtual void run();
 
 	virtual int windowWidth() const;
 	virtual int windowHeight() const;
+
+	SampleBackend backend() const;
+
+	// Framebuffer standing in for the default one: 0 when presenting to a
+	// window, the backend's color target when running offscreen.
+	unsigned int defaultFramebuffer() const;
+
+	// Non-null only while a measured benchmark frame is running, so samples
+	// can add their own series next to the update/render/swap timings.
+	Benchmark* benchmark() const;
+
+	// Describes the run in the benchmark report, e.g. from initContents().
+	void setBenchmarkProperty(const char* key, const char* value);
+	void setBenchmarkProperty(const char* key, double value);
+
+	// Zones opened on the profiler nest inside the "frame" zone that run()
+	// wraps around render(); the profiler is disabled unless --gpu-profile
+	// or --bench was given, in which case zones cost nothing.
+	GpuProfiler* gpuProfiler() const;
+	const std::vector<GpuTiming>& gpuTimings() const;
+
+	// A second context sharing objects with the sample's, for a thread of
+	// the sample's own to build programs on, see ShaderReloader. Created
+	// on the main thread after init() and freed by destroy(), after
+	// destroyContents(); only one thread may have it current at a time.
+	bool createSharedContext();
+
+	// Makes the shared context current on the calling thread, or with
+	// false releases it from there.
+	bool makeSharedContextCurrent(bool current);
+
+protected:
+	Sample_Impl* impl;
 };
 
 #endif // SAMPLE_H_
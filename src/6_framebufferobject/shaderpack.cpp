@@ -0,0 +1,290 @@
+#include "shaderpack.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	const ShaderPack* g_pack = nullptr;
+
+	// Packed by file name, so a path finds what was packed from any
+	// directory.
+	const char* fileName(const char* path)
+	{
+		const char* name = path;
+		for (const char* c = path; *c; ++c) {
+			if (*c == '/' || *c == '\\')
+				name = c + 1;
+		}
+
+		return name;
+	}
+
+	bool entryBefore(const ShaderPackEntry& entry, const char* name)
+	{
+		return strncmp(entry.name, name, kShaderPackNameLength) < 0;
+	}
+}
+
+bool buildShaderPack(const std::vector<std::string>& names, const std::vector<std::string>& sources,
+		std::vector<unsigned char>* pack)
+{
+	std::vector<size_t> order(names.size());
+	for (size_t i = 0; i < order.size(); ++i)
+		order[i] = i;
+
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return names[a] < names[b]; });
+
+	size_t size = sizeof(ShaderPackHeader) + names.size() * sizeof(ShaderPackEntry);
+	std::vector<ShaderPackEntry> entries(names.size());
+
+	for (size_t i = 0; i < order.size(); ++i) {
+		const std::string& name = names[order[i]];
+		if (name.size() >= kShaderPackNameLength) {
+			fprintf(stderr, "Error: shader name %s is longer than %u characters\n",
+					name.c_str(), kShaderPackNameLength - 1);
+			return false;
+		}
+
+		if (i > 0 && names[order[i - 1]] == name) {
+			fprintf(stderr, "Error: %s is packed twice\n", name.c_str());
+			return false;
+		}
+
+		ShaderPackEntry& entry = entries[i];
+		memset(&entry, 0, sizeof(entry));
+		memcpy(entry.name, name.c_str(), name.size());
+		entry.offset = size;
+		entry.size = (uint32_t)sources[order[i]].size();
+
+		size += entry.size + 1;
+	}
+
+	ShaderPackHeader header;
+	memcpy(header.magic, kShaderPackMagic, sizeof(header.magic));
+	header.version = kShaderPackVersion;
+	header.fileSize = size;
+	header.entryCount = (uint32_t)entries.size();
+	header.reserved = 0;
+
+	pack->assign(size, 0);
+	memcpy(&(*pack)[0], &header, sizeof(header));
+	if (!entries.empty())
+		memcpy(&(*pack)[sizeof(header)], &entries[0], entries.size() * sizeof(ShaderPackEntry));
+
+	for (size_t i = 0; i < order.size(); ++i) {
+		const std::string& source = sources[order[i]];
+		if (!source.empty())
+			memcpy(&(*pack)[entries[i].offset], source.data(), source.size());
+	}
+
+	return true;
+}
+
+ShaderPack::ShaderPack()
+	: _data(nullptr), _size(0), _mapped(false)
+#ifdef _WIN32
+	, _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+#endif
+{
+}
+
+ShaderPack::~ShaderPack()
+{
+	close();
+}
+
+bool ShaderPack::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error: cannot open %s\n", path);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(_file, &size);
+	_size = (size_t)size.QuadPart;
+
+	if (_size >= sizeof(ShaderPackHeader)) {
+		_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping)
+			_data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: cannot open %s\n", path);
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) == 0)
+		_size = (size_t)status.st_size;
+
+	if (_size >= sizeof(ShaderPackHeader)) {
+		void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED)
+			_data = (const unsigned char*)data;
+	}
+
+	::close(fd);
+#endif
+
+	if (!_data) {
+		fprintf(stderr, "Error: cannot map %s\n", path);
+		close();
+		return false;
+	}
+
+	_mapped = true;
+	return check(path);
+}
+
+bool ShaderPack::open(const void* data, size_t size, const char* description)
+{
+	close();
+
+	_data = (const unsigned char*)data;
+	_size = size;
+
+	if (size < sizeof(ShaderPackHeader)) {
+		fprintf(stderr, "Error: %s is not a shader pack\n", description);
+		close();
+		return false;
+	}
+
+	return check(description);
+}
+
+bool ShaderPack::check(const char* description)
+{
+	const ShaderPackHeader& h = header();
+
+	if (memcmp(h.magic, kShaderPackMagic, sizeof(h.magic)) != 0 || h.version != kShaderPackVersion) {
+		fprintf(stderr, "Error: %s is not a version %u shader pack\n", description, kShaderPackVersion);
+		close();
+		return false;
+	}
+
+	bool damaged = h.fileSize != _size ||
+		h.entryCount > (_size - sizeof(ShaderPackHeader)) / sizeof(ShaderPackEntry);
+
+	// Names terminated and in order for find(), sources inside the pack
+	// and followed by their 0.
+	for (uint32_t i = 0; !damaged && i < h.entryCount; ++i) {
+		const ShaderPackEntry& entry = entries()[i];
+		damaged = entry.name[kShaderPackNameLength - 1] != '\0' ||
+			(i > 0 && !entryBefore(entries()[i - 1], entry.name)) ||
+			entry.offset > _size || entry.size >= _size - entry.offset ||
+			_data[entry.offset + entry.size] != '\0';
+	}
+
+	if (damaged) {
+		fprintf(stderr, "Error: %s is damaged\n", description);
+		close();
+		return false;
+	}
+
+	return true;
+}
+
+void ShaderPack::close()
+{
+	if (_mapped) {
+#ifdef _WIN32
+		if (_data)
+			UnmapViewOfFile(_data);
+#else
+		if (_data)
+			munmap((void*)_data, _size);
+#endif
+	}
+
+#ifdef _WIN32
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+#endif
+
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+}
+
+const char* ShaderPack::find(const char* name, size_t* size) const
+{
+	if (!isOpen())
+		return nullptr;
+
+	name = fileName(name);
+
+	const ShaderPackEntry* begin = entries();
+	const ShaderPackEntry* end = begin + header().entryCount;
+	const ShaderPackEntry* entry = std::lower_bound(begin, end, name, entryBefore);
+	if (entry == end || strncmp(entry->name, name, kShaderPackNameLength) != 0)
+		return nullptr;
+
+	*size = entry->size;
+	return (const char*)_data + entry->offset;
+}
+
+void ShaderSource::setPack(const ShaderPack* pack)
+{
+	g_pack = pack;
+}
+
+const ShaderPack* ShaderSource::pack()
+{
+	return g_pack;
+}
+
+bool ShaderSource::read(const char* path, std::string* source)
+{
+	size_t size = 0;
+	const char* packed = g_pack ? g_pack->find(path, &size) : nullptr;
+	if (packed) {
+		source->assign(packed, size);
+		return true;
+	}
+
+	return readFile(path, source);
+}
+
+bool ShaderSource::readFile(const char* path, std::string* source)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	source->resize(size > 0 ? (size_t)size : 0);
+	bool read = size >= 0 && (source->empty() || fread(&(*source)[0], 1, source->size(), file) == source->size());
+	fclose(file);
+
+	return read;
+}
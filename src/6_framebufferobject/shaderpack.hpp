@@ -0,0 +1,102 @@
+#ifndef SHADERPACK_H_
+#define SHADERPACK_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+// Shader pack (.pack): every shader of a sample in one file, written by
+// packshaders at build time and mapped at startup, so loading programs
+// opens no file of its own. A ShaderPackHeader, the ShaderPackEntry table
+// sorted by name, then the sources, each followed by a 0 so it can go to
+// glShaderSource() as it is. Little endian.
+static const char kShaderPackMagic[4] = { 'O', 'G', 'C', 'S' };
+static const uint32_t kShaderPackVersion = 1;
+static const uint32_t kShaderPackNameLength = 48;
+
+struct ShaderPackHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t fileSize;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+// A source of size bytes at offset from the start of the file. name is
+// the file name the shader was packed from, without its directory, and
+// 0 terminated.
+struct ShaderPackEntry
+{
+	char name[kShaderPackNameLength];
+	uint64_t offset;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+// The pack holding sources under names, for packshaders; false when a
+// name is too long or there twice.
+bool buildShaderPack(const std::vector<std::string>& names, const std::vector<std::string>& sources,
+		std::vector<unsigned char>* pack);
+
+// A shader pack mapped read-only, or one compiled into the binary (see
+// packshaders --embed). open() checks the table; a source's pages only
+// come in when it is looked up.
+class ShaderPack
+{
+public:
+	ShaderPack();
+	~ShaderPack();
+
+	ShaderPack(const ShaderPack&) = delete;
+	ShaderPack& operator=(const ShaderPack&) = delete;
+
+	bool open(const char* path);
+
+	// data stays the caller's; description names it in errors.
+	bool open(const void* data, size_t size, const char* description);
+
+	void close();
+
+	bool isOpen() const { return _data != nullptr; }
+
+	// The 0 terminated source packed as name, its length in size, or null.
+	const char* find(const char* name, size_t* size) const;
+
+	size_t entryCount() const { return isOpen() ? header().entryCount : 0; }
+	size_t size() const { return _size; }
+
+private:
+	const ShaderPackHeader& header() const { return *(const ShaderPackHeader*)_data; }
+	const ShaderPackEntry* entries() const { return (const ShaderPackEntry*)(_data + sizeof(ShaderPackHeader)); }
+
+	bool check(const char* description);
+
+	const unsigned char* _data;
+	size_t _size;
+	bool _mapped;
+
+#ifdef _WIN32
+	void* _file;
+	void* _mapping;
+#endif
+};
+
+// Where LoadShaders() and ShaderBatch get shader sources: the pack Sample
+// opened at startup when it has the file, the file itself otherwise.
+namespace ShaderSource
+{
+	// null reads every source from its file; the pack stays the caller's.
+	void setPack(const ShaderPack* pack);
+	const ShaderPack* pack();
+
+	// false when neither the pack nor the file system has it.
+	bool read(const char* path, std::string* source);
+
+	// The whole file in one read, skipping the pack.
+	bool readFile(const char* path, std::string* source);
+}
+
+#endif // SHADERPACK_H_
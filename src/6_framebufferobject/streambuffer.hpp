@@ -0,0 +1,103 @@
+#ifndef STREAMBUFFER_H_
+#define STREAMBUFFER_H_
+
+#include <cstddef>
+
+#include <vector>
+
+// How StreamBuffer gets data to the GPU. Which one is fastest depends on
+// the driver, so it is chosen at startup.
+enum StreamStrategy
+{
+	// Writes go to system memory and are copied with glBufferSubData.
+	STREAM_BUFFER_SUBDATA,
+	// glBufferData(NULL) hands the driver a fresh store, then it is mapped.
+	STREAM_ORPHAN,
+	// glMapBufferRange with GL_MAP_INVALIDATE_BUFFER_BIT.
+	STREAM_INVALIDATE,
+	// A ring of buffers mapped with GL_MAP_UNSYNCHRONIZED_BIT, each guarded
+	// by our own fence.
+	STREAM_UNSYNCHRONIZED,
+	// A ring of regions in one persistently mapped, coherent buffer, each
+	// guarded by our own fence and read through a glTexBufferRange view.
+	STREAM_PERSISTENT,
+};
+
+// Fastest strategy the current context supports.
+StreamStrategy bestStreamStrategy();
+bool streamStrategySupported(StreamStrategy strategy);
+const char* streamStrategyName(StreamStrategy strategy);
+bool parseStreamStrategy(const char* name, StreamStrategy* strategy);
+
+// Buffer for data rewritten every frame and read through a texture buffer.
+//
+// The ring strategies let the CPU write region N while the GPU may still
+// read N - 1 and N - 2, so map() only waits when the GPU falls a whole
+// ring behind. The others use a single buffer and leave synchronization
+// to the driver.
+class StreamBuffer
+{
+public:
+	static const int kMaxRegions = 4;
+
+	StreamBuffer();
+	~StreamBuffer();
+
+	// Needs a current context. format is the texture buffer's internal
+	// format, e.g. GL_RGBA32F. regionCount only applies to ring strategies.
+	bool init(size_t regionSize, unsigned int format,
+			StreamStrategy strategy = bestStreamStrategy(), int regionCount = 3);
+	void destroy();
+
+	StreamStrategy strategy() const { return _strategy; }
+	size_t regionSize() const { return _regionSize; }
+
+	// Returns the current region for writing. Every map() needs an unmap()
+	// before drawing. With bytes, only the first bytes of the region are
+	// written, so only those are mapped or copied; the rest is undefined.
+	void* map() { return map(_regionSize); }
+	void* map(size_t bytes);
+	void unmap();
+
+	// Texture buffer view of the region last written.
+	unsigned int texture() const { return _textures[_current]; }
+
+	// Buffer and byte offset of the region last written, for binding it
+	// as vertex attributes or a uniform or storage block instead.
+	unsigned int buffer() const { return _buffers[_strategy == STREAM_PERSISTENT ? 0 : _current]; }
+	size_t offset() const { return _strategy == STREAM_PERSISTENT ? _regionSize * _current : 0; }
+
+	// Call after the draws reading the region are submitted; moves on to
+	// the next region.
+	void fence();
+
+	// CPU time the last map() and unmap() spent blocked: on our fence for
+	// the ring strategies, inside the driver's map or copy for the others.
+	double waitMilliseconds() const { return _waitMilliseconds; }
+
+private:
+	bool ring() const { return _strategy == STREAM_UNSYNCHRONIZED || _strategy == STREAM_PERSISTENT; }
+	bool waitRegion(int region);
+
+	StreamStrategy _strategy;
+	size_t _regionSize;
+	int _regionCount;
+	int _current;
+
+	// Bytes the last map() was for.
+	size_t _mappedBytes;
+
+	unsigned int _buffers[kMaxRegions];
+	unsigned int _textures[kMaxRegions];
+	void* _fences[kMaxRegions];
+
+	// Persistent mapping of the whole ring.
+	unsigned char* _mapped;
+
+	// System memory copy for STREAM_BUFFER_SUBDATA.
+	std::vector<unsigned char> _staging;
+
+	double _waitMilliseconds;
+};
+
+#endif // STREAMBUFFER_H_
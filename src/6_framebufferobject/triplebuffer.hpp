@@ -0,0 +1,55 @@
+#ifndef TRIPLEBUFFER_H_
+#define TRIPLEBUFFER_H_
+
+#include <atomic>
+
+// Single-producer/single-consumer handoff of whole frames. The producer
+// fills writeBuffer() and publish()es it; the consumer acquire()s the most
+// recently published one and reads it until the next acquire(). Neither
+// side ever waits on the other, and a slow consumer just skips stale frames.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: _middle(1), _write(0), _read(2)
+	{
+	}
+
+	T& writeBuffer() { return _buffers[_write]; }
+
+	void publish()
+	{
+		int previous = _middle.exchange(_write | kFresh, std::memory_order_acq_rel);
+		_write = previous & kIndexMask;
+	}
+
+	// Returns false, keeping the current read buffer, when nothing new
+	// has been published since the last call.
+	bool acquire()
+	{
+		if (!(_middle.load(std::memory_order_relaxed) & kFresh))
+			return false;
+
+		int previous = _middle.exchange(_read, std::memory_order_acq_rel);
+		_read = previous & kIndexMask;
+
+		return true;
+	}
+
+	const T& readBuffer() const { return _buffers[_read]; }
+
+private:
+	static const int kIndexMask = 3;
+	static const int kFresh = 4;
+
+	T _buffers[3];
+
+	// Index of the buffer between producer and consumer, plus kFresh while
+	// it holds a frame the consumer has not seen yet.
+	std::atomic<int> _middle;
+	int _write;
+	int _read;
+};
+
+#endif // TRIPLEBUFFER_H_
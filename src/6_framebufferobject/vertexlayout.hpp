@@ -0,0 +1,105 @@
+#ifndef VERTEXLAYOUT_H_
+#define VERTEXLAYOUT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+
+#include "meshfile.hpp"
+
+// How the MeshAttributes of a vertex are stored.
+enum VertexFormat
+{
+	// Position, normal and tangent as 3 floats, texture coordinates as 2,
+	// the tangent's bitangent sign as a fourth float (48 bytes with all).
+	VERTEX_FORMAT_FLOAT,
+	// Position as normalized int16 within the mesh bounds (8 bytes, padded),
+	// normal octahedral as two normalized int16 (4), texture coordinates as
+	// halves (4) and the tangent as normalized 10_10_10_2 with the sign in
+	// the 2 bits (4): 20 bytes with all.
+	VERTEX_FORMAT_QUANTIZED,
+};
+
+const char* vertexFormatName(VertexFormat format);
+bool parseVertexFormat(const char* name, VertexFormat* format);
+
+uint32_t vertexLayoutStride(uint32_t attributes, VertexFormat format);
+
+// Component types the attributes are stored as.
+enum VertexComponent
+{
+	VERTEX_COMPONENT_FLOAT,
+	VERTEX_COMPONENT_HALF,
+	VERTEX_COMPONENT_SNORM16,
+	VERTEX_COMPONENT_SNORM_10_10_10_2,
+};
+
+// One attribute as glVertexAttribPointer() takes it: components of
+// component at offset, normalized unless float or half.
+struct VertexAttributeLayout
+{
+	MeshAttribute attribute;
+	int location;
+	int components;
+	VertexComponent component;
+	uint32_t offset;
+};
+
+// The layout of the vertices of a GeometryPool or .mesh file: where every
+// attribute is, how GeometryPool::bindVertexArray() points GL at it, and
+// vertexShaderSource(), which declares the inputs and functions returning
+// them decoded (vertexPosition(), and vertexNormal(), vertexTexcoord() and
+// vertexTangent() when present). Quantized positions are relative to the
+// bounds given to init(): the shader gets their center and half extent as
+// the uniforms vertexPositionOffset and vertexPositionScale.
+class VertexLayout
+{
+public:
+	// Attribute locations, clear of the instance data, culling and draw
+	// batch attributes.
+	static const int kPositionAttribute = 0;
+	static const int kNormalAttribute = 7;
+	static const int kTexcoordAttribute = 8;
+	static const int kTangentAttribute = 9;
+
+	VertexLayout();
+
+	void init(uint32_t attributes, VertexFormat format, const float* boundsMin, const float* boundsMax);
+
+	// From a .mesh header.
+	void init(const MeshFileHeader& header);
+
+	uint32_t attributes() const { return _attributes; }
+	VertexFormat format() const { return _format; }
+	uint32_t stride() const { return _stride; }
+
+	int attributeCount() const { return _attributeCount; }
+	const VertexAttributeLayout& attribute(int i) const { return _layout[i]; }
+
+	const float* positionOffset() const { return _positionOffset; }
+	const float* positionScale() const { return _positionScale; }
+
+	// Writes count vertices given as floats (meshVertexStride() apart) to
+	// out in this layout.
+	void encode(const float* vertices, size_t count, void* out) const;
+
+	// For LoadShaders(); defines VERTEX_LAYOUT plus VERTEX_NORMAL,
+	// VERTEX_TEXCOORD and VERTEX_TANGENT for the attributes present.
+	const char* vertexShaderSource() const { return _vertexSource.c_str(); }
+
+private:
+	uint32_t _attributes;
+	VertexFormat _format;
+	uint32_t _stride;
+
+	VertexAttributeLayout _layout[4];
+	int _attributeCount;
+
+	float _positionOffset[3];
+	float _positionScale[3];
+
+	std::string _vertexSource;
+};
+
+#endif // VERTEXLAYOUT_H_
@@ -0,0 +1,326 @@
+// Builds an InstanceBvh over 10K to 4M bounding spheres spread through a
+// cube at constant density and times build(), refit() after every sphere
+// moved (one thread and all of them), frustum culling against
+// cullSpheres(), raycast() and queryPoint(). Every query is checked
+// against testing all spheres.
+//
+//	bvh-bench [report.json|-]
+
+#include "benchmark.hpp"
+#include "bvh.hpp"
+#include "frustumcull.hpp"
+#include "jobsystem.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+static const int kBuildIterations = 3;
+static const int kIterations = 10;
+static const int kRayCount = 10000;
+static const int kPointCount = 10000;
+
+// Queries per scene also answered by testing every sphere.
+static const int kCheckedQueries = 64;
+
+struct Random
+{
+	unsigned int state;
+
+	explicit Random(unsigned int seed) : state(seed) {}
+
+	// Uniform in [low, high).
+	float next(float low, float high)
+	{
+		state = state * 1664525u + 1013904223u;
+		return low + (high - low) * ((float)(state >> 8) / 16777216.0f);
+	}
+};
+
+struct Scene
+{
+	std::vector<float> x, y, z, radius;
+	float side;
+
+	// About one sphere per 8 units cubed, radius 0.25 to 1.
+	explicit Scene(size_t count)
+		: x(count), y(count), z(count), radius(count),
+		side(2.0f * std::cbrt((float)count))
+	{
+		Random random(1);
+		for (size_t i = 0; i < count; ++i) {
+			x[i] = random.next(0.0f, side);
+			y[i] = random.next(0.0f, side);
+			z[i] = random.next(0.0f, side);
+			radius[i] = random.next(0.25f, 1.0f);
+		}
+	}
+
+	// Every sphere takes a step of up to half a unit per axis.
+	void move(Random& random)
+	{
+		for (size_t i = 0; i < x.size(); ++i) {
+			x[i] += random.next(-0.5f, 0.5f);
+			y[i] += random.next(-0.5f, 0.5f);
+			z[i] += random.next(-0.5f, 0.5f);
+		}
+	}
+
+	BoundingSpheres view() const
+	{
+		BoundingSpheres view = { &x[0], &y[0], &z[0], &radius[0] };
+		return view;
+	}
+};
+
+static double milliseconds(double start)
+{
+	return (Benchmark::now() - start) * 1000.0;
+}
+
+static std::vector<unsigned int> sorted(std::vector<unsigned int> indices)
+{
+	std::sort(indices.begin(), indices.end());
+	return indices;
+}
+
+// The closest hit by testing every sphere, as in InstanceBvh::raycast().
+static int raycastAll(const Scene& scene, const float* origin, const float* direction, float* distance)
+{
+	float lengthSquared = direction[0] * direction[0] + direction[1] * direction[1] +
+		direction[2] * direction[2];
+
+	int hit = -1;
+	float best = FLT_MAX;
+
+	for (size_t i = 0; i < scene.x.size(); ++i) {
+		float toCenter[3] = { scene.x[i] - origin[0], scene.y[i] - origin[1], scene.z[i] - origin[2] };
+		float along = toCenter[0] * direction[0] + toCenter[1] * direction[1] + toCenter[2] * direction[2];
+		float outside = toCenter[0] * toCenter[0] + toCenter[1] * toCenter[1] +
+			toCenter[2] * toCenter[2] - scene.radius[i] * scene.radius[i];
+
+		float t;
+		if (outside <= 0.0f) {
+			t = 0.0f;
+		}
+		else {
+			float discriminant = along * along - lengthSquared * outside;
+			if (along <= 0.0f || discriminant < 0.0f)
+				continue;
+
+			t = (along - std::sqrt(discriminant)) / lengthSquared;
+		}
+
+		if (t < best) {
+			best = t;
+			hit = (int)i;
+		}
+	}
+
+	*distance = best;
+	return hit;
+}
+
+static size_t queryPointAll(const Scene& scene, const float* point)
+{
+	size_t count = 0;
+	for (size_t i = 0; i < scene.x.size(); ++i) {
+		float dx = point[0] - scene.x[i], dy = point[1] - scene.y[i], dz = point[2] - scene.z[i];
+		if (dx * dx + dy * dy + dz * dz <= scene.radius[i] * scene.radius[i])
+			++count;
+	}
+
+	return count;
+}
+
+// Queries the BVH the way the samples do and compares with testing every
+// sphere; returns false on any difference.
+static bool check(const InstanceBvh& bvh, const Scene& scene, const float* planes)
+{
+	size_t count = scene.x.size();
+	bool ok = true;
+
+	std::vector<unsigned int> visible, expected(count);
+	bvh.cullFrustum(planes, visible);
+	expected.resize(cullSpheres(scene.view(), planes, 0, count, &expected[0]));
+
+	if (sorted(visible) != expected) {
+		fprintf(stderr, "Error: cullFrustum() keeps %zu spheres, cullSpheres() %zu\n",
+				visible.size(), expected.size());
+		ok = false;
+	}
+
+	Random random(7);
+	for (int q = 0; q < kCheckedQueries; ++q) {
+		float origin[3] = { -1.0f, -1.0f, -1.0f };
+		float direction[3] = { random.next(0.0f, 1.0f), random.next(0.0f, 1.0f), random.next(0.0f, 1.0f) };
+
+		float distance = 0.0f, expectedDistance = 0.0f;
+		int hit = bvh.raycast(origin, direction, &distance);
+		int expectedHit = raycastAll(scene, origin, direction, &expectedDistance);
+
+		// Equally close spheres may be reported either way.
+		if ((hit < 0) != (expectedHit < 0) || (hit >= 0 && distance != expectedDistance)) {
+			fprintf(stderr, "Error: raycast() hits %d, testing every sphere %d\n", hit, expectedHit);
+			ok = false;
+		}
+
+		float point[3] = { random.next(0.0f, scene.side), random.next(0.0f, scene.side),
+			random.next(0.0f, scene.side) };
+
+		std::vector<unsigned int> hits;
+		if (bvh.queryPoint(point, hits) != queryPointAll(scene, point)) {
+			fprintf(stderr, "Error: queryPoint() finds %zu spheres, testing every sphere %zu\n",
+					hits.size(), queryPointAll(scene, point));
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	const size_t sizes[] = { 10000, 100000, 1000000, 4000000 };
+
+	JobSystem jobs;
+	JobSystem serial(0);
+
+	Benchmark report;
+	report.setProperty("benchmark", "bvh");
+	report.setProperty("job_threads", jobs.threadCount());
+	report.setProperty("max_leaf_size", (double)InstanceBvh::kMaxLeafSize);
+	report.setProperty("bin_count", (double)InstanceBvh::kBinCount);
+
+	int status = 0;
+
+	for (size_t size : sizes) {
+		Scene scene(size);
+
+		// From just outside one face towards the middle of the cube, seeing
+		// the part of it within a quarter of its side.
+		float half = 0.5f * scene.side;
+		glm::vec3 eye(half, half, -1.0f);
+		glm::mat4 VP = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 0.25f * scene.side) *
+			glm::lookAt(eye, glm::vec3(half), glm::vec3(0.0f, 1.0f, 0.0f));
+
+		float planes[24];
+		frustumPlanes(glm::value_ptr(VP), planes);
+
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "n%zu_", size);
+		std::string series(prefix);
+
+		InstanceBvh bvh;
+
+		double build = 0.0;
+		for (int i = 0; i < kBuildIterations; ++i) {
+			double start = Benchmark::now();
+			bvh.build(scene.view(), size);
+			double elapsed = milliseconds(start);
+
+			report.record(series + "build_ms", elapsed);
+			build += elapsed / kBuildIterations;
+		}
+
+		fprintf(stderr, "%8zu spheres, %zu nodes\n", size, bvh.nodeCount());
+		fprintf(stderr, "  build            %10.3f ms\n", build);
+
+		if (!check(bvh, scene, planes))
+			status = 1;
+
+		Random motion(3);
+		double refit = 0.0, refitSerial = 0.0;
+		for (int i = 0; i < kIterations; ++i) {
+			scene.move(motion);
+
+			double start = Benchmark::now();
+			bvh.refit(serial, scene.view());
+			double elapsed = milliseconds(start);
+			report.record(series + "refit_serial_ms", elapsed);
+			refitSerial += elapsed / kIterations;
+
+			start = Benchmark::now();
+			bvh.refit(jobs, scene.view());
+			elapsed = milliseconds(start);
+			report.record(series + "refit_ms", elapsed);
+			refit += elapsed / kIterations;
+		}
+
+		fprintf(stderr, "  refit            %10.3f ms (1 thread)\n", refitSerial);
+		fprintf(stderr, "  refit            %10.3f ms (%d threads)\n", refit, jobs.threadCount());
+
+		// The tree is now refit, not rebuilt, for the spheres' new places.
+		if (!check(bvh, scene, planes))
+			status = 1;
+
+		std::vector<unsigned int> visible, flat(size);
+		visible.reserve(size);
+
+		double cull = 0.0, cullFlat = 0.0;
+		size_t visibleCount = 0;
+		for (int i = 0; i < kIterations; ++i) {
+			visible.clear();
+
+			double start = Benchmark::now();
+			visibleCount = bvh.cullFrustum(planes, visible);
+			double elapsed = milliseconds(start);
+			report.record(series + "cull_ms", elapsed);
+			cull += elapsed / kIterations;
+
+			start = Benchmark::now();
+			cullSpheres(scene.view(), planes, 0, size, &flat[0]);
+			elapsed = milliseconds(start);
+			report.record(series + "cull_flat_ms", elapsed);
+			cullFlat += elapsed / kIterations;
+		}
+
+		fprintf(stderr, "  frustum (%4.1f%%)  %10.3f ms, every sphere %s %.3f ms\n",
+				100.0 * visibleCount / size, cull, transformKernelName(bestTransformKernel()), cullFlat);
+
+		Random rays(5);
+		double start = Benchmark::now();
+		int hits = 0;
+		for (int i = 0; i < kRayCount; ++i) {
+			float origin[3] = { eye.x, eye.y, eye.z };
+			float direction[3] = { rays.next(-0.5f, 0.5f), rays.next(-0.5f, 0.5f), 1.0f };
+			hits += bvh.raycast(origin, direction) >= 0;
+		}
+		double ray = milliseconds(start) * 1000.0 / kRayCount;
+		report.record(series + "raycast_us", ray);
+
+		Random points(9);
+		std::vector<unsigned int> found;
+		start = Benchmark::now();
+		for (int i = 0; i < kPointCount; ++i) {
+			float point[3] = { points.next(0.0f, scene.side), points.next(0.0f, scene.side),
+				points.next(0.0f, scene.side) };
+			found.clear();
+			bvh.queryPoint(point, found);
+		}
+		double point = milliseconds(start) * 1000.0 / kPointCount;
+		report.record(series + "point_us", point);
+
+		fprintf(stderr, "  raycast          %10.3f us (%d of %d hit)\n", ray, hits, kRayCount);
+		fprintf(stderr, "  point            %10.3f us\n", point);
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return status;
+	}
+
+	return report.writeJSON(output) ? status : 1;
+}
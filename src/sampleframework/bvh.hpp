@@ -0,0 +1,89 @@
+#ifndef BVH_H_
+#define BVH_H_
+
+#include <cstddef>
+
+#include <vector>
+
+#include "frustumcull.hpp"
+#include "jobsystem.hpp"
+
+// One node of InstanceBvh, two to a cache line. Nodes are stored depth
+// first: an inner node's left child directly follows it and first is the
+// index of its right child; a leaf holds the count instances starting at
+// first in the BVH's instance order.
+struct BvhNode
+{
+	float min[3];
+	unsigned int first;
+	float max[3];
+	unsigned int count;
+
+	bool leaf() const { return count != 0; }
+};
+
+// Bounding volume hierarchy over per-instance bounding spheres, for culling
+// and picking when testing every instance no longer scales.
+//
+// build() splits with a binned surface area heuristic. refit() keeps the
+// tree and only recomputes the boxes after the spheres moved, the subtrees
+// below the top few levels in parallel; the tree gets worse the further the
+// instances travel from where it was built, so rebuild after large changes.
+//
+// The leaves keep a copy of their spheres in BVH order, so the queries read
+// them sequentially; build() and refit() update it.
+class InstanceBvh
+{
+public:
+	// Instances per leaf at most, and bins per axis tried by build().
+	static const unsigned int kMaxLeafSize = 4;
+	static const int kBinCount = 16;
+
+	InstanceBvh();
+
+	void build(const BoundingSpheres& spheres, size_t count);
+	void refit(JobSystem& jobs, const BoundingSpheres& spheres);
+
+	// Appends the instances whose spheres touch the frustum of planes (see
+	// frustumPlanes()) to visible, in BVH order, and returns how many; the
+	// set is the one cullSpheres() keeps. Subtrees entirely inside the
+	// frustum are taken without testing their spheres.
+	size_t cullFrustum(const float* planes, std::vector<unsigned int>& visible) const;
+
+	// The instance whose sphere the ray from origin along direction enters
+	// first, and the ray parameter where it does (zero when origin is inside
+	// it), or -1 when the ray hits nothing.
+	int raycast(const float* origin, const float* direction, float* distance = nullptr) const;
+
+	// Appends the instances whose spheres contain point to hits and returns
+	// how many.
+	size_t queryPoint(const float* point, std::vector<unsigned int>& hits) const;
+
+	size_t instanceCount() const { return _instances.size(); }
+	size_t nodeCount() const { return _nodes.size(); }
+	const BvhNode& root() const { return _nodes[0]; }
+
+private:
+	struct RefitTask
+	{
+		unsigned int begin, end;
+	};
+
+	void refitNode(unsigned int index);
+	void planRefit();
+
+	std::vector<BvhNode> _nodes;
+
+	// Instance indices and their spheres (x, y, z, radius) in BVH order,
+	// and where in that order every instance is.
+	std::vector<unsigned int> _instances;
+	std::vector<float> _spheres;
+	std::vector<unsigned int> _slots;
+
+	// Disjoint subtrees refit in parallel, as node ranges, and the nodes
+	// above them, refit afterwards in decreasing order.
+	std::vector<RefitTask> _refitTasks;
+	std::vector<unsigned int> _refitTop;
+};
+
+#endif // BVH_H_
@@ -0,0 +1,158 @@
+// Culls 1M bounding spheres against frusta that keep 0% to 100% of them,
+// with every kernel single threaded and with FrustumCuller on all
+// hardware threads. Every kernel's visible list is checked against the
+// scalar one.
+//
+//	frustumcull-bench [report.json|-]
+
+#include "benchmark.hpp"
+#include "frustumcull.hpp"
+#include "jobsystem.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+static const size_t kInstanceCount = 1000000;
+static const int kWarmupIterations = 3;
+static const int kIterations = 20;
+
+struct Spheres
+{
+	std::vector<float> x, y, z, radius;
+
+	// Uniformly spread over [-1, 1]^3 in a fixed, shuffled order, so the
+	// visible ones are scattered rather than one contiguous run.
+	explicit Spheres(size_t count)
+		: x(count), y(count), z(count), radius(count)
+	{
+		unsigned int state = 1;
+		for (size_t i = 0; i < count; ++i) {
+			float* values[3] = { &x[i], &y[i], &z[i] };
+			for (float* value : values) {
+				state = state * 1664525u + 1013904223u;
+				*value = (float)(state >> 8) / 8388608.0f - 1.0f;
+			}
+
+			radius[i] = 0.001f;
+		}
+	}
+
+	BoundingSpheres view() const
+	{
+		BoundingSpheres view = { &x[0], &y[0], &z[0], &radius[0] };
+		return view;
+	}
+};
+
+// An orthographic frustum over x in [-1, -1 + 2 * fraction] and the whole
+// y and z range, which contains about fraction of the spheres.
+static glm::mat4 fractionFrustum(float fraction)
+{
+	if (fraction <= 0.0f)
+		return glm::ortho(-3.0f, -2.0f, -1.0f, 1.0f, -1.0f, 1.0f);
+
+	return glm::ortho(-1.0f, -1.0f + 2.0f * fraction, -1.0f, 1.0f, -1.0f, 1.0f);
+}
+
+template <class Cull>
+static double measure(Benchmark& report, const std::string& series, Cull cull)
+{
+	for (int i = 0; i < kWarmupIterations; ++i)
+		cull();
+
+	double total = 0.0;
+	for (int i = 0; i < kIterations; ++i) {
+		double start = Benchmark::now();
+		cull();
+		double elapsed = (Benchmark::now() - start) * 1000.0;
+
+		report.record(series, elapsed);
+		total += elapsed;
+	}
+
+	return total / kIterations;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	const float fractions[] = { 0.0f, 0.01f, 0.1f, 0.5f, 0.9f, 1.0f };
+	const TransformKernel kernels[] = {
+		TRANSFORM_KERNEL_SCALAR, TRANSFORM_KERNEL_SSE41, TRANSFORM_KERNEL_AVX2
+	};
+
+	Spheres spheres(kInstanceCount);
+	BoundingSpheres view = spheres.view();
+
+	JobSystem jobs;
+
+	Benchmark report;
+	report.setProperty("benchmark", "frustumcull");
+	report.setProperty("instances", (double)kInstanceCount);
+	report.setProperty("job_threads", jobs.threadCount());
+	report.setProperty("best_kernel", transformKernelName(bestTransformKernel()));
+
+	std::vector<unsigned int> reference(kInstanceCount), visible(kInstanceCount);
+
+	int status = 0;
+
+	for (float fraction : fractions) {
+		glm::mat4 VP = fractionFrustum(fraction);
+
+		float planes[24];
+		frustumPlanes(glm::value_ptr(VP), planes);
+
+		size_t expected = cullSpheres(view, planes, 0, kInstanceCount, &reference[0],
+				TRANSFORM_KERNEL_SCALAR);
+
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "f%g_", fraction);
+
+		fprintf(stderr, "visible %5.1f%% (%zu)\n", 100.0 * expected / kInstanceCount, expected);
+
+		for (TransformKernel kernel : kernels) {
+			if (!transformKernelSupported(kernel))
+				continue;
+
+			size_t count = 0;
+			double time = measure(report, prefix + std::string(transformKernelName(kernel)) + "_ms", [&]() {
+				count = cullSpheres(view, planes, 0, kInstanceCount, &visible[0], kernel);
+			});
+
+			if (count != expected || memcmp(&visible[0], &reference[0], count * sizeof(unsigned int)) != 0) {
+				fprintf(stderr, "Error: %s keeps different spheres than scalar\n", transformKernelName(kernel));
+				status = 1;
+			}
+
+			fprintf(stderr, "  %-10s %8.3f ms\n", transformKernelName(kernel), time);
+		}
+
+		FrustumCuller culler;
+		double time = measure(report, prefix + std::string("parallel_ms"), [&]() {
+			culler.cull(jobs, view, kInstanceCount, glm::value_ptr(VP));
+		});
+
+		if (culler.visibleCount() != expected) {
+			fprintf(stderr, "Error: FrustumCuller keeps %zu spheres, not %zu\n", culler.visibleCount(), expected);
+			status = 1;
+		}
+
+		fprintf(stderr, "  %-10s %8.3f ms (%d threads)\n", "parallel", time, jobs.threadCount());
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return status;
+	}
+
+	return report.writeJSON(output) ? status : 1;
+}
@@ -0,0 +1,192 @@
+#ifndef GEOMETRYPOOL_H_
+#define GEOMETRYPOOL_H_
+
+#include <cstddef>
+
+#include <string>
+#include <vector>
+
+#include "vertexlayout.hpp"
+
+// Where one mesh sits in a GeometryPool: its indices start at firstIndex
+// of the index buffer and count from baseVertex of the vertex buffer.
+struct PoolMesh
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	int baseVertex;
+	unsigned int vertexCount;
+};
+
+// The vertices and 32-bit indices of many meshes packed into one vertex
+// buffer and one index buffer, so any mix of them draws from a single
+// vertex array without rebinding anything between meshes. Every mesh uses
+// the same VertexLayout, which bindVertexArray() points the attributes at
+// and whose vertexShaderSource() the program is built with.
+class GeometryPool
+{
+public:
+	GeometryPool();
+
+	// Every vertex is in layout.
+	void init(const VertexLayout& layout);
+	void destroy();
+
+	// Copies a mesh whose indices count from its own first vertex and
+	// returns its id; only before upload().
+	int addMesh(const void* vertices, size_t vertexCount,
+			const unsigned int* indices, size_t indexCount);
+
+	// Like addMesh() without the copy: upload() reads the mesh straight
+	// from vertices and indices, which must stay valid until then. For a
+	// mapped MeshFile that is the file's own pages.
+	int addMeshView(const void* vertices, size_t vertexCount,
+			const unsigned int* indices, size_t indexCount);
+
+	// Creates both buffers, fills them mesh by mesh and drops the copies.
+	// Needs a current context.
+	void upload();
+
+	// Attaches the index buffer to the bound vertex array and points and
+	// enables its attributes as the layout says.
+	void bindVertexArray() const;
+
+	// Sets the dequantization uniforms of a program built with the
+	// layout's vertexShaderSource().
+	void bindProgram(unsigned int program) const;
+
+	const VertexLayout& layout() const { return _layout; }
+
+	const PoolMesh& mesh(int id) const { return _meshes[id]; }
+	int meshCount() const { return (int)_meshes.size(); }
+
+	size_t vertexStride() const { return _vertexStride; }
+	size_t vertexBytes() const { return _vertexBytes; }
+	size_t indexBytes() const { return _indexBytes; }
+
+private:
+	// Where upload() takes a mesh from, and the copies addMesh() made.
+	struct Source
+	{
+		const void* vertices;
+		const unsigned int* indices;
+	};
+
+	VertexLayout _layout;
+	size_t _vertexStride;
+
+	std::vector<Source> _sources;
+	std::vector<std::vector<unsigned char>> _vertexCopies;
+	std::vector<std::vector<unsigned int>> _indexCopies;
+	std::vector<PoolMesh> _meshes;
+
+	size_t _vertexBytes;
+	size_t _indexBytes;
+
+	unsigned int _vertexBuffer;
+	unsigned int _indexBuffer;
+};
+
+// How a DrawBatch reaches the GPU.
+enum DrawSubmission
+{
+	// One glDrawElementsInstancedBaseVertexBaseInstance per draw (GL 4.2 or
+	// GL_ARB_base_instance).
+	DRAW_SUBMISSION_DIRECT,
+	// All draws in one glMultiDrawElementsIndirect (GL 4.3 or
+	// GL_ARB_multi_draw_indirect).
+	DRAW_SUBMISSION_MULTI_INDIRECT,
+};
+
+bool drawSubmissionSupported(DrawSubmission submission);
+const char* drawSubmissionName(DrawSubmission submission);
+bool parseDrawSubmission(const char* name, DrawSubmission* submission);
+
+// Instanced draws of GeometryPool meshes, submitted together. Draw d
+// covers the instances [baseInstance, baseInstance + instanceCount) given
+// to add(), which must not overlap between draws.
+//
+// vertexShaderSource() defines DRAW_BATCH plus DRAW_INSTANCE, the instance
+// a vertex belongs to counted across the whole batch, and DRAW_ID, the
+// draw. With GL_ARB_shader_draw_parameters they are gl_BaseInstanceARB +
+// gl_InstanceID and gl_DrawIDARB, or a uniform set per draw when the draws
+// are separate; without, an instanced attribute holding (instance, draw)
+// for every instance stands in, as vertex attribute fetch is the one place
+// base instance reaches the shader then.
+class DrawBatch
+{
+public:
+	static const int kDrawAttribute = 6;
+
+	DrawBatch();
+
+	// Needs a current context.
+	bool init(DrawSubmission submission);
+	void destroy();
+
+	DrawSubmission submission() const { return _submission; }
+	bool drawParameters() const { return _drawParameters; }
+
+	// For LoadShaders(), ahead of any other header so its #extension
+	// comes before the first declaration.
+	const char* vertexShaderSource() const { return _vertexSource.c_str(); }
+
+	// Connects a program linked from vertexShaderSource() to the batch.
+	void bindProgram(unsigned int program);
+
+	// Points kDrawAttribute of the bound vertex array at the per-instance
+	// (instance, draw) pairs; does nothing with draw parameters.
+	void bindVertexArray();
+
+	void clear();
+	void add(const PoolMesh& mesh, unsigned int instanceCount, unsigned int baseInstance);
+
+	// Writes the draws added since clear() to the GPU.
+	void upload();
+
+	// Draws up to maxDraws DrawElementsIndirectCommands a shader wrote to
+	// commandBuffer instead of those added, as many as the uint at the
+	// start of countBuffer says with GL_ARB_indirect_parameters, or all of
+	// them without, when the unused ones have to be empty. Multi-draw
+	// indirect submission with draw parameters only; a commandBuffer of 0
+	// goes back to the draws added. Their order says nothing, so DRAW_ID is
+	// 0 for all of them: call before taking vertexShaderSource().
+	void setGeneratedDraws(unsigned int commandBuffer, unsigned int countBuffer, size_t maxDraws);
+
+	// The caller binds the program and a vertex array set up with the
+	// pool's bindVertexArray() and this one's; draw() only sets the
+	// program's drawIndex.
+	void draw(unsigned int mode) const;
+
+	size_t drawCount() const { return _commands.size(); }
+
+	// GL draw calls one draw() makes.
+	size_t callCount() const;
+
+private:
+	// DrawElementsIndirectCommand.
+	struct Command
+	{
+		unsigned int count;
+		unsigned int instanceCount;
+		unsigned int firstIndex;
+		int baseVertex;
+		unsigned int baseInstance;
+	};
+
+	DrawSubmission _submission;
+	bool _drawParameters;
+	std::string _vertexSource;
+	int _drawIndexLocation;
+
+	std::vector<Command> _commands;
+
+	unsigned int _commandBuffer;
+	unsigned int _drawBuffer;
+
+	unsigned int _generatedCommands;
+	unsigned int _generatedCount;
+	size_t _generatedMax;
+};
+
+#endif // GEOMETRYPOOL_H_
@@ -0,0 +1,174 @@
+#include "gpuprofiler.hpp"
+
+#include <cstdio>
+
+#include <GL/glew.h>
+
+GpuProfiler::GpuProfiler()
+	: _supported(false), _enabled(false), _recording(false),
+	_currentFrame(0), _droppedFrames(0)
+{
+	for (int i = 0; i < kFrameLatency; ++i) {
+		_frames[i].usedQueries = 0;
+		_frames[i].pending = false;
+	}
+}
+
+GpuProfiler::~GpuProfiler()
+{
+}
+
+bool GpuProfiler::init()
+{
+	_supported = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+
+	if (_supported) {
+		GLint counterBits = 0;
+		glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counterBits);
+		_supported = counterBits > 0;
+	}
+
+	if (!_supported) {
+		fprintf(stderr, "GPU profiler: timestamp queries are not supported\n");
+		_enabled = false;
+	}
+
+	return _supported;
+}
+
+void GpuProfiler::destroy()
+{
+	for (int i = 0; i < kFrameLatency; ++i) {
+		Frame& frame = _frames[i];
+		if (!frame.queries.empty())
+			glDeleteQueries((GLsizei)frame.queries.size(), &frame.queries[0]);
+
+		frame.queries.clear();
+		frame.zones.clear();
+		frame.usedQueries = 0;
+		frame.pending = false;
+	}
+
+	_openZones.clear();
+	_recording = false;
+}
+
+bool GpuProfiler::beginFrame()
+{
+	if (!_enabled)
+		return false;
+
+	// Starting at the slot about to be reused walks the ring oldest first;
+	// queries complete in submission order, so stop at the first busy one.
+	bool updated = false;
+	for (int i = 0; i < kFrameLatency; ++i) {
+		Frame& frame = _frames[(_currentFrame + i) % kFrameLatency];
+		if (!frame.pending)
+			continue;
+
+		if (!resolve(frame))
+			break;
+
+		updated = true;
+	}
+
+	Frame& frame = _frames[_currentFrame];
+	if (frame.pending) {
+		++_droppedFrames;
+		frame.pending = false;
+	}
+
+	frame.zones.clear();
+	frame.usedQueries = 0;
+
+	_recording = true;
+
+	return updated;
+}
+
+void GpuProfiler::endFrame()
+{
+	if (!_recording)
+		return;
+
+	while (!_openZones.empty())
+		endZone();
+
+	Frame& frame = _frames[_currentFrame];
+	frame.pending = !frame.zones.empty();
+
+	_currentFrame = (_currentFrame + 1) % kFrameLatency;
+	_recording = false;
+}
+
+void GpuProfiler::beginZone(const char* name)
+{
+	if (!_recording)
+		return;
+
+	Frame& frame = _frames[_currentFrame];
+
+	Zone zone;
+	zone.name = name;
+	zone.depth = (int)_openZones.size();
+	zone.beginQuery = allocateQuery(frame);
+	zone.endQuery = 0;
+
+	glQueryCounter(zone.beginQuery, GL_TIMESTAMP);
+
+	_openZones.push_back((int)frame.zones.size());
+	frame.zones.push_back(zone);
+}
+
+void GpuProfiler::endZone()
+{
+	if (!_recording || _openZones.empty())
+		return;
+
+	Frame& frame = _frames[_currentFrame];
+
+	Zone& zone = frame.zones[_openZones.back()];
+	_openZones.pop_back();
+
+	zone.endQuery = allocateQuery(frame);
+	glQueryCounter(zone.endQuery, GL_TIMESTAMP);
+}
+
+GLuint GpuProfiler::allocateQuery(Frame& frame)
+{
+	if (frame.usedQueries == frame.queries.size()) {
+		GLuint query = 0;
+		glGenQueries(1, &query);
+		frame.queries.push_back(query);
+	}
+
+	return frame.queries[frame.usedQueries++];
+}
+
+bool GpuProfiler::resolve(Frame& frame)
+{
+	GLint available = GL_FALSE;
+	glGetQueryObjectiv(frame.queries[frame.usedQueries - 1],
+			GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+		return false;
+
+	_timings.clear();
+
+	for (const Zone& zone : frame.zones) {
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(zone.beginQuery, GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(zone.endQuery, GL_QUERY_RESULT, &end);
+
+		GpuTiming timing;
+		timing.name = zone.name;
+		timing.depth = zone.depth;
+		timing.milliseconds = end > begin ? (end - begin) / 1.0e6 : 0.0;
+
+		_timings.push_back(timing);
+	}
+
+	frame.pending = false;
+
+	return true;
+}
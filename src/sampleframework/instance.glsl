@@ -0,0 +1,117 @@
+// What content.vert and instancing.vert share: an instance's transform and
+// animation, and which instance is being drawn. #include it after the
+// headers InstanceData, DrawBatch and GpuCuller prepend (see
+// shaderpreprocessor.hpp).
+
+// InstanceData (instancedata.cpp) prepends the INSTANCE_* defines and
+// instanceTexel(), which reads texel n of an instance's transform in the
+// layout picked by INSTANCE_ENCODING_* (see instanceencoding.hpp).
+#if defined(INSTANCE_ENCODING_AFFINE)
+
+vec3 instanceToWorld(int instance, vec3 position)
+{
+	vec4 p = vec4(position, 1.0);
+
+	return vec3(
+			dot(instanceTexel(instance, 0), p),
+			dot(instanceTexel(instance, 1), p),
+			dot(instanceTexel(instance, 2), p));
+}
+
+#elif defined(INSTANCE_ENCODING_QUAT) || defined(INSTANCE_ENCODING_HALF)
+
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+#if defined(INSTANCE_ENCODING_QUAT)
+
+vec3 instanceToWorld(int instance, vec3 position)
+{
+	vec4 q = instanceTexel(instance, 0);
+	vec4 translationScale = instanceTexel(instance, 1);
+
+	return rotate(q, position * translationScale.w) + translationScale.xyz;
+}
+
+#else
+
+#if __VERSION__ >= 420
+#define unpackHalf unpackHalf2x16
+#else
+// Normal halves only, which is all the encoder produces.
+vec2 unpackHalf(uint value)
+{
+	uvec2 h = uvec2(value & 0xffffu, value >> 16);
+	uvec2 bits = ((h & 0x8000u) << 16) | (((h >> 10) & 0x1fu) + 112u) << 23 | (h & 0x3ffu) << 13;
+
+	return mix(uintBitsToFloat(bits), vec2(0.0), equal(h & 0x7fffu, uvec2(0u)));
+}
+#endif
+
+vec3 instanceToWorld(int instance, vec3 position)
+{
+	uvec2 t0 = instanceTexel(instance, 0);
+	uvec2 t1 = instanceTexel(instance, 1);
+	uvec2 t2 = instanceTexel(instance, 2);
+
+	vec3 translation = uintBitsToFloat(uvec3(t0, t1.x));
+	vec4 q = vec4(unpackHalf(t1.y), unpackHalf(t2.x));
+	float scale = unpackHalf(t2.y).x;
+
+	return rotate(q, position * scale) + translation;
+}
+
+#endif
+
+#else
+
+vec3 instanceToWorld(int instance, vec3 position)
+{
+	mat4 M = mat4(
+			instanceTexel(instance, 0),
+			instanceTexel(instance, 1),
+			instanceTexel(instance, 2),
+			instanceTexel(instance, 3));
+
+	return (M * vec4(position, 1.0)).xyz;
+}
+
+#endif
+
+#if defined(INSTANCE_ANIMATION_GPU)
+
+// Rotation about +Y by phase + speed * instanceTime, applied before the
+// static base transform; the CPU path bakes it into the transform instead.
+vec3 animate(int instance, vec3 position)
+{
+	vec2 spin = instanceSpin(instance);
+	float angle = spin.x + spin.y * instanceTime;
+	float s = sin(angle);
+	float c = cos(angle);
+
+	return vec3(c * position.x + s * position.z, position.y, c * position.z - s * position.x);
+}
+
+#else
+
+vec3 animate(int instance, vec3 position)
+{
+	return position;
+}
+
+#endif
+
+int drawnInstance()
+{
+#if defined(INSTANCE_CULLING)
+	// GpuCuller (culling.cpp) only draws the visible instances.
+	return int(visibleInstance);
+#elif defined(DRAW_BATCH)
+	// DrawBatch (geometrypool.cpp) gives every draw its own instances.
+	return DRAW_INSTANCE;
+#else
+	return gl_InstanceID;
+#endif
+}
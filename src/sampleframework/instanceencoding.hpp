@@ -0,0 +1,44 @@
+#ifndef INSTANCEENCODING_H_
+#define INSTANCEENCODING_H_
+
+#include <cstddef>
+
+#include "transformkernel.hpp"
+
+// Layouts of the per-instance transform in the Ms texture buffer. The
+// vertex shaders decode the one named by instanceEncodingDefine(), so the
+// choice is fixed when the program is compiled.
+enum InstanceEncoding
+{
+	// Column-major mat4, four RGBA32F texels (64 bytes).
+	INSTANCE_ENCODING_MAT4,
+	// The three rows of the affine 3x4 part, three RGBA32F texels (48 bytes).
+	INSTANCE_ENCODING_AFFINE,
+	// Rotation quaternion, then translation and uniform scale, two RGBA32F
+	// texels (32 bytes).
+	INSTANCE_ENCODING_QUAT,
+	// Float translation followed by the quaternion and scale as half
+	// floats, three RG32UI texels (24 bytes). Translation stays full
+	// precision since halves lose whole units past 1024.
+	INSTANCE_ENCODING_HALF,
+};
+
+const char* instanceEncodingName(InstanceEncoding encoding);
+bool parseInstanceEncoding(const char* name, InstanceEncoding* encoding);
+
+// Bytes per instance and texel count per instance.
+size_t instanceEncodingStride(InstanceEncoding encoding);
+int instanceEncodingTexels(InstanceEncoding encoding);
+
+// Internal format of the texture buffer holding the encoded instances.
+unsigned int instanceEncodingFormat(InstanceEncoding encoding);
+
+// Shader source defining INSTANCE_ENCODING_<NAME>, for LoadShaders().
+const char* instanceEncodingDefine(InstanceEncoding encoding);
+
+// Encodes instances [begin, end) with the rotation about +Y offset by
+// angle, instance i at out + instanceEncodingStride() * i.
+void encodeInstances(InstanceEncoding encoding, const InstanceTransforms& instances,
+		float angle, size_t begin, size_t end, void* out);
+
+#endif // INSTANCEENCODING_H_
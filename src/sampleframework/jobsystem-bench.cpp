@@ -0,0 +1,90 @@
+// Scaling curve of JobSystem::parallelFor on the instance transform loop of
+// the instancing samples: every instance count is timed with one thread up
+// to every hardware thread.
+//
+//	jobsystem-bench [report.json|-]
+
+#include "benchmark.hpp"
+#include "jobsystem.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+static const int kWarmupIterations = 3;
+static const int kIterations = 20;
+static const size_t kGrainSize = 4096;
+
+static void buildTransforms(JobSystem& jobs, std::vector<glm::mat4>& transforms, float time)
+{
+	jobs.parallelFor(transforms.size(), kGrainSize, [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			auto T = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, (float)i, 0.0f));
+			auto R = glm::rotate(glm::mat4(1.0f), time, glm::vec3(0.0f, 1.0f, 0.0f));
+			auto S = glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, 1.0f, 1.0f));
+
+			transforms[i] = T * R * S;
+		}
+	});
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	const size_t counts[] = { 1000, 100000, 1000000 };
+
+	int maxThreads = (int)std::thread::hardware_concurrency();
+	if (maxThreads < 1)
+		maxThreads = 1;
+
+	Benchmark report;
+	report.setProperty("benchmark", "jobsystem");
+	report.setProperty("grain_size", (double)kGrainSize);
+	report.setProperty("hardware_threads", maxThreads);
+
+	for (size_t count : counts) {
+		std::vector<glm::mat4> transforms(count);
+		double singleThreaded = 0.0;
+
+		for (int threads = 1; threads <= maxThreads; ++threads) {
+			JobSystem jobs(threads - 1);
+
+			std::string series = "n" + std::to_string(count) +
+				"_t" + std::to_string(threads) + "_ms";
+
+			for (int i = 0; i < kWarmupIterations; ++i)
+				buildTransforms(jobs, transforms, (float)i);
+
+			double total = 0.0;
+			for (int i = 0; i < kIterations; ++i) {
+				double start = Benchmark::now();
+				buildTransforms(jobs, transforms, (float)i);
+				double elapsed = (Benchmark::now() - start) * 1000.0;
+
+				report.record(series, elapsed);
+				total += elapsed;
+			}
+
+			double mean = total / kIterations;
+			if (threads == 1)
+				singleThreaded = mean;
+
+			fprintf(stderr, "%8zu instances, %2d threads: %8.3f ms (%.2fx)\n",
+					count, threads, mean, singleThreaded / mean);
+		}
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return 0;
+	}
+
+	return report.writeJSON(output) ? 0 : 1;
+}
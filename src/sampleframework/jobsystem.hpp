@@ -0,0 +1,72 @@
+#ifndef JOBSYSTEM_H_
+#define JOBSYSTEM_H_
+
+#include <cstddef>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing scheduler for data-parallel loops.
+//
+// Every worker owns a deque of index ranges. A worker pops from the back
+// of its own deque and, before running a range larger than the grain size,
+// splits it and pushes the upper half back, so idle workers that steal from
+// the front of someone else's deque always take the biggest pieces left.
+// The thread calling parallelFor() takes part as well.
+class JobSystem
+{
+public:
+	typedef std::function<void(size_t begin, size_t end)> RangeFunction;
+
+	// workerCount threads are started in addition to the caller;
+	// a negative count uses one per hardware thread beyond the caller.
+	explicit JobSystem(int workerCount = -1);
+	~JobSystem();
+
+	// Workers plus the calling thread.
+	int threadCount() const { return (int)_workers.size() + 1; }
+
+	// Calls body on disjoint subranges of [0, count), none larger than
+	// grainSize, and returns once all of them have completed.
+	void parallelFor(size_t count, size_t grainSize, const RangeFunction& body);
+
+private:
+	struct Task
+	{
+		const RangeFunction* body;
+		size_t begin, end;
+		size_t grainSize;
+		std::atomic<size_t>* remaining;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	void workerMain(int index);
+
+	void push(int queue, const Task& task);
+	bool pop(int queue, Task& task);
+	bool steal(int thief, Task& task);
+	bool findTask(int queue, Task& task);
+	void execute(int queue, Task task);
+
+	std::vector<std::thread> _workers;
+
+	// Slot 0 belongs to threads calling parallelFor(), the rest to workers.
+	std::vector<Queue*> _queues;
+
+	std::mutex _sleepMutex;
+	std::condition_variable _wakeUp;
+	std::atomic<int> _queuedTasks;
+	bool _stopping;
+};
+
+#endif // JOBSYSTEM_H_
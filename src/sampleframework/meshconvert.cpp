@@ -0,0 +1,115 @@
+// Converts OBJ and glTF meshes to the .mesh format the samples map at
+// startup (see meshfile.hpp). Every input after the first is one more
+// level of detail, used from the --distance given in front of it;
+// --normalize fits the mesh into the unit sphere like the samples'
+// triangle, --optimize runs optimizeMesh() on every level and prints its
+// vertex cache and fetch numbers before and after, and --quantize stores
+// the vertices in VERTEX_FORMAT_QUANTIZED. Every level is split into
+// meshlets last, in the final triangle order.
+//
+//	meshconvert [--normalize] [--optimize] [--quantize] -o out.mesh lod0.obj [--distance <d> lod1.obj ...]
+
+#include "meshfile.hpp"
+#include "meshimport.hpp"
+#include "meshlet.hpp"
+#include "meshoptimize.hpp"
+#include "vertexlayout.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <vector>
+
+static int usage()
+{
+	fprintf(stderr, "usage: meshconvert [--normalize] [--optimize] [--quantize] -o out.mesh lod0.obj|gltf|glb "
+			"[--distance <d> lod1.obj|gltf|glb ...]\n");
+	return 1;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = nullptr;
+	bool normalize = false;
+	bool optimize = false;
+	VertexFormat format = VERTEX_FORMAT_FLOAT;
+	float distance = 0.0f;
+
+	MeshData mesh;
+	bool first = true;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--normalize") == 0) {
+			normalize = true;
+		}
+		else if (strcmp(argv[i], "--optimize") == 0) {
+			optimize = true;
+		}
+		else if (strcmp(argv[i], "--quantize") == 0) {
+			format = VERTEX_FORMAT_QUANTIZED;
+		}
+		else if (strcmp(argv[i], "--distance") == 0 && i + 1 < argc) {
+			distance = (float)atof(argv[++i]);
+		}
+		else if (argv[i][0] == '-') {
+			return usage();
+		}
+		else {
+			MeshData level;
+			if (!loadMesh(argv[i], &level))
+				return 1;
+
+			if (first) {
+				mesh.attributes = level.attributes;
+				mesh.lods.clear();
+			}
+
+			if (!appendMeshLod(&mesh, level, first ? 0.0f : distance))
+				return 1;
+
+			fprintf(stderr, "%s: %zu vertices, %zu triangles\n", argv[i],
+					level.vertexCount(), level.indices.size() / 3);
+			first = false;
+		}
+	}
+
+	if (!output || first)
+		return usage();
+
+	// All levels together, so they keep their relative size.
+	if (normalize)
+		normalizeMesh(&mesh);
+
+	if (optimize) {
+		std::vector<MeshStats> before;
+		for (size_t level = 0; level < mesh.lods.size(); ++level)
+			before.push_back(analyzeMesh(mesh, (int)level));
+
+		optimizeMesh(&mesh);
+
+		size_t stride = meshVertexStride(mesh.attributes);
+		for (size_t level = 0; level < mesh.lods.size(); ++level) {
+			MeshStats after = analyzeMesh(mesh, (int)level);
+			fprintf(stderr, "level %zu: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %zu -> %zu transformed, "
+					"overfetch %.2f -> %.2f, %zu -> %zu vertices\n", level,
+					before[level].acmr(), after.acmr(), before[level].atvr(), after.atvr(),
+					before[level].transformed, after.transformed,
+					before[level].overfetch(stride), after.overfetch(stride),
+					before[level].vertices, after.vertices);
+		}
+	}
+
+	buildMeshlets(&mesh);
+
+	if (!writeMeshFile(output, mesh, format))
+		return 1;
+
+	fprintf(stderr, "%s: %zu levels of detail, %zu meshlets, %s vertices, %u bytes each\n", output,
+			mesh.lods.size(), mesh.meshlets.size(), vertexFormatName(format),
+			vertexLayoutStride(mesh.attributes, format));
+	return 0;
+}
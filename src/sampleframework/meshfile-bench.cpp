@@ -0,0 +1,250 @@
+// Load time of a mesh as text OBJ against the mapped .mesh format, for
+// grids of 16K to 1M vertices with normals and texture coordinates. Both
+// are timed until the vertices and indices are in memory the way
+// glBufferData() takes them: loadObj() reads and parses the text, the
+// .mesh side opens the file and copies its streams out once, as the
+// driver would. Warm runs read from the page cache; on Linux the cold
+// runs evict the file first. Every size checks that both give the same
+// mesh.
+//
+//	meshfile-bench [report.json|-]
+
+#include "benchmark.hpp"
+#include "meshfile.hpp"
+#include "meshimport.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static const int kIterations = 3;
+
+static double milliseconds(double start)
+{
+	return (Benchmark::now() - start) * 1000.0;
+}
+
+// A side by side grid bent into a half cylinder, so no two vertices share
+// a position or normal.
+static void gridMesh(int side, MeshData* mesh)
+{
+	mesh->attributes = MESH_ATTRIBUTE_POSITION | MESH_ATTRIBUTE_NORMAL | MESH_ATTRIBUTE_TEXCOORD;
+	mesh->vertices.clear();
+	mesh->indices.clear();
+
+	for (int y = 0; y <= side; ++y) {
+		for (int x = 0; x <= side; ++x) {
+			float u = (float)x / side, v = (float)y / side;
+			float angle = 3.1415927f * u;
+			float vertex[8] = { -std::cos(angle), 2.0f * v - 1.0f, -std::sin(angle),
+				-std::cos(angle), 0.0f, -std::sin(angle), u, v };
+			mesh->vertices.insert(mesh->vertices.end(), vertex, vertex + 8);
+		}
+	}
+
+	for (int y = 0; y < side; ++y) {
+		for (int x = 0; x < side; ++x) {
+			uint32_t corner = (uint32_t)(y * (side + 1) + x);
+			uint32_t quad[6] = { corner, corner + 1, corner + side + 2, corner, corner + side + 2, corner + side + 1 };
+			mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+		}
+	}
+
+	MeshLod lod = { 0, (uint32_t)mesh->indices.size(), 0, (uint32_t)mesh->vertexCount(), 0.0f, 0, 0 };
+	mesh->lods.assign(1, lod);
+}
+
+// As OBJ exporters write it: every attribute its own list, and faces
+// pointing into all three with the same index.
+static bool writeObj(const char* path, const MeshData& mesh)
+{
+	FILE* file = fopen(path, "w");
+	if (!file)
+		return false;
+
+	const float* v = &mesh.vertices[0];
+	size_t count = mesh.vertexCount();
+
+	for (size_t i = 0; i < count; ++i)
+		fprintf(file, "v %.9g %.9g %.9g\n", v[8 * i], v[8 * i + 1], v[8 * i + 2]);
+	for (size_t i = 0; i < count; ++i)
+		fprintf(file, "vn %.9g %.9g %.9g\n", v[8 * i + 3], v[8 * i + 4], v[8 * i + 5]);
+	for (size_t i = 0; i < count; ++i)
+		fprintf(file, "vt %.9g %.9g\n", v[8 * i + 6], v[8 * i + 7]);
+
+	for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+		uint32_t a = mesh.indices[i] + 1, b = mesh.indices[i + 1] + 1, c = mesh.indices[i + 2] + 1;
+		fprintf(file, "f %u/%u/%u %u/%u/%u %u/%u/%u\n", a, a, a, b, b, b, c, c, c);
+	}
+
+	return fclose(file) == 0;
+}
+
+static long fileSize(const char* path)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file)
+		return 0;
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fclose(file);
+	return size;
+}
+
+// Drops the file from the page cache, so the next read goes to the disk;
+// false where that is not possible.
+static bool evict(const char* path)
+{
+#ifdef __linux__
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	fdatasync(fd);
+	bool ok = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return ok;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+// The .mesh side: map, then copy the streams out once as glBufferData()
+// does from the pointer it gets. Returns false if the file does not hold
+// expected.
+static bool loadMapped(const char* path, std::vector<unsigned char>& vertices,
+		std::vector<unsigned char>& indices, const MeshData* expected)
+{
+	MeshFile file;
+	if (!file.open(path))
+		return false;
+
+	const MeshFileHeader& header = file.header();
+	size_t vertexBytes = (size_t)header.vertexCount * header.vertexStride;
+	size_t indexBytes = sizeof(uint32_t) * header.indexCount;
+
+	vertices.resize(vertexBytes);
+	indices.resize(indexBytes);
+	memcpy(&vertices[0], file.vertices(), vertexBytes);
+	memcpy(&indices[0], file.indices(), indexBytes);
+
+	if (!expected)
+		return true;
+
+	return header.attributes == expected->attributes &&
+		vertexBytes == sizeof(float) * expected->vertices.size() &&
+		indexBytes == sizeof(uint32_t) * expected->indices.size() &&
+		memcmp(&vertices[0], &expected->vertices[0], vertexBytes) == 0 &&
+		memcmp(&indices[0], &expected->indices[0], indexBytes) == 0;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	const int sides[] = { 128, 512, 1024 };
+
+	Benchmark report;
+	report.setProperty("benchmark", "meshfile");
+	report.setProperty("stream_alignment", (double)kMeshStreamAlignment);
+
+	int status = 0;
+
+	for (int side : sides) {
+		MeshData mesh;
+		gridMesh(side, &mesh);
+
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "v%zu_", mesh.vertexCount());
+		std::string series(prefix);
+
+		std::string objPath = "meshfile-bench-" + std::to_string(side) + ".obj";
+		std::string meshPath = "meshfile-bench-" + std::to_string(side) + ".mesh";
+
+		if (!writeObj(objPath.c_str(), mesh) || !writeMeshFile(meshPath.c_str(), mesh)) {
+			fprintf(stderr, "Error: cannot write the test files\n");
+			return 1;
+		}
+
+		fprintf(stderr, "%8zu vertices, %zu triangles: OBJ %.1f MB, .mesh %.1f MB\n",
+				mesh.vertexCount(), mesh.indices.size() / 3,
+				fileSize(objPath.c_str()) / 1048576.0, fileSize(meshPath.c_str()) / 1048576.0);
+
+		// Parsing gives the grid's vertices in first use order, which for
+		// these faces is not the order written; compare the .mesh with it.
+		MeshData parsed;
+		if (!loadObj(objPath.c_str(), &parsed) || !writeMeshFile(meshPath.c_str(), parsed)) {
+			status = 1;
+			continue;
+		}
+
+		std::vector<unsigned char> vertices, indices;
+		if (!loadMapped(meshPath.c_str(), vertices, indices, &parsed)) {
+			fprintf(stderr, "Error: the .mesh file does not hold the parsed OBJ\n");
+			status = 1;
+		}
+
+		for (int cold = 0; cold < 2; ++cold) {
+			if (cold && !evict(objPath.c_str())) {
+				fprintf(stderr, "  (no cold runs: cannot evict files here)\n");
+				break;
+			}
+
+			const char* temperature = cold ? "cold" : "warm";
+			double obj = 0.0, mapped = 0.0, open = 0.0;
+
+			for (int i = 0; i < kIterations; ++i) {
+				if (cold)
+					evict(objPath.c_str());
+
+				MeshData loaded;
+				double start = Benchmark::now();
+				loadObj(objPath.c_str(), &loaded);
+				double elapsed = milliseconds(start);
+				report.record(series + "obj_" + temperature + "_ms", elapsed);
+				obj += elapsed / kIterations;
+
+				if (cold)
+					evict(meshPath.c_str());
+
+				start = Benchmark::now();
+				loadMapped(meshPath.c_str(), vertices, indices, nullptr);
+				elapsed = milliseconds(start);
+				report.record(series + "mesh_" + temperature + "_ms", elapsed);
+				mapped += elapsed / kIterations;
+
+				// Mapping and checking the header alone, which is all the
+				// sample does before handing the streams to GL.
+				start = Benchmark::now();
+				MeshFile file;
+				file.open(meshPath.c_str());
+				elapsed = milliseconds(start);
+				report.record(series + "mesh_open_" + temperature + "_ms", elapsed);
+				open += elapsed / kIterations;
+			}
+
+			fprintf(stderr, "  %s: OBJ %10.3f ms, .mesh %8.3f ms (%.0fx), open %.3f ms\n",
+					temperature, obj, mapped, obj / mapped, open);
+		}
+
+		remove(objPath.c_str());
+		remove(meshPath.c_str());
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return status;
+	}
+
+	return report.writeJSON(output) ? status : 1;
+}
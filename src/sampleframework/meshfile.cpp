@@ -0,0 +1,185 @@
+#include "meshfile.hpp"
+#include "vertexlayout.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+uint32_t meshVertexStride(uint32_t attributes)
+{
+	uint32_t floats = 0;
+	if (attributes & MESH_ATTRIBUTE_POSITION)
+		floats += 3;
+	if (attributes & MESH_ATTRIBUTE_NORMAL)
+		floats += 3;
+	if (attributes & MESH_ATTRIBUTE_TEXCOORD)
+		floats += 2;
+	if (attributes & MESH_ATTRIBUTE_TANGENT)
+		floats += 4;
+
+	return floats * sizeof(float);
+}
+
+int meshAttributeOffset(uint32_t attributes, MeshAttribute attribute)
+{
+	if (!(attributes & attribute))
+		return -1;
+
+	// The stride of the attributes in front of it.
+	return (int)meshVertexStride(attributes & (attribute - 1));
+}
+
+MeshFile::MeshFile()
+	: _data(nullptr), _size(0)
+#ifdef _WIN32
+	, _file(INVALID_HANDLE_VALUE), _mapping(nullptr)
+#endif
+{
+}
+
+MeshFile::~MeshFile()
+{
+	close();
+}
+
+// Whether count elements of size bytes from offset lie within the file.
+static bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+{
+	return offset <= fileSize && count <= (fileSize - offset) / size;
+}
+
+bool MeshFile::open(const char* path)
+{
+	close();
+
+#ifdef _WIN32
+	_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+			FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (_file == INVALID_HANDLE_VALUE) {
+		fprintf(stderr, "Error: cannot open %s\n", path);
+		return false;
+	}
+
+	LARGE_INTEGER size;
+	GetFileSizeEx(_file, &size);
+	_size = (size_t)size.QuadPart;
+
+	if (_size >= sizeof(MeshFileHeader)) {
+		_mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (_mapping)
+			_data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+#else
+	int fd = ::open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: cannot open %s\n", path);
+		return false;
+	}
+
+	struct stat status;
+	if (fstat(fd, &status) == 0)
+		_size = (size_t)status.st_size;
+
+	if (_size >= sizeof(MeshFileHeader)) {
+		void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			_data = (const unsigned char*)data;
+
+			// The streams are read once, front to back, by the driver.
+			madvise(data, _size, MADV_SEQUENTIAL);
+		}
+	}
+
+	::close(fd);
+#endif
+
+	if (!_data) {
+		fprintf(stderr, "Error: cannot map %s\n", path);
+		close();
+		return false;
+	}
+
+	const MeshFileHeader& h = header();
+
+	if (memcmp(h.magic, kMeshFileMagic, sizeof(h.magic)) != 0 || h.version != kMeshFileVersion) {
+		fprintf(stderr, "Error: %s is not a version %u mesh file\n", path, kMeshFileVersion);
+		close();
+		return false;
+	}
+
+	if (h.fileSize != _size || h.vertexFormat > VERTEX_FORMAT_QUANTIZED ||
+			h.vertexStride != vertexLayoutStride(h.attributes, (VertexFormat)h.vertexFormat) ||
+			!(h.attributes & MESH_ATTRIBUTE_POSITION) ||
+			h.vertexOffset % kMeshStreamAlignment || h.indexOffset % kMeshStreamAlignment ||
+			h.lodOffset % kMeshStreamAlignment || h.meshletOffset % kMeshStreamAlignment ||
+			!fits(h.vertexOffset, h.vertexCount, h.vertexStride, _size) ||
+			!fits(h.indexOffset, h.indexCount, sizeof(uint32_t), _size) ||
+			!fits(h.lodOffset, h.lodCount, sizeof(MeshLod), _size) ||
+			!fits(h.meshletOffset, h.meshletCount, sizeof(Meshlet), _size) || h.lodCount == 0) {
+		fprintf(stderr, "Error: %s is damaged\n", path);
+		close();
+		return false;
+	}
+
+	// Only the ranges; the indices themselves are trusted, as checking them
+	// would mean reading the whole stream. The meshlets are few and become
+	// indirect draws, so each one's triangles are checked against its
+	// level's indices.
+	for (uint32_t i = 0; i < h.lodCount; ++i) {
+		const MeshLod& level = lod(i);
+		if (level.baseVertex < 0 || (uint64_t)level.baseVertex + level.vertexCount > h.vertexCount ||
+				(uint64_t)level.firstIndex + level.indexCount > h.indexCount ||
+				(uint64_t)level.firstMeshlet + level.meshletCount > h.meshletCount) {
+			fprintf(stderr, "Error: %s has a damaged level of detail %u\n", path, i);
+			close();
+			return false;
+		}
+
+		for (uint32_t m = level.firstMeshlet; m < level.firstMeshlet + level.meshletCount; ++m) {
+			const Meshlet& meshlet = meshlets()[m];
+			if ((uint64_t)meshlet.firstIndex + 3 * (uint64_t)meshlet.triangleCount > level.indexCount) {
+				fprintf(stderr, "Error: %s has a damaged meshlet %u\n", path, m);
+				close();
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+void MeshFile::close()
+{
+#ifdef _WIN32
+	if (_data)
+		UnmapViewOfFile(_data);
+	if (_mapping)
+		CloseHandle(_mapping);
+	if (_file != INVALID_HANDLE_VALUE)
+		CloseHandle(_file);
+
+	_mapping = nullptr;
+	_file = INVALID_HANDLE_VALUE;
+#else
+	if (_data)
+		munmap((void*)_data, _size);
+#endif
+
+	_data = nullptr;
+	_size = 0;
+}
+
+const void* MeshFile::lodVertices(int level) const
+{
+	return (const unsigned char*)vertices() + (size_t)lod(level).baseVertex * header().vertexStride;
+}
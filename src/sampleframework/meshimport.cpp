@@ -0,0 +1,928 @@
+#include "meshimport.hpp"
+
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+static bool readFile(const char* path, std::string* contents)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		fprintf(stderr, "Error: cannot open %s\n", path);
+		return false;
+	}
+
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+
+	contents->resize(size > 0 ? (size_t)size : 0);
+	bool ok = size >= 0 && (size == 0 || fread(&(*contents)[0], 1, (size_t)size, file) == (size_t)size);
+	fclose(file);
+
+	if (!ok)
+		fprintf(stderr, "Error: cannot read %s\n", path);
+
+	return ok;
+}
+
+static void singleLod(MeshData* mesh)
+{
+	MeshLod lod = { 0, (uint32_t)mesh->indices.size(), 0, (uint32_t)mesh->vertexCount(), 0.0f, 0, 0 };
+	mesh->lods.assign(1, lod);
+}
+
+static bool endsWith(const char* text, const char* suffix)
+{
+	size_t length = strlen(text), suffixLength = strlen(suffix);
+	if (length < suffixLength)
+		return false;
+
+	for (size_t i = 0; i < suffixLength; ++i) {
+		if (tolower((unsigned char)text[length - suffixLength + i]) != suffix[i])
+			return false;
+	}
+
+	return true;
+}
+
+// OBJ
+
+namespace {
+
+// One corner of an OBJ face: its position, texture coordinate and normal
+// indices, from zero, or -1.
+struct ObjCorner
+{
+	int v, vt, vn;
+
+	bool operator==(const ObjCorner& other) const
+	{
+		return v == other.v && vt == other.vt && vn == other.vn;
+	}
+};
+
+struct ObjCornerHash
+{
+	size_t operator()(const ObjCorner& corner) const
+	{
+		return (size_t)corner.v * 73856093u ^ (size_t)corner.vt * 19349663u ^ (size_t)corner.vn * 83492791u;
+	}
+};
+
+} // namespace
+
+static const char* skipBlanks(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+		++p;
+
+	return p;
+}
+
+// count floats of a v, vt or vn line; text past the line end would be the
+// next line, which strtof() would happily read.
+static bool parseFloats(const char* p, const char* end, int count, std::vector<float>& values)
+{
+	for (int i = 0; i < count; ++i) {
+		p = skipBlanks(p, end);
+		if (p == end)
+			return false;
+
+		char* next;
+		values.push_back(strtof(p, &next));
+		if (next == p || next > end)
+			return false;
+		p = next;
+	}
+
+	return true;
+}
+
+// An OBJ index, from one and negative from the end, as an index from zero.
+static bool parseIndex(const char*& p, const char* end, int count, int* index)
+{
+	char* next;
+	long value = strtol(p, &next, 10);
+	if (next == p || next > end)
+		return false;
+	p = next;
+
+	*index = value < 0 ? count + (int)value : (int)value - 1;
+	return *index >= 0 && *index < count;
+}
+
+bool parseObj(const std::string& text, MeshData* mesh)
+{
+	std::vector<float> positions, texcoords, normals;
+	std::vector<ObjCorner> corners, polygon;
+
+	const char* p = text.c_str();
+	const char* end = p + text.size();
+	int lineNumber = 0;
+
+	while (p < end) {
+		const char* lineEnd = (const char*)memchr(p, '\n', end - p);
+		if (!lineEnd)
+			lineEnd = end;
+		++lineNumber;
+
+		p = skipBlanks(p, lineEnd);
+		bool ok = true;
+
+		if (lineEnd - p > 2 && p[0] == 'v' && p[1] == ' ') {
+			ok = parseFloats(p + 2, lineEnd, 3, positions);
+		}
+		else if (lineEnd - p > 3 && p[0] == 'v' && p[1] == 't' && p[2] == ' ') {
+			ok = parseFloats(p + 3, lineEnd, 2, texcoords);
+		}
+		else if (lineEnd - p > 3 && p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+			ok = parseFloats(p + 3, lineEnd, 3, normals);
+		}
+		else if (lineEnd - p > 2 && p[0] == 'f' && p[1] == ' ') {
+			polygon.clear();
+			p = skipBlanks(p + 2, lineEnd);
+
+			while (ok && p < lineEnd) {
+				ObjCorner corner = { -1, -1, -1 };
+				ok = parseIndex(p, lineEnd, (int)positions.size() / 3, &corner.v);
+
+				if (ok && p < lineEnd && *p == '/') {
+					++p;
+					if (p < lineEnd && *p != '/')
+						ok = parseIndex(p, lineEnd, (int)texcoords.size() / 2, &corner.vt);
+
+					if (ok && p < lineEnd && *p == '/') {
+						++p;
+						ok = parseIndex(p, lineEnd, (int)normals.size() / 3, &corner.vn);
+					}
+				}
+
+				polygon.push_back(corner);
+				p = skipBlanks(p, lineEnd);
+			}
+
+			ok = ok && polygon.size() >= 3;
+
+			for (size_t i = 1; ok && i + 1 < polygon.size(); ++i) {
+				corners.push_back(polygon[0]);
+				corners.push_back(polygon[i]);
+				corners.push_back(polygon[i + 1]);
+			}
+		}
+
+		if (!ok) {
+			fprintf(stderr, "Error: malformed OBJ line %d\n", lineNumber);
+			return false;
+		}
+
+		p = lineEnd + 1;
+	}
+
+	bool hasTexcoords = !corners.empty(), hasNormals = !corners.empty();
+	for (const ObjCorner& corner : corners) {
+		hasTexcoords = hasTexcoords && corner.vt >= 0;
+		hasNormals = hasNormals && corner.vn >= 0;
+	}
+
+	mesh->attributes = MESH_ATTRIBUTE_POSITION;
+	if (hasNormals)
+		mesh->attributes |= MESH_ATTRIBUTE_NORMAL;
+	if (hasTexcoords)
+		mesh->attributes |= MESH_ATTRIBUTE_TEXCOORD;
+
+	mesh->vertices.clear();
+	mesh->indices.clear();
+	mesh->indices.reserve(corners.size());
+
+	std::unordered_map<ObjCorner, uint32_t, ObjCornerHash> vertices;
+	vertices.reserve(positions.size() / 3);
+
+	for (ObjCorner corner : corners) {
+		if (!hasTexcoords)
+			corner.vt = -1;
+		if (!hasNormals)
+			corner.vn = -1;
+
+		auto inserted = vertices.insert(std::make_pair(corner, (uint32_t)vertices.size()));
+		if (inserted.second) {
+			const float* position = &positions[3 * corner.v];
+			mesh->vertices.insert(mesh->vertices.end(), position, position + 3);
+
+			if (hasNormals) {
+				const float* normal = &normals[3 * corner.vn];
+				mesh->vertices.insert(mesh->vertices.end(), normal, normal + 3);
+			}
+
+			if (hasTexcoords) {
+				const float* texcoord = &texcoords[2 * corner.vt];
+				mesh->vertices.insert(mesh->vertices.end(), texcoord, texcoord + 2);
+			}
+		}
+
+		mesh->indices.push_back(inserted.first->second);
+	}
+
+	singleLod(mesh);
+	return true;
+}
+
+bool loadObj(const char* path, MeshData* mesh)
+{
+	std::string text;
+	if (!readFile(path, &text))
+		return false;
+
+	if (!parseObj(text, mesh)) {
+		fprintf(stderr, "Error: cannot load %s\n", path);
+		return false;
+	}
+
+	return true;
+}
+
+// glTF
+
+namespace {
+
+// Just enough JSON for glTF. An object keeps its keys and values in order
+// side by side in keys and items.
+struct Json
+{
+	enum Type { NUL, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	Type type;
+	double number;
+	std::string string;
+	std::vector<std::string> keys;
+	std::vector<Json> items;
+
+	Json() : type(NUL), number(0.0) {}
+
+	const Json* find(const char* key) const
+	{
+		for (size_t i = 0; i < keys.size(); ++i) {
+			if (keys[i] == key)
+				return &items[i];
+		}
+
+		return nullptr;
+	}
+
+	const Json* at(size_t index) const { return index < items.size() ? &items[index] : nullptr; }
+
+	// A member number or string, or fallback when there is none.
+	double numberOf(const char* key, double fallback) const
+	{
+		const Json* value = find(key);
+		return value && value->type == NUMBER ? value->number : fallback;
+	}
+
+	const char* stringOf(const char* key) const
+	{
+		const Json* value = find(key);
+		return value && value->type == STRING ? value->string.c_str() : nullptr;
+	}
+};
+
+class JsonParser
+{
+public:
+	JsonParser(const char* text, size_t length) : _p(text), _end(text + length) {}
+
+	bool parse(Json* value)
+	{
+		return parseValue(value, 0) && (skipSpace(), _p == _end);
+	}
+
+private:
+	static const int kMaxDepth = 64;
+
+	void skipSpace()
+	{
+		while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\n' || *_p == '\r'))
+			++_p;
+	}
+
+	bool literal(const char* word)
+	{
+		size_t length = strlen(word);
+		if ((size_t)(_end - _p) < length || memcmp(_p, word, length) != 0)
+			return false;
+
+		_p += length;
+		return true;
+	}
+
+	// Escapes other than \uXXXX are kept; glTF names and URIs are ASCII in
+	// practice, and \u sequences become '?'.
+	bool parseString(std::string* string)
+	{
+		if (_p == _end || *_p != '"')
+			return false;
+		++_p;
+
+		while (_p < _end && *_p != '"') {
+			if (*_p == '\\') {
+				if (++_p == _end)
+					return false;
+
+				switch (*_p) {
+				case 'n': string->push_back('\n'); break;
+				case 't': string->push_back('\t'); break;
+				case 'r': string->push_back('\r'); break;
+				case 'b': string->push_back('\b'); break;
+				case 'f': string->push_back('\f'); break;
+				case 'u':
+					if (_end - _p < 5)
+						return false;
+					string->push_back('?');
+					_p += 4;
+					break;
+				default: string->push_back(*_p); break;
+				}
+				++_p;
+			}
+			else {
+				string->push_back(*_p++);
+			}
+		}
+
+		if (_p == _end)
+			return false;
+
+		++_p;
+		return true;
+	}
+
+	bool parseValue(Json* value, int depth)
+	{
+		skipSpace();
+		if (_p == _end || depth > kMaxDepth)
+			return false;
+
+		if (*_p == '{') {
+			value->type = Json::OBJECT;
+			++_p;
+			skipSpace();
+			if (_p < _end && *_p == '}') {
+				++_p;
+				return true;
+			}
+
+			for (;;) {
+				skipSpace();
+				value->keys.push_back(std::string());
+				if (!parseString(&value->keys.back()))
+					return false;
+
+				skipSpace();
+				if (_p == _end || *_p++ != ':')
+					return false;
+
+				value->items.push_back(Json());
+				if (!parseValue(&value->items.back(), depth + 1))
+					return false;
+
+				skipSpace();
+				if (_p == _end)
+					return false;
+				if (*_p == '}') {
+					++_p;
+					return true;
+				}
+				if (*_p++ != ',')
+					return false;
+			}
+		}
+
+		if (*_p == '[') {
+			value->type = Json::ARRAY;
+			++_p;
+			skipSpace();
+			if (_p < _end && *_p == ']') {
+				++_p;
+				return true;
+			}
+
+			for (;;) {
+				value->items.push_back(Json());
+				if (!parseValue(&value->items.back(), depth + 1))
+					return false;
+
+				skipSpace();
+				if (_p == _end)
+					return false;
+				if (*_p == ']') {
+					++_p;
+					return true;
+				}
+				if (*_p++ != ',')
+					return false;
+			}
+		}
+
+		if (*_p == '"') {
+			value->type = Json::STRING;
+			return parseString(&value->string);
+		}
+
+		if (literal("true")) {
+			value->type = Json::BOOLEAN;
+			value->number = 1.0;
+			return true;
+		}
+
+		if (literal("false")) {
+			value->type = Json::BOOLEAN;
+			return true;
+		}
+
+		if (literal("null"))
+			return true;
+
+		// The text is not NUL terminated, so copy the number out first.
+		char number[64];
+		size_t length = 0;
+		while (_p + length < _end && length + 1 < sizeof(number) && strchr("+-0123456789.eE", _p[length])) {
+			number[length] = _p[length];
+			++length;
+		}
+		number[length] = '\0';
+
+		char* next;
+		value->type = Json::NUMBER;
+		value->number = strtod(number, &next);
+		_p += next - number;
+
+		return next != number;
+	}
+
+	const char* _p;
+	const char* _end;
+};
+
+} // namespace
+
+static bool decodeBase64(const char* text, size_t length, std::vector<unsigned char>* bytes)
+{
+	unsigned int bits = 0;
+	int bitCount = 0;
+
+	for (size_t i = 0; i < length && text[i] != '='; ++i) {
+		char c = text[i];
+		int value;
+		if (c >= 'A' && c <= 'Z')
+			value = c - 'A';
+		else if (c >= 'a' && c <= 'z')
+			value = c - 'a' + 26;
+		else if (c >= '0' && c <= '9')
+			value = c - '0' + 52;
+		else if (c == '+' || c == '-')
+			value = 62;
+		else if (c == '/' || c == '_')
+			value = 63;
+		else
+			return false;
+
+		bits = bits << 6 | (unsigned int)value;
+		bitCount += 6;
+		if (bitCount >= 8) {
+			bitCount -= 8;
+			bytes->push_back((unsigned char)(bits >> bitCount));
+		}
+	}
+
+	return true;
+}
+
+namespace {
+
+struct Gltf
+{
+	Json json;
+	std::vector<std::vector<unsigned char>> buffers;
+
+	// The elements of an accessor: count of them, components each, starting
+	// at data, stride bytes apart.
+	struct View
+	{
+		const unsigned char* data;
+		size_t count;
+		size_t stride;
+		int components;
+		int componentType;
+	};
+
+	bool view(int accessor, View* view) const;
+};
+
+} // namespace
+
+static int componentSize(int componentType)
+{
+	switch (componentType) {
+	case 5120: case 5121: return 1;
+	case 5122: case 5123: return 2;
+	case 5125: case 5126: return 4;
+	default: return 0;
+	}
+}
+
+bool Gltf::view(int accessor, View* view) const
+{
+	static const char* const kTypes[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+
+	const Json* accessors = json.find("accessors");
+	const Json* a = accessors ? accessors->at(accessor) : nullptr;
+	if (!a || a->find("sparse"))
+		return false;
+
+	view->count = (size_t)a->numberOf("count", 0.0);
+	view->componentType = (int)a->numberOf("componentType", 0.0);
+
+	view->components = 0;
+	const char* type = a->stringOf("type");
+	for (int i = 0; type && i < 4; ++i) {
+		if (strcmp(type, kTypes[i]) == 0)
+			view->components = i + 1;
+	}
+
+	size_t elementSize = (size_t)componentSize(view->componentType) * view->components;
+	const Json* bufferViews = json.find("bufferViews");
+	const Json* bufferView = bufferViews ? bufferViews->at((size_t)(int)a->numberOf("bufferView", -1.0)) : nullptr;
+	if (!elementSize || !bufferView)
+		return false;
+
+	size_t buffer = (size_t)(int)bufferView->numberOf("buffer", -1.0);
+	size_t viewOffset = (size_t)bufferView->numberOf("byteOffset", 0.0);
+	size_t viewLength = (size_t)bufferView->numberOf("byteLength", 0.0);
+	size_t offset = (size_t)a->numberOf("byteOffset", 0.0);
+	view->stride = (size_t)bufferView->numberOf("byteStride", (double)elementSize);
+
+	if (buffer >= buffers.size() || viewOffset + viewLength > buffers[buffer].size())
+		return false;
+
+	if (view->count && offset + view->stride * (view->count - 1) + elementSize > viewLength)
+		return false;
+
+	view->data = &buffers[buffer][0] + viewOffset + offset;
+	return true;
+}
+
+static bool loadGltfBuffers(const char* path, const std::vector<unsigned char>& binary, Gltf* gltf)
+{
+	std::string directory(path);
+	size_t slash = directory.find_last_of("/\\");
+	directory = slash == std::string::npos ? std::string() : directory.substr(0, slash + 1);
+
+	const Json* buffers = gltf->json.find("buffers");
+	for (size_t i = 0; buffers && i < buffers->items.size(); ++i) {
+		const Json& buffer = buffers->items[i];
+		const char* uri = buffer.stringOf("uri");
+		gltf->buffers.push_back(std::vector<unsigned char>());
+		std::vector<unsigned char>& bytes = gltf->buffers.back();
+
+		if (!uri) {
+			// The BIN chunk of a .glb.
+			bytes = binary;
+		}
+		else if (strncmp(uri, "data:", 5) == 0) {
+			const char* data = strstr(uri, ";base64,");
+			if (!data || !decodeBase64(data + 8, strlen(data + 8), &bytes)) {
+				fprintf(stderr, "Error: %s has a data URI that is not base64\n", path);
+				return false;
+			}
+		}
+		else {
+			std::string contents;
+			if (!readFile((directory + uri).c_str(), &contents))
+				return false;
+			bytes.assign(contents.begin(), contents.end());
+		}
+
+		if (bytes.size() < (size_t)buffer.numberOf("byteLength", 0.0)) {
+			fprintf(stderr, "Error: buffer %zu of %s is short\n", i, path);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool loadGltf(const char* path, MeshData* mesh)
+{
+	std::string contents;
+	if (!readFile(path, &contents))
+		return false;
+
+	const char* json = contents.c_str();
+	size_t jsonLength = contents.size();
+	std::vector<unsigned char> binary;
+
+	// .glb: a 12 byte header, then a JSON chunk and an optional BIN chunk,
+	// each with its length and type up front.
+	if (contents.size() >= 20 && memcmp(json, "glTF", 4) == 0) {
+		uint32_t jsonChunk[2];
+		memcpy(jsonChunk, json + 12, sizeof(jsonChunk));
+		if (jsonChunk[1] != 0x4e4f534a || 20 + (size_t)jsonChunk[0] > contents.size()) {
+			fprintf(stderr, "Error: %s is a damaged .glb\n", path);
+			return false;
+		}
+
+		size_t binOffset = 20 + jsonChunk[0];
+		if (binOffset + 8 <= contents.size()) {
+			uint32_t binChunk[2];
+			memcpy(binChunk, json + binOffset, sizeof(binChunk));
+			if (binChunk[1] == 0x004e4942 && binOffset + 8 + binChunk[0] <= contents.size())
+				binary.assign(json + binOffset + 8, json + binOffset + 8 + binChunk[0]);
+		}
+
+		json += 20;
+		jsonLength = jsonChunk[0];
+	}
+
+	Gltf gltf;
+	if (!JsonParser(json, jsonLength).parse(&gltf.json) || gltf.json.type != Json::OBJECT) {
+		fprintf(stderr, "Error: %s is not glTF JSON\n", path);
+		return false;
+	}
+
+	if (!loadGltfBuffers(path, binary, &gltf))
+		return false;
+
+	// The triangle primitives, and which attributes all of them have.
+	std::vector<const Json*> primitives;
+	bool hasNormals = true, hasTexcoords = true, hasTangents = true;
+
+	const Json* meshes = gltf.json.find("meshes");
+	for (size_t m = 0; meshes && m < meshes->items.size(); ++m) {
+		const Json* list = meshes->items[m].find("primitives");
+		for (size_t i = 0; list && i < list->items.size(); ++i) {
+			const Json& primitive = list->items[i];
+			const Json* attributes = primitive.find("attributes");
+			if (primitive.numberOf("mode", 4.0) != 4.0 || !attributes || !attributes->find("POSITION"))
+				continue;
+
+			primitives.push_back(&primitive);
+			hasNormals = hasNormals && attributes->find("NORMAL");
+			hasTexcoords = hasTexcoords && attributes->find("TEXCOORD_0");
+			hasTangents = hasTangents && attributes->find("TANGENT");
+		}
+	}
+
+	if (primitives.empty()) {
+		fprintf(stderr, "Error: %s has no triangles\n", path);
+		return false;
+	}
+
+	mesh->attributes = MESH_ATTRIBUTE_POSITION;
+	if (hasNormals)
+		mesh->attributes |= MESH_ATTRIBUTE_NORMAL;
+	if (hasTexcoords)
+		mesh->attributes |= MESH_ATTRIBUTE_TEXCOORD;
+	if (hasTangents)
+		mesh->attributes |= MESH_ATTRIBUTE_TANGENT;
+
+	mesh->vertices.clear();
+	mesh->indices.clear();
+
+	static const char* const kAttributes[] = { "POSITION", "NORMAL", "TEXCOORD_0", "TANGENT" };
+	static const int kComponents[] = { 3, 3, 2, 4 };
+	int used[] = { 1, hasNormals, hasTexcoords, hasTangents };
+
+	for (const Json* primitive : primitives) {
+		const Json* attributes = primitive->find("attributes");
+		uint32_t baseVertex = (uint32_t)mesh->vertexCount();
+
+		Gltf::View views[4];
+		for (int a = 0; a < 4; ++a) {
+			if (!used[a])
+				continue;
+
+			Gltf::View& view = views[a];
+			if (!gltf.view((int)attributes->numberOf(kAttributes[a], -1.0), &view) ||
+					view.componentType != 5126 || view.components != kComponents[a] ||
+					view.count != views[0].count) {
+				fprintf(stderr, "Error: %s has a %s that is not float vec%d\n", path,
+						kAttributes[a], kComponents[a]);
+				return false;
+			}
+		}
+
+		for (size_t v = 0; v < views[0].count; ++v) {
+			for (int a = 0; a < 4; ++a) {
+				if (!used[a])
+					continue;
+
+				float values[4];
+				memcpy(values, views[a].data + v * views[a].stride, sizeof(float) * kComponents[a]);
+				mesh->vertices.insert(mesh->vertices.end(), values, values + kComponents[a]);
+			}
+		}
+
+		const Json* indices = primitive->find("indices");
+		if (!indices) {
+			for (size_t v = 0; v + 2 < views[0].count; v += 3) {
+				for (int c = 0; c < 3; ++c)
+					mesh->indices.push_back(baseVertex + (uint32_t)(v + c));
+			}
+			continue;
+		}
+
+		Gltf::View view;
+		if (!gltf.view((int)indices->number, &view) || view.components != 1 ||
+				(view.componentType != 5121 && view.componentType != 5123 && view.componentType != 5125)) {
+			fprintf(stderr, "Error: %s has damaged indices\n", path);
+			return false;
+		}
+
+		for (size_t i = 0; i < view.count; ++i) {
+			const unsigned char* element = view.data + i * view.stride;
+			uint32_t index;
+			if (view.componentType == 5121) {
+				index = *element;
+			}
+			else if (view.componentType == 5123) {
+				uint16_t value;
+				memcpy(&value, element, sizeof(value));
+				index = value;
+			}
+			else {
+				memcpy(&index, element, sizeof(index));
+			}
+
+			if (index >= views[0].count) {
+				fprintf(stderr, "Error: %s has an index past its vertices\n", path);
+				return false;
+			}
+
+			mesh->indices.push_back(baseVertex + index);
+		}
+	}
+
+	singleLod(mesh);
+	return true;
+}
+
+bool loadMesh(const char* path, MeshData* mesh)
+{
+	if (endsWith(path, ".obj"))
+		return loadObj(path, mesh);
+
+	if (endsWith(path, ".gltf") || endsWith(path, ".glb"))
+		return loadGltf(path, mesh);
+
+	fprintf(stderr, "Error: %s is neither OBJ nor glTF\n", path);
+	return false;
+}
+
+bool appendMeshLod(MeshData* mesh, const MeshData& level, float distance)
+{
+	if (level.attributes != mesh->attributes) {
+		fprintf(stderr, "Error: every level of detail needs the same attributes\n");
+		return false;
+	}
+
+	MeshLod lod = { (uint32_t)mesh->indices.size(), (uint32_t)level.indices.size(),
+		(int32_t)mesh->vertexCount(), (uint32_t)level.vertexCount(), distance, 0, 0 };
+	mesh->lods.push_back(lod);
+
+	mesh->vertices.insert(mesh->vertices.end(), level.vertices.begin(), level.vertices.end());
+	mesh->indices.insert(mesh->indices.end(), level.indices.begin(), level.indices.end());
+
+	return true;
+}
+
+// The axis-aligned box of the positions, and the sphere around its center
+// through the farthest of them.
+static void meshBounds(const MeshData& mesh, float* min, float* max, float* center, float* radius)
+{
+	size_t stride = meshVertexStride(mesh.attributes) / sizeof(float);
+
+	for (int c = 0; c < 3; ++c) {
+		min[c] = mesh.vertices.empty() ? 0.0f : mesh.vertices[c];
+		max[c] = min[c];
+	}
+
+	for (size_t i = 0; i < mesh.vertices.size(); i += stride) {
+		for (int c = 0; c < 3; ++c) {
+			min[c] = std::min(min[c], mesh.vertices[i + c]);
+			max[c] = std::max(max[c], mesh.vertices[i + c]);
+		}
+	}
+
+	float radiusSquared = 0.0f;
+	for (int c = 0; c < 3; ++c)
+		center[c] = 0.5f * (min[c] + max[c]);
+
+	for (size_t i = 0; i < mesh.vertices.size(); i += stride) {
+		float dx = mesh.vertices[i] - center[0];
+		float dy = mesh.vertices[i + 1] - center[1];
+		float dz = mesh.vertices[i + 2] - center[2];
+		radiusSquared = std::max(radiusSquared, dx * dx + dy * dy + dz * dz);
+	}
+
+	*radius = std::sqrt(radiusSquared);
+}
+
+void normalizeMesh(MeshData* mesh)
+{
+	float min[3], max[3], center[3], radius;
+	meshBounds(*mesh, min, max, center, &radius);
+
+	float scale = radius > 0.0f ? 1.0f / radius : 1.0f;
+	size_t stride = meshVertexStride(mesh->attributes) / sizeof(float);
+
+	for (size_t i = 0; i < mesh->vertices.size(); i += stride) {
+		for (int c = 0; c < 3; ++c)
+			mesh->vertices[i + c] = (mesh->vertices[i + c] - center[c]) * scale;
+	}
+}
+
+static uint64_t alignStream(uint64_t offset)
+{
+	return (offset + kMeshStreamAlignment - 1) / kMeshStreamAlignment * kMeshStreamAlignment;
+}
+
+// Writes size bytes of data at offset, zero filling from where the file
+// is now.
+static bool writeAt(FILE* file, uint64_t* position, uint64_t offset, const void* data, size_t size)
+{
+	static const char kZeros[256] = {};
+
+	while (*position < offset) {
+		size_t padding = (size_t)std::min<uint64_t>(offset - *position, sizeof(kZeros));
+		if (fwrite(kZeros, 1, padding, file) != padding)
+			return false;
+		*position += padding;
+	}
+
+	if (size && fwrite(data, 1, size, file) != size)
+		return false;
+
+	*position += size;
+	return true;
+}
+
+bool writeMeshFile(const char* path, const MeshData& mesh, VertexFormat format)
+{
+	MeshFileHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, kMeshFileMagic, sizeof(header.magic));
+	header.version = kMeshFileVersion;
+
+	header.attributes = mesh.attributes;
+	header.vertexFormat = format;
+	header.vertexStride = vertexLayoutStride(mesh.attributes, format);
+	header.vertexCount = (uint32_t)mesh.vertexCount();
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.lodCount = (uint32_t)mesh.lods.size();
+	header.meshletCount = (uint32_t)mesh.meshlets.size();
+
+	size_t vertexBytes = (size_t)header.vertexStride * header.vertexCount;
+	size_t indexBytes = sizeof(uint32_t) * mesh.indices.size();
+	size_t lodBytes = sizeof(MeshLod) * mesh.lods.size();
+	size_t meshletBytes = sizeof(Meshlet) * mesh.meshlets.size();
+
+	header.vertexOffset = alignStream(sizeof(header));
+	header.indexOffset = alignStream(header.vertexOffset + vertexBytes);
+	header.lodOffset = alignStream(header.indexOffset + indexBytes);
+	header.meshletOffset = alignStream(header.lodOffset + lodBytes);
+	header.fileSize = header.meshletOffset + meshletBytes;
+
+	meshBounds(mesh, header.boundsMin, header.boundsMax, header.sphereCenter, &header.sphereRadius);
+
+	// Quantized within the bounds just found.
+	VertexLayout layout;
+	layout.init(header);
+	std::vector<unsigned char> vertices(vertexBytes);
+	layout.encode(mesh.vertices.empty() ? nullptr : &mesh.vertices[0], header.vertexCount,
+			vertices.empty() ? nullptr : &vertices[0]);
+
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Error: cannot create %s\n", path);
+		return false;
+	}
+
+	uint64_t position = 0;
+	bool ok = writeAt(file, &position, 0, &header, sizeof(header)) &&
+		writeAt(file, &position, header.vertexOffset, vertices.empty() ? nullptr : &vertices[0], vertexBytes) &&
+		writeAt(file, &position, header.indexOffset, mesh.indices.empty() ? nullptr : &mesh.indices[0], indexBytes) &&
+		writeAt(file, &position, header.lodOffset, mesh.lods.empty() ? nullptr : &mesh.lods[0], lodBytes) &&
+		writeAt(file, &position, header.meshletOffset, mesh.meshlets.empty() ? nullptr : &mesh.meshlets[0], meshletBytes);
+
+	ok = fclose(file) == 0 && ok;
+	if (!ok)
+		fprintf(stderr, "Error: cannot write %s\n", path);
+
+	return ok;
+}
@@ -0,0 +1,59 @@
+#ifndef MESHIMPORT_H_
+#define MESHIMPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <string>
+#include <vector>
+
+#include "meshfile.hpp"
+#include "vertexlayout.hpp"
+
+// A mesh on its way into a .mesh file: interleaved float vertices with the
+// layout of attributes (see MeshAttribute), 32-bit indices, and its levels
+// of detail.
+struct MeshData
+{
+	uint32_t attributes;
+	std::vector<float> vertices;
+	std::vector<uint32_t> indices;
+	std::vector<MeshLod> lods;
+
+	// Of every level, from buildMeshlets() (meshlet.hpp), which has to
+	// come after anything else that changes the mesh.
+	std::vector<Meshlet> meshlets;
+
+	MeshData() : attributes(MESH_ATTRIBUTE_POSITION) {}
+
+	size_t vertexCount() const { return vertices.size() / (meshVertexStride(attributes) / sizeof(float)); }
+};
+
+// Wavefront OBJ: v, vt and vn, with f polygons split into fans. Every
+// distinct v/vt/vn corner becomes one vertex. Normals and texture
+// coordinates are kept when every corner has them. One level of detail.
+bool loadObj(const char* path, MeshData* mesh);
+bool parseObj(const std::string& text, MeshData* mesh);
+
+// glTF 2.0, .gltf with its buffers in files next to it or data URIs, or
+// .glb: the triangles of every primitive of every mesh, in mesh space (node
+// transforms are not applied), with float POSITION, NORMAL, TEXCOORD_0 and
+// TANGENT when every primitive has them. One level of detail.
+bool loadGltf(const char* path, MeshData* mesh);
+
+// By extension.
+bool loadMesh(const char* path, MeshData* mesh);
+
+// Adds the single level of level to mesh as its next level of detail, used
+// from distance on. Both need the same attributes.
+bool appendMeshLod(MeshData* mesh, const MeshData& level, float distance);
+
+// Moves and scales the positions into the unit sphere around the origin,
+// the size of the samples' triangle.
+void normalizeMesh(MeshData* mesh);
+
+// With the vertices in format; quantized ones are relative to the bounds in
+// the header.
+bool writeMeshFile(const char* path, const MeshData& mesh, VertexFormat format = VERTEX_FORMAT_FLOAT);
+
+#endif // MESHIMPORT_H_
@@ -0,0 +1,223 @@
+// Triangles submitted against those left after meshlet culling and those
+// actually visible, for a 1M triangle torus and any OBJ or glTF files
+// given, from cameras orbiting close up, at mid range and far away. The
+// meshlets are built after optimizeMesh(), as meshconvert does, and the
+// time buildMeshlets() takes is reported too. Culling runs on the CPU with
+// meshletVisible(), the test MeshletCuller's shader makes.
+//
+//	meshlet-bench [report.json|-] [mesh.obj|gltf|glb ...]
+
+#include "benchmark.hpp"
+#include "frustumcull.hpp"
+#include "meshimport.hpp"
+#include "meshlet.hpp"
+#include "meshoptimize.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+static const int kIterations = 20;
+
+static double milliseconds(double start)
+{
+	return (Benchmark::now() - start) * 1000.0;
+}
+
+// A torus in the unit sphere, rings around the tube of segments
+// vertices each, with normals.
+static void torusMesh(int rings, int segments, MeshData* mesh)
+{
+	const float kMajor = 0.7f;
+	const float kMinor = 0.3f;
+	const float kPi = 3.14159265f;
+
+	mesh->attributes = MESH_ATTRIBUTE_POSITION | MESH_ATTRIBUTE_NORMAL;
+	mesh->vertices.clear();
+	mesh->indices.clear();
+
+	for (int r = 0; r < rings; ++r) {
+		float u = 2.0f * kPi * r / rings;
+		for (int s = 0; s < segments; ++s) {
+			float v = 2.0f * kPi * s / segments;
+			float normal[3] = { std::cos(u) * std::cos(v), std::sin(v), std::sin(u) * std::cos(v) };
+			float vertex[6] = {
+				std::cos(u) * kMajor + kMinor * normal[0], kMinor * normal[1], std::sin(u) * kMajor + kMinor * normal[2],
+				normal[0], normal[1], normal[2],
+			};
+			mesh->vertices.insert(mesh->vertices.end(), vertex, vertex + 6);
+		}
+	}
+
+	for (int r = 0; r < rings; ++r) {
+		for (int s = 0; s < segments; ++s) {
+			uint32_t a = (uint32_t)(r * segments + s);
+			uint32_t b = (uint32_t)(r * segments + (s + 1) % segments);
+			uint32_t c = (uint32_t)((r + 1) % rings * segments + s);
+			uint32_t d = (uint32_t)((r + 1) % rings * segments + (s + 1) % segments);
+			uint32_t quad[6] = { a, b, d, a, d, c };
+			mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+		}
+	}
+
+	MeshLod lod = { 0, (uint32_t)mesh->indices.size(), 0, (uint32_t)mesh->vertexCount(), 0.0f, 0, 0 };
+	mesh->lods.assign(1, lod);
+}
+
+static glm::vec3 vec3(const float* v)
+{
+	return glm::vec3(v[0], v[1], v[2]);
+}
+
+// Triangles with a corner inside the frustum (or straddling it) that face
+// the camera: what the rasterizer would keep.
+static size_t visibleTriangles(const MeshData& mesh, const float* planes, const glm::vec3& camera)
+{
+	size_t floats = meshVertexStride(mesh.attributes) / sizeof(float);
+	const MeshLod& lod = mesh.lods[0];
+	const uint32_t* indices = &mesh.indices[lod.firstIndex];
+	const float* positions = &mesh.vertices[lod.baseVertex * floats];
+
+	size_t visible = 0;
+	for (size_t i = 0; i < lod.indexCount; i += 3) {
+		glm::vec3 corners[3];
+		for (int c = 0; c < 3; ++c)
+			corners[c] = vec3(positions + indices[i + c] * floats);
+
+		glm::vec3 normal = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+		if (glm::dot(normal, corners[0] - camera) >= 0.0f)
+			continue;
+
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p) {
+			const float* plane = planes + 4 * p;
+			outside = true;
+			for (int c = 0; c < 3; ++c)
+				outside = outside && glm::dot(vec3(plane), corners[c]) + plane[3] < 0.0f;
+		}
+
+		visible += !outside;
+	}
+
+	return visible;
+}
+
+static void run(Benchmark& report, const std::string& name, MeshData& mesh)
+{
+	size_t triangles = mesh.lods[0].indexCount / 3;
+	fprintf(stderr, "%s: %zu triangles\n", name.c_str(), triangles);
+
+	optimizeMesh(&mesh);
+
+	double start = Benchmark::now();
+	buildMeshlets(&mesh);
+	double build = milliseconds(start);
+
+	const MeshLod& lod = mesh.lods[0];
+	const Meshlet* meshlets = &mesh.meshlets[lod.firstMeshlet];
+
+	size_t vertices = 0;
+	for (uint32_t m = 0; m < lod.meshletCount; ++m)
+		vertices += meshlets[m].vertexCount;
+
+	fprintf(stderr, "  %u meshlets, %.1f triangles and %.1f vertices each, built in %.2f ms\n",
+			lod.meshletCount, (double)triangles / lod.meshletCount, (double)vertices / lod.meshletCount, build);
+
+	report.record(name + "_meshlets", (double)lod.meshletCount);
+	report.record(name + "_meshlet_triangles", (double)triangles / lod.meshletCount);
+	report.record(name + "_meshlet_vertices", (double)vertices / lod.meshletCount);
+	report.record(name + "_build_ms", build);
+
+	// Distance from the center, in radii of the mesh's bounding sphere.
+	const float distances[] = { 1.5f, 3.0f, 10.0f };
+	const float angles[] = { 0.0f, 2.1f, 4.2f };
+
+	for (float distance : distances) {
+		for (float angle : angles) {
+			glm::vec3 camera = distance * glm::normalize(glm::vec3(std::cos(angle), 0.6f, std::sin(angle)));
+			glm::mat4 VP = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 100.0f) *
+				glm::lookAt(camera, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+			float planes[24];
+			frustumPlanes(glm::value_ptr(VP), planes);
+
+			// Frustum alone, with cones no camera is behind, then with the
+			// real ones.
+			size_t inFrustum = 0;
+			for (uint32_t m = 0; m < lod.meshletCount; ++m) {
+				Meshlet sphere = meshlets[m];
+				sphere.coneCutoff = 1.0f;
+				if (meshletVisible(sphere, planes, glm::value_ptr(camera)))
+					inFrustum += meshlets[m].triangleCount;
+			}
+
+			size_t kept = 0;
+			start = Benchmark::now();
+			for (int i = 0; i < kIterations; ++i) {
+				kept = 0;
+				for (uint32_t m = 0; m < lod.meshletCount; ++m) {
+					if (meshletVisible(meshlets[m], planes, glm::value_ptr(camera)))
+						kept += meshlets[m].triangleCount;
+				}
+			}
+			double cull = milliseconds(start) / kIterations;
+
+			size_t visible = visibleTriangles(mesh, planes, camera);
+
+			char series[64];
+			snprintf(series, sizeof(series), "%s_d%g_a%g_", name.c_str(), distance, angle);
+
+			fprintf(stderr, "  distance %4.1f angle %3.1f: %8zu submitted, %8zu in frustum, %8zu after cones "
+					"(%5.1f%%), %8zu visible (%5.1f%%), cull %.3f ms\n", distance, angle, triangles,
+					inFrustum, kept, 100.0 * kept / triangles, visible, 100.0 * visible / triangles, cull);
+
+			report.record(std::string(series) + "submitted", (double)triangles);
+			report.record(std::string(series) + "frustum", (double)inFrustum);
+			report.record(std::string(series) + "meshlet", (double)kept);
+			report.record(std::string(series) + "visible", (double)visible);
+			report.record(std::string(series) + "cull_ms", cull);
+		}
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	Benchmark report;
+	report.setProperty("benchmark", "meshlet");
+	report.setProperty("max_vertices", (double)kMeshletMaxVertices);
+	report.setProperty("max_triangles", (double)kMeshletMaxTriangles);
+
+	MeshData torus;
+	torusMesh(1000, 500, &torus);
+	run(report, "torus", torus);
+
+	int status = 0;
+	for (int i = 2; i < argc; ++i) {
+		MeshData mesh;
+		if (!loadMesh(argv[i], &mesh)) {
+			status = 1;
+			continue;
+		}
+		normalizeMesh(&mesh);
+
+		std::string name(argv[i]);
+		size_t slash = name.find_last_of("/\\");
+		run(report, slash == std::string::npos ? name : name.substr(slash + 1), mesh);
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return status;
+	}
+
+	return report.writeJSON(output) ? status : 1;
+}
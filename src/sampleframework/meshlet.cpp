@@ -0,0 +1,171 @@
+#include "meshlet.hpp"
+
+#include <cfloat>
+#include <cmath>
+
+#include <algorithm>
+#include <vector>
+
+// Below this, the normals spread over more than a hemisphere (about 84
+// degrees from the axis) and no camera position sees all of them from
+// behind.
+static const float kMinConeDot = 0.1f;
+
+static void subtract(const float* a, const float* b, float* out)
+{
+	for (int c = 0; c < 3; ++c)
+		out[c] = a[c] - b[c];
+}
+
+static float dot(const float* a, const float* b)
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+// The bounding sphere and normal cone of the triangles of meshlet.
+static void meshletBounds(const uint32_t* indices, const float* positions, size_t stride, Meshlet* meshlet)
+{
+	const uint32_t* first = indices + meshlet->firstIndex;
+	size_t indexCount = 3 * (size_t)meshlet->triangleCount;
+
+	float lo[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+	float hi[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	for (size_t i = 0; i < indexCount; ++i) {
+		const float* p = positions + first[i] * stride;
+		for (int c = 0; c < 3; ++c) {
+			lo[c] = std::min(lo[c], p[c]);
+			hi[c] = std::max(hi[c], p[c]);
+		}
+	}
+
+	float radius = 0.0f;
+	for (int c = 0; c < 3; ++c)
+		meshlet->center[c] = 0.5f * (lo[c] + hi[c]);
+	for (size_t i = 0; i < indexCount; ++i) {
+		float offset[3];
+		subtract(positions + first[i] * stride, meshlet->center, offset);
+		radius = std::max(radius, dot(offset, offset));
+	}
+	meshlet->radius = std::sqrt(radius);
+
+	// The axis is the mean of the unit normals; degenerate triangles have
+	// none and face nowhere.
+	std::vector<float> normals;
+	normals.reserve(indexCount);
+	float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (size_t i = 0; i < indexCount; i += 3) {
+		const float* a = positions + first[i] * stride;
+		float ab[3], ac[3];
+		subtract(positions + first[i + 1] * stride, a, ab);
+		subtract(positions + first[i + 2] * stride, a, ac);
+
+		float n[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+		float length = std::sqrt(dot(n, n));
+		if (length == 0.0f)
+			continue;
+
+		for (int c = 0; c < 3; ++c) {
+			n[c] /= length;
+			axis[c] += n[c];
+		}
+		normals.insert(normals.end(), n, n + 3);
+	}
+
+	float length = std::sqrt(dot(axis, axis));
+	float minDot = -1.0f;
+	if (length > 0.0f) {
+		for (int c = 0; c < 3; ++c)
+			axis[c] /= length;
+
+		minDot = 1.0f;
+		for (size_t n = 0; n < normals.size(); n += 3)
+			minDot = std::min(minDot, dot(&normals[n], axis));
+	}
+
+	for (int c = 0; c < 3; ++c)
+		meshlet->coneAxis[c] = length > 0.0f ? axis[c] : 0.0f;
+	meshlet->coneCutoff = minDot <= kMinConeDot ? 1.0f : std::sqrt(1.0f - minDot * minDot);
+}
+
+void buildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions,
+		size_t stride, std::vector<Meshlet>* meshlets)
+{
+	if (indexCount == 0)
+		return;
+
+	uint32_t vertexCount = 0;
+	for (size_t i = 0; i < indexCount; ++i)
+		vertexCount = std::max(vertexCount, indices[i] + 1);
+
+	// The meshlet that last took each vertex, counted from 1.
+	std::vector<uint32_t> owner(vertexCount, 0);
+	uint32_t number = 1;
+
+	Meshlet meshlet = {};
+
+	for (size_t i = 0; i + 2 < indexCount; i += 3) {
+		uint32_t fresh = 0;
+		for (int c = 0; c < 3; ++c) {
+			uint32_t v = indices[i + c];
+			bool repeated = (c > 0 && v == indices[i]) || (c > 1 && v == indices[i + 1]);
+			fresh += owner[v] != number && !repeated;
+		}
+
+		if (meshlet.triangleCount > 0 && (meshlet.vertexCount + fresh > (uint32_t)kMeshletMaxVertices ||
+				meshlet.triangleCount == (uint32_t)kMeshletMaxTriangles)) {
+			meshletBounds(indices, positions, stride, &meshlet);
+			meshlets->push_back(meshlet);
+
+			meshlet = Meshlet();
+			meshlet.firstIndex = (uint32_t)i;
+			++number;
+
+			// Every vertex is new to the next meshlet.
+			fresh = 1 + (indices[i + 1] != indices[i]) +
+				(indices[i + 2] != indices[i] && indices[i + 2] != indices[i + 1]);
+		}
+
+		for (int c = 0; c < 3; ++c)
+			owner[indices[i + c]] = number;
+
+		meshlet.vertexCount += fresh;
+		++meshlet.triangleCount;
+	}
+
+	meshletBounds(indices, positions, stride, &meshlet);
+	meshlets->push_back(meshlet);
+}
+
+void buildMeshlets(MeshData* mesh)
+{
+	size_t stride = meshVertexStride(mesh->attributes) / sizeof(float);
+	mesh->meshlets.clear();
+
+	for (MeshLod& lod : mesh->lods) {
+		lod.firstMeshlet = (uint32_t)mesh->meshlets.size();
+		if (lod.indexCount > 0) {
+			buildMeshlets(&mesh->indices[lod.firstIndex], lod.indexCount,
+					&mesh->vertices[lod.baseVertex * stride], stride, &mesh->meshlets);
+		}
+		lod.meshletCount = (uint32_t)mesh->meshlets.size() - lod.firstMeshlet;
+	}
+}
+
+bool meshletVisible(const Meshlet& meshlet, const float* planes, const float* camera)
+{
+	for (int p = 0; p < 6; ++p) {
+		const float* plane = planes + 4 * p;
+		if (dot(plane, meshlet.center) + plane[3] < -meshlet.radius)
+			return false;
+	}
+
+	// Back-facing when the camera sees every normal in the cone from
+	// behind, with the sphere's radius as margin; the test meshoptimizer
+	// uses.
+	float direction[3];
+	subtract(meshlet.center, camera, direction);
+	float distance = std::sqrt(dot(direction, direction));
+
+	return dot(direction, meshlet.coneAxis) < meshlet.coneCutoff * distance + meshlet.radius;
+}
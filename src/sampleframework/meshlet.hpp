@@ -0,0 +1,35 @@
+#ifndef MESHLET_H_
+#define MESHLET_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "meshimport.hpp"
+
+// Most vertices and triangles per meshlet. 64 vertices fill one wave of
+// vertex shading on most GPUs, and with about two triangles per vertex on
+// a well-connected mesh, 124 triangles is where both limits meet.
+static const int kMeshletMaxVertices = 64;
+static const int kMeshletMaxTriangles = 124;
+
+// Splits the triangles of indexCount indices into meshlets, in order: a
+// meshlet takes triangles until one more would go over either limit. The
+// order optimizeVertexCache() leaves keeps neighbouring triangles
+// together, so run that first for compact clusters. Appends to meshlets
+// with firstIndex counted from indices; positions are three floats,
+// stride floats apart, indexed like indices.
+void buildMeshlets(const uint32_t* indices, size_t indexCount, const float* positions,
+		size_t stride, std::vector<Meshlet>* meshlets);
+
+// Every level of detail of mesh, setting their firstMeshlet and
+// meshletCount.
+void buildMeshlets(MeshData* mesh);
+
+// The test the cluster culling shader makes (see MeshletCuller): whether
+// the meshlet's sphere touches the frustum of planes (frustumPlanes()) and
+// some of its triangles may face camera, all in the meshlet's space.
+bool meshletVisible(const Meshlet& meshlet, const float* planes, const float* camera);
+
+#endif // MESHLET_H_
@@ -0,0 +1,219 @@
+// Vertex cache and fetch behaviour of meshes before and after
+// optimizeMesh(), and the time each stage takes: a regular grid with its
+// triangles and vertices shuffled, as some exporters leave them, the same
+// grid as a triangle soup with no shared vertices, and any OBJ or glTF
+// files given.
+//
+//	meshoptimize-bench [report.json|-] [mesh.obj|gltf|glb ...]
+
+#include "benchmark.hpp"
+#include "meshimport.hpp"
+#include "meshoptimize.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+struct Random
+{
+	unsigned int state;
+
+	explicit Random(unsigned int seed) : state(seed) {}
+
+	unsigned int next(unsigned int bound)
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) % bound;
+	}
+};
+
+static double milliseconds(double start)
+{
+	return (Benchmark::now() - start) * 1000.0;
+}
+
+static void gridMesh(int side, MeshData* mesh)
+{
+	mesh->attributes = MESH_ATTRIBUTE_POSITION | MESH_ATTRIBUTE_NORMAL;
+	mesh->vertices.clear();
+	mesh->indices.clear();
+
+	for (int y = 0; y <= side; ++y) {
+		for (int x = 0; x <= side; ++x) {
+			float vertex[6] = { (float)x / side, (float)y / side, 0.0f, 0.0f, 0.0f, 1.0f };
+			mesh->vertices.insert(mesh->vertices.end(), vertex, vertex + 6);
+		}
+	}
+
+	for (int y = 0; y < side; ++y) {
+		for (int x = 0; x < side; ++x) {
+			uint32_t corner = (uint32_t)(y * (side + 1) + x);
+			uint32_t quad[6] = { corner, corner + 1, corner + side + 2, corner, corner + side + 2, corner + side + 1 };
+			mesh->indices.insert(mesh->indices.end(), quad, quad + 6);
+		}
+	}
+
+	MeshLod lod = { 0, (uint32_t)mesh->indices.size(), 0, (uint32_t)mesh->vertexCount(), 0.0f, 0, 0 };
+	mesh->lods.assign(1, lod);
+}
+
+// Triangles in random order, vertices at random places.
+static void shuffleMesh(MeshData* mesh, Random& random)
+{
+	size_t floats = meshVertexStride(mesh->attributes) / sizeof(float);
+	size_t vertexCount = mesh->vertexCount();
+	size_t triangleCount = mesh->indices.size() / 3;
+
+	for (size_t t = triangleCount - 1; t > 0; --t) {
+		size_t other = random.next((unsigned int)t + 1);
+		for (int c = 0; c < 3; ++c)
+			std::swap(mesh->indices[3 * t + c], mesh->indices[3 * other + c]);
+	}
+
+	std::vector<uint32_t> order(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v)
+		order[v] = (uint32_t)v;
+	for (size_t v = vertexCount - 1; v > 0; --v)
+		std::swap(order[v], order[random.next((unsigned int)v + 1)]);
+
+	// order[n] is the old vertex going to place n.
+	std::vector<uint32_t> place(vertexCount);
+	std::vector<float> vertices(mesh->vertices.size());
+	for (size_t n = 0; n < vertexCount; ++n) {
+		place[order[n]] = (uint32_t)n;
+		std::copy(&mesh->vertices[order[n] * floats], &mesh->vertices[(order[n] + 1) * floats], &vertices[n * floats]);
+	}
+
+	mesh->vertices.swap(vertices);
+	for (uint32_t& index : mesh->indices)
+		index = place[index];
+}
+
+// Every corner its own vertex.
+static void soupMesh(MeshData* mesh)
+{
+	size_t floats = meshVertexStride(mesh->attributes) / sizeof(float);
+	std::vector<float> vertices;
+	vertices.reserve(mesh->indices.size() * floats);
+
+	for (uint32_t& index : mesh->indices) {
+		vertices.insert(vertices.end(), &mesh->vertices[index * floats], &mesh->vertices[(index + 1) * floats]);
+		index = (uint32_t)(vertices.size() / floats - 1);
+	}
+
+	mesh->vertices.swap(vertices);
+	mesh->lods[0].vertexCount = (uint32_t)mesh->vertexCount();
+}
+
+static void printStats(const char* when, const MeshStats& stats, size_t stride)
+{
+	fprintf(stderr, "  %-6s %8zu vertices, ACMR %.3f, ATVR %.3f, %zu transformed, %.1f KB fetched (overfetch %.2f)\n",
+			when, stats.vertices, stats.acmr(), stats.atvr(), stats.transformed,
+			stats.fetched / 1024.0, stats.overfetch(stride));
+}
+
+static void recordStats(Benchmark& report, const std::string& series, const MeshStats& stats, size_t stride)
+{
+	report.record(series + "vertices", (double)stats.vertices);
+	report.record(series + "acmr", stats.acmr());
+	report.record(series + "atvr", stats.atvr());
+	report.record(series + "transformed", (double)stats.transformed);
+	report.record(series + "fetched_bytes", (double)stats.fetched);
+	report.record(series + "overfetch", stats.overfetch(stride));
+}
+
+// Times every stage of optimizeMesh() on the first level of detail and
+// reports the caches before and after.
+static void run(Benchmark& report, const std::string& name, MeshData& mesh)
+{
+	size_t stride = meshVertexStride(mesh.attributes);
+	size_t floats = stride / sizeof(float);
+
+	fprintf(stderr, "%s: %zu triangles\n", name.c_str(), mesh.indices.size() / 3);
+
+	MeshStats before = analyzeMesh(mesh, 0);
+	printStats("before", before, stride);
+	recordStats(report, name + "_before_", before, stride);
+
+	std::vector<float> vertices(mesh.vertices.begin() + mesh.lods[0].baseVertex * floats,
+			mesh.vertices.begin() + (mesh.lods[0].baseVertex + mesh.lods[0].vertexCount) * floats);
+	std::vector<uint32_t> indices(mesh.indices.begin() + mesh.lods[0].firstIndex,
+			mesh.indices.begin() + mesh.lods[0].firstIndex + mesh.lods[0].indexCount);
+
+	double start = Benchmark::now();
+	size_t vertexCount = deduplicateVertices(vertices, floats, indices);
+	double deduplicate = milliseconds(start);
+
+	std::vector<uint32_t> clusters;
+	start = Benchmark::now();
+	optimizeVertexCache(&indices[0], indices.size(), vertexCount, &clusters);
+	double cache = milliseconds(start);
+	MeshStats afterCache = analyzeMesh(&indices[0], indices.size(), vertexCount, stride);
+
+	start = Benchmark::now();
+	optimizeOverdraw(&indices[0], indices.size(), &vertices[0], floats, clusters, 1.05f);
+	double overdraw = milliseconds(start);
+
+	start = Benchmark::now();
+	vertexCount = optimizeVertexFetch(vertices, floats, indices);
+	double fetch = milliseconds(start);
+
+	MeshStats after = analyzeMesh(&indices[0], indices.size(), vertexCount, stride);
+	printStats("after", after, stride);
+	recordStats(report, name + "_after_", after, stride);
+
+	fprintf(stderr, "  ACMR %.3f after the cache pass, %zu clusters; dedup %.2f ms, cache %.2f ms, "
+			"overdraw %.2f ms, fetch %.2f ms\n", afterCache.acmr(), clusters.size(),
+			deduplicate, cache, overdraw, fetch);
+
+	report.record(name + "_dedup_ms", deduplicate);
+	report.record(name + "_cache_ms", cache);
+	report.record(name + "_overdraw_ms", overdraw);
+	report.record(name + "_fetch_ms", fetch);
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = argc > 1 ? argv[1] : "-";
+
+	Benchmark report;
+	report.setProperty("benchmark", "meshoptimize");
+	report.setProperty("vertex_cache_size", (double)kVertexCacheSize);
+	report.setProperty("fetch_cache_bytes", (double)(kFetchCacheLines * kFetchLineSize));
+
+	Random random(1);
+
+	MeshData grid;
+	gridMesh(512, &grid);
+	shuffleMesh(&grid, random);
+	run(report, "grid", grid);
+
+	MeshData soup;
+	gridMesh(512, &soup);
+	shuffleMesh(&soup, random);
+	soupMesh(&soup);
+	run(report, "soup", soup);
+
+	int status = 0;
+	for (int i = 2; i < argc; ++i) {
+		MeshData mesh;
+		if (!loadMesh(argv[i], &mesh)) {
+			status = 1;
+			continue;
+		}
+
+		std::string name(argv[i]);
+		size_t slash = name.find_last_of("/\\");
+		run(report, slash == std::string::npos ? name : name.substr(slash + 1), mesh);
+	}
+
+	if (strcmp(output, "-") == 0) {
+		report.writeJSON(stdout);
+		return status;
+	}
+
+	return report.writeJSON(output) ? status : 1;
+}
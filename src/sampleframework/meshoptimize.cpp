@@ -0,0 +1,390 @@
+#include "meshoptimize.hpp"
+
+#include <cmath>
+#include <cstring>
+
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+MeshStats analyzeMesh(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t vertexStride)
+{
+	MeshStats stats = {};
+	stats.triangles = indexCount / 3;
+
+	// A vertex or line is cached while fewer than the cache size entries
+	// came in after it, which is a FIFO without moving anything.
+	std::vector<size_t> cacheTime(vertexCount, 0);
+	size_t time = kVertexCacheSize + 1;
+
+	std::vector<size_t> lineTime((vertexCount * vertexStride + kFetchLineSize - 1) / kFetchLineSize, 0);
+	size_t fetchTime = kFetchCacheLines + 1;
+
+	std::vector<bool> used(vertexCount, false);
+
+	for (size_t i = 0; i < indexCount; ++i) {
+		uint32_t v = indices[i];
+		used[v] = true;
+
+		if (time - cacheTime[v] <= (size_t)kVertexCacheSize)
+			continue;
+
+		cacheTime[v] = time++;
+		++stats.transformed;
+
+		// Only vertices the shader runs for are fetched.
+		size_t first = v * vertexStride / kFetchLineSize;
+		size_t last = ((v + 1) * vertexStride - 1) / kFetchLineSize;
+		for (size_t line = first; line <= last; ++line) {
+			if (fetchTime - lineTime[line] > (size_t)kFetchCacheLines) {
+				lineTime[line] = fetchTime++;
+				stats.fetched += kFetchLineSize;
+			}
+		}
+	}
+
+	stats.vertices = (size_t)std::count(used.begin(), used.end(), true);
+	return stats;
+}
+
+MeshStats analyzeMesh(const MeshData& mesh, int level)
+{
+	const MeshLod& lod = mesh.lods[level];
+
+	return analyzeMesh(&mesh.indices[lod.firstIndex], lod.indexCount, lod.vertexCount,
+			meshVertexStride(mesh.attributes));
+}
+
+namespace {
+
+// Hashes and compares vertices by their bytes, by index into vertices.
+struct VertexKey
+{
+	const float* vertices;
+	size_t floatsPerVertex;
+
+	size_t operator()(uint32_t v) const
+	{
+		const float* vertex = vertices + v * floatsPerVertex;
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < floatsPerVertex; ++i) {
+			uint32_t bits;
+			memcpy(&bits, &vertex[i], sizeof(bits));
+			hash = (hash ^ bits) * 16777619u;
+		}
+		return hash ^ hash >> 15;
+	}
+
+	bool operator()(uint32_t a, uint32_t b) const
+	{
+		return memcmp(vertices + a * floatsPerVertex, vertices + b * floatsPerVertex,
+				floatsPerVertex * sizeof(float)) == 0;
+	}
+};
+
+} // namespace
+
+size_t deduplicateVertices(std::vector<float>& vertices, size_t floatsPerVertex,
+		std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	VertexKey key = { &vertices[0], floatsPerVertex };
+
+	std::unordered_map<uint32_t, uint32_t, VertexKey, VertexKey> unique(vertexCount, key, key);
+	std::vector<uint32_t> remap(vertexCount);
+	std::vector<float> merged;
+	merged.reserve(vertices.size());
+
+	for (size_t v = 0; v < vertexCount; ++v) {
+		auto inserted = unique.insert(std::make_pair((uint32_t)v, (uint32_t)(merged.size() / floatsPerVertex)));
+		if (inserted.second)
+			merged.insert(merged.end(), &vertices[v * floatsPerVertex], &vertices[(v + 1) * floatsPerVertex]);
+
+		remap[v] = inserted.first->second;
+	}
+
+	for (uint32_t& index : indices)
+		index = remap[index];
+
+	vertices.swap(merged);
+	return vertices.size() / floatsPerVertex;
+}
+
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+		std::vector<uint32_t>* clusters)
+{
+	size_t triangleCount = indexCount / 3;
+
+	// The triangles around every vertex, and how many of them are still to
+	// be emitted.
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (size_t i = 0; i < indexCount; ++i)
+		++live[indices[i]];
+
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v)
+		offsets[v + 1] = offsets[v] + live[v];
+
+	std::vector<uint32_t> adjacency(indexCount);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indexCount; ++i)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnds, candidates, output;
+	deadEnds.reserve(indexCount);
+	output.reserve(indexCount);
+
+	uint32_t time = kVertexCacheSize + 1;
+	size_t cursor = 0;
+	long fanning = -1;
+
+	for (;;) {
+		if (fanning < 0) {
+			// Back to the most recent vertex with triangles left, else the
+			// next one in input order.
+			while (!deadEnds.empty() && fanning < 0) {
+				uint32_t v = deadEnds.back();
+				deadEnds.pop_back();
+				if (live[v] > 0)
+					fanning = v;
+			}
+
+			while (cursor < vertexCount && fanning < 0) {
+				if (live[cursor] > 0)
+					fanning = (long)cursor;
+				else
+					++cursor;
+			}
+
+			if (fanning < 0)
+				break;
+
+			if (time - cacheTime[fanning] > (uint32_t)kVertexCacheSize)
+				clusters->push_back((uint32_t)(output.size() / 3));
+		}
+
+		// Every triangle left around the fanning vertex.
+		candidates.clear();
+		for (uint32_t k = offsets[fanning]; k < offsets[fanning + 1]; ++k) {
+			uint32_t t = adjacency[k];
+			if (emitted[t])
+				continue;
+
+			for (int c = 0; c < 3; ++c) {
+				uint32_t v = indices[3 * t + c];
+				output.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+
+				if (time - cacheTime[v] > (uint32_t)kVertexCacheSize)
+					cacheTime[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// The next one: the oldest candidate still in the cache after its
+		// remaining triangles went through it, else a dead end.
+		fanning = -1;
+		int best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= (uint32_t)kVertexCacheSize)
+				priority = (int)(time - cacheTime[v]);
+
+			if (priority > best) {
+				best = priority;
+				fanning = v;
+			}
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions,
+		size_t stride, const std::vector<uint32_t>& clusters, float threshold)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount == 0)
+		return;
+
+	uint32_t vertexCount = *std::max_element(indices, indices + indexCount) + 1;
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = kVertexCacheSize + 1;
+
+	// Cache misses of triangle t; moving time on by the cache size
+	// empties the cache.
+	auto misses = [&](size_t t) {
+		int count = 0;
+		for (int c = 0; c < 3; ++c) {
+			uint32_t v = indices[3 * t + c];
+			if (time - cacheTime[v] > (uint32_t)kVertexCacheSize) {
+				cacheTime[v] = time++;
+				++count;
+			}
+		}
+		return count;
+	};
+
+	std::vector<uint32_t> starts;
+	for (size_t h = 0; h < clusters.size(); ++h) {
+		size_t begin = clusters[h];
+		size_t end = h + 1 < clusters.size() ? clusters[h + 1] : triangleCount;
+
+		time += kVertexCacheSize + 1;
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; ++t)
+			clusterMisses += misses(t);
+
+		double limit = threshold * (double)clusterMisses / (end - begin);
+
+		time += kVertexCacheSize + 1;
+		starts.push_back((uint32_t)begin);
+
+		size_t start = begin, softMisses = 0;
+		for (size_t t = begin; t + 1 < end; ++t) {
+			softMisses += misses(t);
+
+			if (softMisses <= limit * (t + 1 - start)) {
+				starts.push_back((uint32_t)(t + 1));
+				start = t + 1;
+				softMisses = 0;
+				time += kVertexCacheSize + 1;
+			}
+		}
+	}
+
+	// Area weighted centroids and normals of the clusters and the mesh.
+	struct Cluster
+	{
+		uint32_t begin, end;
+		float centroid[3], normal[3];
+		float sortKey;
+	};
+
+	std::vector<Cluster> sorted(starts.size());
+	float meshCentroid[3] = {}, meshArea = 0.0f;
+
+	for (size_t c = 0; c < starts.size(); ++c) {
+		Cluster& cluster = sorted[c];
+		cluster.begin = starts[c];
+		cluster.end = c + 1 < starts.size() ? starts[c + 1] : (uint32_t)triangleCount;
+
+		float area = 0.0f;
+		for (int k = 0; k < 3; ++k)
+			cluster.centroid[k] = cluster.normal[k] = 0.0f;
+
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			const float* a = positions + indices[3 * t] * stride;
+			const float* b = positions + indices[3 * t + 1] * stride;
+			const float* d = positions + indices[3 * t + 2] * stride;
+
+			float e1[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+			float e2[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+			float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+			float twiceArea = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+			for (int k = 0; k < 3; ++k) {
+				cluster.centroid[k] += (a[k] + b[k] + d[k]) / 3.0f * twiceArea;
+				cluster.normal[k] += n[k];
+			}
+			area += twiceArea;
+		}
+
+		for (int k = 0; k < 3; ++k) {
+			meshCentroid[k] += cluster.centroid[k];
+			if (area > 0.0f)
+				cluster.centroid[k] /= area;
+		}
+		meshArea += area;
+	}
+
+	for (int k = 0; k < 3; ++k) {
+		if (meshArea > 0.0f)
+			meshCentroid[k] /= meshArea;
+	}
+
+	for (Cluster& cluster : sorted) {
+		float length = std::sqrt(cluster.normal[0] * cluster.normal[0] +
+				cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+		cluster.sortKey = 0.0f;
+		for (int k = 0; k < 3; ++k) {
+			if (length > 0.0f)
+				cluster.sortKey += (cluster.centroid[k] - meshCentroid[k]) * cluster.normal[k] / length;
+		}
+	}
+
+	std::stable_sort(sorted.begin(), sorted.end(), [](const Cluster& a, const Cluster& b) {
+		return a.sortKey > b.sortKey;
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(indexCount);
+	for (const Cluster& cluster : sorted)
+		output.insert(output.end(), indices + 3 * cluster.begin, indices + 3 * cluster.end);
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+size_t optimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex,
+		std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	std::vector<uint32_t> remap(vertexCount, UINT32_MAX);
+	std::vector<float> reordered;
+	reordered.reserve(vertices.size());
+
+	for (uint32_t& index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = (uint32_t)(reordered.size() / floatsPerVertex);
+			reordered.insert(reordered.end(), &vertices[index * floatsPerVertex],
+					&vertices[(index + 1) * floatsPerVertex]);
+		}
+
+		index = remap[index];
+	}
+
+	vertices.swap(reordered);
+	return vertices.size() / floatsPerVertex;
+}
+
+void optimizeMesh(MeshData* mesh, float overdrawThreshold)
+{
+	size_t floatsPerVertex = meshVertexStride(mesh->attributes) / sizeof(float);
+
+	MeshData optimized;
+	optimized.attributes = mesh->attributes;
+
+	for (const MeshLod& lod : mesh->lods) {
+		MeshData level;
+		level.attributes = mesh->attributes;
+		level.vertices.assign(mesh->vertices.begin() + lod.baseVertex * floatsPerVertex,
+				mesh->vertices.begin() + (lod.baseVertex + lod.vertexCount) * floatsPerVertex);
+		level.indices.assign(mesh->indices.begin() + lod.firstIndex,
+				mesh->indices.begin() + lod.firstIndex + lod.indexCount);
+
+		if (!level.indices.empty()) {
+			size_t vertexCount = deduplicateVertices(level.vertices, floatsPerVertex, level.indices);
+
+			std::vector<uint32_t> clusters;
+			optimizeVertexCache(&level.indices[0], level.indices.size(), vertexCount, &clusters);
+			optimizeOverdraw(&level.indices[0], level.indices.size(), &level.vertices[0],
+					floatsPerVertex, clusters, overdrawThreshold);
+
+			optimizeVertexFetch(level.vertices, floatsPerVertex, level.indices);
+		}
+
+		level.lods.assign(1, lod);
+		appendMeshLod(&optimized, level, lod.distance);
+	}
+
+	*mesh = optimized;
+}
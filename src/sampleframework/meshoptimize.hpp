@@ -0,0 +1,75 @@
+#ifndef MESHOPTIMIZE_H_
+#define MESHOPTIMIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+
+#include <vector>
+
+#include "meshimport.hpp"
+
+// Entries of the post-transform vertex cache the optimizer targets and the
+// analysis simulates, as a FIFO; small enough to hold on every GPU.
+static const int kVertexCacheSize = 16;
+
+// Cache lines and their size of the simulated vertex fetch cache.
+static const int kFetchCacheLines = 64;
+static const int kFetchLineSize = 64;
+
+// How an index buffer uses the caches.
+struct MeshStats
+{
+	size_t triangles;
+	size_t vertices;
+
+	// Vertex shader runs: misses in a kVertexCacheSize FIFO.
+	size_t transformed;
+	// Bytes read from the vertex buffer through the fetch cache.
+	size_t fetched;
+
+	// Transformed per triangle (0.5 at best on a regular grid, 3 at
+	// worst), transformed per vertex (1 at best), and fetched bytes per
+	// vertex byte (1 at best).
+	double acmr() const { return triangles ? (double)transformed / triangles : 0.0; }
+	double atvr() const { return vertices ? (double)transformed / vertices : 0.0; }
+	double overfetch(size_t vertexStride) const
+	{
+		return vertices ? (double)fetched / (vertices * vertexStride) : 0.0;
+	}
+};
+
+MeshStats analyzeMesh(const uint32_t* indices, size_t indexCount, size_t vertexCount,
+		size_t vertexStride);
+
+// Level of detail level of mesh.
+MeshStats analyzeMesh(const MeshData& mesh, int level);
+
+// Merges bit-identical vertices, rewriting indices, and returns how many
+// vertices are left. floatsPerVertex floats per vertex.
+size_t deduplicateVertices(std::vector<float>& vertices, size_t floatsPerVertex,
+		std::vector<uint32_t>& indices);
+
+// Reorders triangles for the post-transform cache with Tipsify (Sander,
+// Nehab and Barczak, "Fast Triangle Reordering for Vertex Locality and
+// Reduced Overdraw", 2007). Appends to clusters the first triangle of each
+// run that starts from a cold cache, for optimizeOverdraw().
+void optimizeVertexCache(uint32_t* indices, size_t indexCount, size_t vertexCount,
+		std::vector<uint32_t>* clusters);
+
+// Splits the clusters of optimizeVertexCache() further wherever doing so
+// costs at most threshold times the cluster's ACMR, then draws the
+// clusters facing out from the middle of the mesh first, so they occlude
+// the rest. positions are three floats, stride floats apart.
+void optimizeOverdraw(uint32_t* indices, size_t indexCount, const float* positions,
+		size_t stride, const std::vector<uint32_t>& clusters, float threshold);
+
+// Renumbers the vertices in the order the indices first use them and
+// moves them to match, so fetches walk the vertex buffer forwards; drops
+// unused vertices and returns how many are left.
+size_t optimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex,
+		std::vector<uint32_t>& indices);
+
+// All of the above on every level of detail of mesh, in order.
+void optimizeMesh(MeshData* mesh, float overdrawThreshold = 1.05f);
+
+#endif // MESHOPTIMIZE_H_
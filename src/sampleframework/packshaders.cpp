@@ -0,0 +1,115 @@
+// Packs a sample's shaders into the .pack file it maps at startup (see
+// shaderpack.hpp), each under its file name. --embed writes the pack as a
+// C++ source defining g_shaderPack and g_shaderPackSize instead, for
+// building into the sample with SAMPLE_SHADER_PACK_EMBEDDED.
+//
+//	packshaders [--embed] -o shaders.pack|shaderpack-embed.cpp shader.vert shader.frag ...
+
+#include "shaderpack.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+#include <string>
+#include <vector>
+
+static int usage()
+{
+	fprintf(stderr, "usage: packshaders [--embed] -o out.pack|out.cpp shader ...\n");
+	return 1;
+}
+
+static bool writeFile(const char* path, const void* data, size_t size)
+{
+	FILE* file = fopen(path, "wb");
+	if (!file) {
+		fprintf(stderr, "Error: cannot write %s\n", path);
+		return false;
+	}
+
+	bool written = fwrite(data, 1, size, file) == size;
+	written = fclose(file) == 0 && written;
+	if (!written)
+		fprintf(stderr, "Error: cannot write %s\n", path);
+
+	return written;
+}
+
+// The pack as an array of 16 bytes a line; aligned so the header and the
+// table can be read in place, as from a mapping.
+static std::string embeddedSource(const std::vector<unsigned char>& pack)
+{
+	std::string source =
+		"// Generated by packshaders --embed.\n"
+		"#include <cstddef>\n"
+		"\n"
+		"extern const unsigned char g_shaderPack[];\n"
+		"extern const size_t g_shaderPackSize;\n"
+		"\n"
+		"alignas(16) const unsigned char g_shaderPack[] = {\n";
+
+	char number[8];
+	for (size_t i = 0; i < pack.size(); ++i) {
+		snprintf(number, sizeof(number), "%u,", pack[i]);
+		source += i % 16 == 0 ? "\t" : " ";
+		source += number;
+		if (i % 16 == 15 || i + 1 == pack.size())
+			source += "\n";
+	}
+
+	char size[64];
+	snprintf(size, sizeof(size), "};\n\nconst size_t g_shaderPackSize = %zu;\n", pack.size());
+	return source + size;
+}
+
+int main(int argc, char** argv)
+{
+	const char* output = nullptr;
+	bool embed = false;
+
+	std::vector<std::string> names;
+	std::vector<std::string> sources;
+
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			output = argv[++i];
+		}
+		else if (strcmp(argv[i], "--embed") == 0) {
+			embed = true;
+		}
+		else if (argv[i][0] == '-') {
+			return usage();
+		}
+		else {
+			std::string source;
+			if (!ShaderSource::readFile(argv[i], &source)) {
+				fprintf(stderr, "Error: cannot read %s\n", argv[i]);
+				return 1;
+			}
+
+			std::string name(argv[i]);
+			size_t slash = name.find_last_of("/\\");
+			names.push_back(slash == std::string::npos ? name : name.substr(slash + 1));
+			sources.push_back(source);
+		}
+	}
+
+	if (!output || names.empty())
+		return usage();
+
+	std::vector<unsigned char> pack;
+	if (!buildShaderPack(names, sources, &pack))
+		return 1;
+
+	if (embed) {
+		std::string source = embeddedSource(pack);
+		if (!writeFile(output, source.data(), source.size()))
+			return 1;
+	}
+	else if (!writeFile(output, &pack[0], pack.size())) {
+		return 1;
+	}
+
+	fprintf(stderr, "%s: %zu shaders, %zu bytes\n", output, names.size(), pack.size());
+	return 0;
+}
@@ -52,7 +52,16 @@ int main(int argc, char** argv)
 	}
 
 	helloSample = new HelloSample();
-	helloSample->init();
+	if (!helloSample->parseArguments(argc, argv)) {
+		delete helloSample;
+		return EXIT_FAILURE;
+	}
+
+	if (!helloSample->init()) {
+		helloSample->destroy();
+		delete helloSample;
+		return EXIT_FAILURE;
+	}
 
 	helloSample->run();
 
@@ -0,0 +1,308 @@
+#include "shaderreload.hpp"
+#include "sample.hpp"
+#include "shaderpack.hpp"
+#include "trace.hpp"
+
+#include <cerrno>
+#include <cstdio>
+
+#include <GL/glew.h>
+
+#include "shader.hpp"
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+	// Editors save in several steps (write, rename, chmod); a change is
+	// only built once the files have been quiet for this long.
+	const int kSettleMilliseconds = 50;
+
+	// Watched by directory, since saving through a rename replaces the
+	// file a watch of its own would follow.
+	std::string directoryOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of('/');
+		if (slash == std::string::npos)
+			return ".";
+
+		return slash == 0 ? "/" : path.substr(0, slash);
+	}
+
+	std::string fileOf(const std::string& path)
+	{
+		size_t slash = path.find_last_of('/');
+		return slash == std::string::npos ? path : path.substr(slash + 1);
+	}
+}
+
+ShaderReloader::ShaderReloader()
+	: _notify(-1), _reloads(0), _failures(0)
+{
+	_wakeUp[0] = _wakeUp[1] = -1;
+}
+
+ShaderReloader::~ShaderReloader()
+{
+	stop();
+}
+
+int ShaderReloader::watch(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines,
+		const char* vertexHeader)
+{
+	Slot slot;
+	slot.vertexPath = vertexPath;
+	slot.fragmentPath = fragmentPath;
+	slot.vertexHeader = vertexHeader ? vertexHeader : "";
+	slot.defines = defines;
+	_slots.push_back(slot);
+
+	return (int)_slots.size() - 1;
+}
+
+bool ShaderReloader::start(Sample* sample)
+{
+#ifdef __linux__
+	if (running())
+		return true;
+
+	_notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (_notify < 0 || pipe(_wakeUp) != 0) {
+		fprintf(stderr, "Error: cannot start watching shader files\n");
+		stop();
+		return false;
+	}
+
+	// The edits are to the files, so sources come from those from now on.
+	ShaderSource::setPack(nullptr);
+
+	for (Slot& slot : _slots) {
+		if (!watchFiles(slot)) {
+			stop();
+			return false;
+		}
+	}
+
+	if (!sample->createSharedContext()) {
+		stop();
+		return false;
+	}
+
+	_thread = std::thread(&ShaderReloader::threadMain, this, sample);
+	return true;
+#else
+	(void)sample;
+	fprintf(stderr, "Error: shader reload needs inotify, which only Linux has\n");
+	return false;
+#endif
+}
+
+void ShaderReloader::stop()
+{
+#ifdef __linux__
+	if (running()) {
+		if (write(_wakeUp[1], "", 1) != 1)
+			fprintf(stderr, "Error: cannot wake the shader reload thread\n");
+		_thread.join();
+	}
+
+	if (_notify >= 0)
+		close(_notify);
+	for (int i = 0; i < 2; ++i) {
+		if (_wakeUp[i] >= 0)
+			close(_wakeUp[i]);
+	}
+#endif
+
+	_notify = -1;
+	_wakeUp[0] = _wakeUp[1] = -1;
+
+	for (Slot& slot : _slots) {
+		slot.files.clear();
+		slot.watches.clear();
+
+		if (slot.program) {
+			glDeleteProgram(slot.program);
+			glDeleteSync((GLsync)slot.fence);
+		}
+		slot.program = 0;
+		slot.fence = nullptr;
+	}
+}
+
+unsigned int ShaderReloader::takeProgram(int index)
+{
+	// Held by the reload thread only while it hands a program over; rather
+	// than wait for that, look again next frame.
+	std::unique_lock<std::mutex> lock(_mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return 0;
+
+	Slot& slot = _slots[index];
+	if (!slot.program)
+		return 0;
+
+	// Flushed on the reload thread already, so this only polls.
+	if (glClientWaitSync((GLsync)slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		return 0;
+
+	GLuint program = slot.program;
+	glDeleteSync((GLsync)slot.fence);
+	slot.program = 0;
+	slot.fence = nullptr;
+
+	++_reloads;
+	return program;
+}
+
+void ShaderReloader::threadMain(Sample* sample)
+{
+	if (Trace::enabled())
+		Trace::setThreadName("shader reload");
+
+	if (!sample->makeSharedContextCurrent(true)) {
+		fprintf(stderr, "Error: cannot make the shared context current, shaders will not reload\n");
+		return;
+	}
+
+	while (waitForChanges()) {
+		for (Slot& slot : _slots) {
+			if (slot.dirty)
+				rebuild(slot);
+			slot.dirty = false;
+		}
+	}
+
+	sample->makeSharedContextCurrent(false);
+}
+
+// Blocks until a watched file has changed and settled, true, or stop()
+// was called, false.
+bool ShaderReloader::waitForChanges()
+{
+#ifdef __linux__
+	bool changed = false;
+
+	for (;;) {
+		pollfd descriptors[2] = {
+			{ _notify, POLLIN, 0 },
+			{ _wakeUp[0], POLLIN, 0 },
+		};
+
+		int ready = poll(descriptors, 2, changed ? kSettleMilliseconds : -1);
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready < 0 || descriptors[1].revents)
+			return false;
+		if (ready == 0)
+			return true;
+
+		alignas(inotify_event) char events[4096];
+		ssize_t length;
+		while ((length = read(_notify, events, sizeof(events))) > 0) {
+			for (ssize_t offset = 0; offset < length; ) {
+				const inotify_event* event = (const inotify_event*)(events + offset);
+				offset += sizeof(inotify_event) + event->len;
+
+				if (event->len == 0)
+					continue;
+
+				for (Slot& slot : _slots) {
+					for (size_t i = 0; i < slot.files.size(); ++i) {
+						if (slot.watches[i] == event->wd && fileOf(slot.files[i]) == event->name) {
+							slot.dirty = true;
+							changed = true;
+						}
+					}
+				}
+			}
+		}
+	}
+#else
+	return false;
+#endif
+}
+
+void ShaderReloader::rebuild(Slot& slot)
+{
+	TRACE_ZONE("ShaderReloader::rebuild");
+
+	GLuint program = 0;
+	{
+		ShaderBatch batch;
+		program = batch.program(batch.add(slot.vertexPath.c_str(), slot.fragmentPath.c_str(),
+					slot.defines, slot.vertexHeader.c_str()));
+	}
+
+	// The edit may have changed what the shaders include.
+	watchFiles(slot);
+
+	GLint linked = GL_FALSE;
+	if (program)
+		glGetProgramiv(program, GL_LINK_STATUS, &linked);
+
+	if (!linked) {
+		if (program)
+			glDeleteProgram(program);
+
+		++_failures;
+		fprintf(stderr, "Error: %s and %s did not build, keeping the running program\n",
+				slot.vertexPath.c_str(), slot.fragmentPath.c_str());
+		return;
+	}
+
+	// Another context may only use the program once the GPU is done with
+	// the commands that built it.
+	GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	glFlush();
+
+	std::lock_guard<std::mutex> lock(_mutex);
+
+	// Changed again before the render thread took the last one.
+	if (slot.program) {
+		glDeleteProgram(slot.program);
+		glDeleteSync((GLsync)slot.fence);
+	}
+
+	slot.program = program;
+	slot.fence = fence;
+
+	fprintf(stderr, "Rebuilt %s and %s\n", slot.vertexPath.c_str(), slot.fragmentPath.c_str());
+}
+
+// The files of both shaders, a watch for each; gathered through the
+// preprocessor, so a file the shaders stopped including no longer counts.
+// Keeps the last ones when a directory cannot be watched.
+bool ShaderReloader::watchFiles(Slot& slot)
+{
+#ifdef __linux__
+	std::vector<std::string> files, fragmentFiles;
+	std::string source;
+	preprocessShader(slot.vertexPath.c_str(), slot.defines, slot.vertexHeader.c_str(), &source, &files);
+	preprocessShader(slot.fragmentPath.c_str(), slot.defines, nullptr, &source, &fragmentFiles);
+	files.insert(files.end(), fragmentFiles.begin(), fragmentFiles.end());
+
+	std::vector<int> watches;
+	for (const std::string& file : files) {
+		// The same directory twice gives the same watch back.
+		int watch = inotify_add_watch(_notify, directoryOf(file).c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+		if (watch < 0) {
+			fprintf(stderr, "Error: cannot watch %s\n", file.c_str());
+			return false;
+		}
+
+		watches.push_back(watch);
+	}
+
+	slot.files.swap(files);
+	slot.watches.swap(watches);
+	return true;
+#else
+	(void)slot;
+	return false;
+#endif
+}
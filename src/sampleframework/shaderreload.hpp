@@ -0,0 +1,93 @@
+#ifndef SHADERRELOAD_H_
+#define SHADERRELOAD_H_
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shaderpreprocessor.hpp"
+
+class Sample;
+
+// Builds programs again when their shader files change, so content.frag or
+// instancing.vert can be edited while the sample runs. A thread of its own
+// waits on inotify for the files, or any file they #include, to be
+// written, rebuilds the program with
+// ShaderBatch on the sample's shared context and, when it links, leaves it
+// for the render thread to pick up with takeProgram() at the start of a
+// frame. A program that fails to build keeps the old one running; its log
+// goes to stdout, as LoadShaders() prints it. Once started, sources come
+// from the files even where a shader pack has them.
+//
+// Needs inotify, so Linux; start() fails anywhere else.
+class ShaderReloader
+{
+public:
+	ShaderReloader();
+	~ShaderReloader();
+
+	ShaderReloader(const ShaderReloader&) = delete;
+	ShaderReloader& operator=(const ShaderReloader&) = delete;
+
+	// Before start(). Takes what ShaderBatch::add() does; the slot for
+	// takeProgram().
+	int watch(const char* vertexPath, const char* fragmentPath, const ShaderDefines& defines,
+			const char* vertexHeader = nullptr);
+
+	// Creates the sample's shared context and starts the thread.
+	bool start(Sample* sample);
+
+	// Needs the sample's context current, for the programs nobody took.
+	void stop();
+
+	bool running() const { return _thread.joinable(); }
+
+	// Never waits: the program rebuilt for slot since the last call, once
+	// the GPU is done building it, or 0. The caller owns it and deletes
+	// the one it replaces.
+	unsigned int takeProgram(int slot);
+
+	// Rebuilds handed to takeProgram() and rebuilds that did not link.
+	int reloads() const { return _reloads; }
+	int failures() const { return _failures.load(); }
+
+private:
+	struct Slot
+	{
+		Slot() : dirty(false), program(0), fence(nullptr) {}
+
+		std::string vertexPath;
+		std::string fragmentPath;
+		std::string vertexHeader;
+		ShaderDefines defines;
+		bool dirty;
+
+		// Both shaders and what they include, as of the last build, and
+		// the watch of each one's directory.
+		std::vector<std::string> files;
+		std::vector<int> watches;
+
+		// Linked on the reload thread and not taken yet; under _mutex.
+		unsigned int program;
+		void* fence;
+	};
+
+	void threadMain(Sample* sample);
+	bool waitForChanges();
+	void rebuild(Slot& slot);
+	bool watchFiles(Slot& slot);
+
+	std::vector<Slot> _slots;
+	std::mutex _mutex;
+	std::thread _thread;
+
+	int _notify;
+	int _wakeUp[2];
+
+	int _reloads;
+	std::atomic<int> _failures;
+};
+
+#endif // SHADERRELOAD_H_
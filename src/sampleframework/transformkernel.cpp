@@ -0,0 +1,418 @@
+#include "transformkernel.hpp"
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define TRANSFORM_KERNEL_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// GCC and Clang need the instruction set enabled per function so the rest
+// of the program keeps running on CPUs without it; MSVC always allows them.
+#if defined(TRANSFORM_KERNEL_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TRANSFORM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define TRANSFORM_TARGET(isa)
+#endif
+
+// The nine rotation-scale terms (column, row) of one instance.
+struct Basis
+{
+	float c0x, c0y, c0z;
+	float c1x, c1y, c1z;
+	float c2x, c2y, c2z;
+};
+
+static inline Basis scalarBasis(const InstanceTransforms& instances, float angle, size_t i)
+{
+	float scale = instances.scale ? instances.scale[i] : 1.0f;
+	Basis basis;
+
+	if (instances.qx) {
+		float x = instances.qx[i], y = instances.qy[i], z = instances.qz[i], w = instances.qw[i];
+
+		basis.c0x = (1.0f - 2.0f * (y * y + z * z)) * scale;
+		basis.c0y = 2.0f * (x * y + w * z) * scale;
+		basis.c0z = 2.0f * (x * z - w * y) * scale;
+		basis.c1x = 2.0f * (x * y - w * z) * scale;
+		basis.c1y = (1.0f - 2.0f * (x * x + z * z)) * scale;
+		basis.c1z = 2.0f * (y * z + w * x) * scale;
+		basis.c2x = 2.0f * (x * z + w * y) * scale;
+		basis.c2y = 2.0f * (y * z - w * x) * scale;
+		basis.c2z = (1.0f - 2.0f * (x * x + y * y)) * scale;
+	}
+	else {
+		float a = instances.angle ? angle + instances.angle[i] : angle;
+		float c = std::cos(a) * scale, s = std::sin(a) * scale;
+
+		// Same layout as glm::rotate(a, vec3(0, 1, 0)).
+		basis.c0x = c;		basis.c0y = 0.0f;	basis.c0z = -s;
+		basis.c1x = 0.0f;	basis.c1y = scale;	basis.c1z = 0.0f;
+		basis.c2x = s;		basis.c2y = 0.0f;	basis.c2z = c;
+	}
+
+	return basis;
+}
+
+static void buildTransformsScalar(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out)
+{
+	for (size_t i = begin; i < end; ++i) {
+		Basis b = scalarBasis(instances, angle, i);
+		float* m = out + 16 * i;
+
+		m[0] = b.c0x;	m[1] = b.c0y;	m[2] = b.c0z;	m[3] = 0.0f;
+		m[4] = b.c1x;	m[5] = b.c1y;	m[6] = b.c1z;	m[7] = 0.0f;
+		m[8] = b.c2x;	m[9] = b.c2y;	m[10] = b.c2z;	m[11] = 0.0f;
+		m[12] = instances.x[i];	m[13] = instances.y[i];	m[14] = instances.z[i];	m[15] = 1.0f;
+	}
+}
+
+#ifdef TRANSFORM_KERNEL_X86
+
+// Cephes single precision sincos, the range reduction and polynomials used
+// by most SIMD math libraries; accurate to a few ulp for |x| < 8192.
+#define SINCOS_CONSTANTS \
+	const float kFourOverPi = 1.27323954473516f; \
+	const float kDP1 = 0.78515625f; \
+	const float kDP2 = 2.4187564849853515625e-4f; \
+	const float kDP3 = 3.77489497744594108e-8f; \
+	const float kSin0 = -1.9515295891e-4f, kSin1 = 8.3321608736e-3f, kSin2 = -1.6666654611e-1f; \
+	const float kCos0 = 2.443315711809948e-5f, kCos1 = -1.388731625493765e-3f, kCos2 = 4.166664568298827e-2f;
+
+TRANSFORM_TARGET("sse4.1")
+static inline void sincos4(__m128 x, __m128& sine, __m128& cosine)
+{
+	SINCOS_CONSTANTS
+
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+
+	__m128 signSin = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(kFourOverPi)));
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(j);
+
+	__m128 swapSignSin = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+	__m128 signCos = _mm_castsi128_ps(_mm_slli_epi32(
+				_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	__m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(
+				_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP1)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP2)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(kDP3)));
+
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 polyCos = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(kCos0), z), _mm_set1_ps(kCos1));
+	polyCos = _mm_add_ps(_mm_mul_ps(polyCos, z), _mm_set1_ps(kCos2));
+	polyCos = _mm_mul_ps(_mm_mul_ps(polyCos, z), z);
+	polyCos = _mm_sub_ps(polyCos, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	polyCos = _mm_add_ps(polyCos, _mm_set1_ps(1.0f));
+
+	__m128 polySin = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(kSin0), z), _mm_set1_ps(kSin1));
+	polySin = _mm_add_ps(_mm_mul_ps(polySin, z), _mm_set1_ps(kSin2));
+	polySin = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(polySin, z), x), x);
+
+	sine = _mm_blendv_ps(polyCos, polySin, polyMask);
+	cosine = _mm_blendv_ps(polySin, polyCos, polyMask);
+
+	sine = _mm_xor_ps(sine, _mm_xor_ps(signSin, swapSignSin));
+	cosine = _mm_xor_ps(cosine, signCos);
+}
+
+TRANSFORM_TARGET("avx2")
+static inline void sincos8(__m256 x, __m256& sine, __m256& cosine)
+{
+	SINCOS_CONSTANTS
+
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+
+	__m256 signSin = _mm256_and_ps(x, signMask);
+	x = _mm256_andnot_ps(signMask, x);
+
+	__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(kFourOverPi)));
+	j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+	__m256 y = _mm256_cvtepi32_ps(j);
+
+	__m256 swapSignSin = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+	__m256 signCos = _mm256_castsi256_ps(_mm256_slli_epi32(
+				_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+	__m256 polyMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+				_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kDP1)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kDP2)));
+	x = _mm256_sub_ps(x, _mm256_mul_ps(y, _mm256_set1_ps(kDP3)));
+
+	__m256 z = _mm256_mul_ps(x, x);
+
+	__m256 polyCos = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(kCos0), z), _mm256_set1_ps(kCos1));
+	polyCos = _mm256_add_ps(_mm256_mul_ps(polyCos, z), _mm256_set1_ps(kCos2));
+	polyCos = _mm256_mul_ps(_mm256_mul_ps(polyCos, z), z);
+	polyCos = _mm256_sub_ps(polyCos, _mm256_mul_ps(z, _mm256_set1_ps(0.5f)));
+	polyCos = _mm256_add_ps(polyCos, _mm256_set1_ps(1.0f));
+
+	__m256 polySin = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(kSin0), z), _mm256_set1_ps(kSin1));
+	polySin = _mm256_add_ps(_mm256_mul_ps(polySin, z), _mm256_set1_ps(kSin2));
+	polySin = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(polySin, z), x), x);
+
+	sine = _mm256_blendv_ps(polyCos, polySin, polyMask);
+	cosine = _mm256_blendv_ps(polySin, polyCos, polyMask);
+
+	sine = _mm256_xor_ps(sine, _mm256_xor_ps(signSin, swapSignSin));
+	cosine = _mm256_xor_ps(cosine, signCos);
+}
+
+// Transposes the terms of four instances into four column-major matrices.
+TRANSFORM_TARGET("sse4.1")
+static inline void storeTransforms4(float* out,
+		__m128 c0x, __m128 c0y, __m128 c0z,
+		__m128 c1x, __m128 c1y, __m128 c1z,
+		__m128 c2x, __m128 c2y, __m128 c2z,
+		__m128 px, __m128 py, __m128 pz, bool nonTemporal)
+{
+	__m128 zero = _mm_setzero_ps();
+	__m128 one = _mm_set1_ps(1.0f);
+
+	__m128 c0w = zero, c1w = zero, c2w = zero, pw = one;
+
+	_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+	_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+	_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+	_MM_TRANSPOSE4_PS(px, py, pz, pw);
+
+	// After transposing, the n-th register of every group is instance n.
+	__m128 columns[16] = {
+		c0x, c1x, c2x, px,
+		c0y, c1y, c2y, py,
+		c0z, c1z, c2z, pz,
+		c0w, c1w, c2w, pw,
+	};
+
+	if (nonTemporal) {
+		for (int i = 0; i < 16; ++i)
+			_mm_stream_ps(out + 4 * i, columns[i]);
+	}
+	else {
+		for (int i = 0; i < 16; ++i)
+			_mm_storeu_ps(out + 4 * i, columns[i]);
+	}
+}
+
+TRANSFORM_TARGET("sse4.1")
+static void buildTransformsSSE41(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out, bool nonTemporal)
+{
+	size_t i = begin;
+
+	for (; i + 4 <= end; i += 4) {
+		__m128 scale = instances.scale ? _mm_loadu_ps(instances.scale + i) : _mm_set1_ps(1.0f);
+		__m128 c0x, c0y, c0z, c1x, c1y, c1z, c2x, c2y, c2z;
+
+		if (instances.qx) {
+			__m128 x = _mm_loadu_ps(instances.qx + i), y = _mm_loadu_ps(instances.qy + i);
+			__m128 z = _mm_loadu_ps(instances.qz + i), w = _mm_loadu_ps(instances.qw + i);
+			__m128 two = _mm_add_ps(scale, scale);
+
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+			c0x = _mm_sub_ps(scale, _mm_mul_ps(two, _mm_add_ps(yy, zz)));
+			c0y = _mm_mul_ps(two, _mm_add_ps(xy, wz));
+			c0z = _mm_mul_ps(two, _mm_sub_ps(xz, wy));
+			c1x = _mm_mul_ps(two, _mm_sub_ps(xy, wz));
+			c1y = _mm_sub_ps(scale, _mm_mul_ps(two, _mm_add_ps(xx, zz)));
+			c1z = _mm_mul_ps(two, _mm_add_ps(yz, wx));
+			c2x = _mm_mul_ps(two, _mm_add_ps(xz, wy));
+			c2y = _mm_mul_ps(two, _mm_sub_ps(yz, wx));
+			c2z = _mm_sub_ps(scale, _mm_mul_ps(two, _mm_add_ps(xx, yy)));
+		}
+		else {
+			__m128 a = _mm_set1_ps(angle);
+			if (instances.angle)
+				a = _mm_add_ps(a, _mm_loadu_ps(instances.angle + i));
+
+			__m128 s, c;
+			sincos4(a, s, c);
+
+			__m128 zero = _mm_setzero_ps();
+
+			c0x = _mm_mul_ps(c, scale);		c0y = zero;		c0z = _mm_sub_ps(zero, _mm_mul_ps(s, scale));
+			c1x = zero;						c1y = scale;	c1z = zero;
+			c2x = _mm_mul_ps(s, scale);		c2y = zero;		c2z = _mm_mul_ps(c, scale);
+		}
+
+		storeTransforms4(out + 16 * i, c0x, c0y, c0z, c1x, c1y, c1z, c2x, c2y, c2z,
+				_mm_loadu_ps(instances.x + i), _mm_loadu_ps(instances.y + i),
+				_mm_loadu_ps(instances.z + i), nonTemporal);
+	}
+
+	if (nonTemporal)
+		_mm_sfence();
+
+	buildTransformsScalar(instances, angle, i, end, out);
+}
+
+TRANSFORM_TARGET("avx2")
+static void buildTransformsAVX2(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out, bool nonTemporal)
+{
+	size_t i = begin;
+
+	for (; i + 8 <= end; i += 8) {
+		__m256 scale = instances.scale ? _mm256_loadu_ps(instances.scale + i) : _mm256_set1_ps(1.0f);
+		__m256 c[9];
+
+		if (instances.qx) {
+			__m256 x = _mm256_loadu_ps(instances.qx + i), y = _mm256_loadu_ps(instances.qy + i);
+			__m256 z = _mm256_loadu_ps(instances.qz + i), w = _mm256_loadu_ps(instances.qw + i);
+			__m256 two = _mm256_add_ps(scale, scale);
+
+			__m256 xx = _mm256_mul_ps(x, x), yy = _mm256_mul_ps(y, y), zz = _mm256_mul_ps(z, z);
+			__m256 xy = _mm256_mul_ps(x, y), xz = _mm256_mul_ps(x, z), yz = _mm256_mul_ps(y, z);
+			__m256 wx = _mm256_mul_ps(w, x), wy = _mm256_mul_ps(w, y), wz = _mm256_mul_ps(w, z);
+
+			c[0] = _mm256_sub_ps(scale, _mm256_mul_ps(two, _mm256_add_ps(yy, zz)));
+			c[1] = _mm256_mul_ps(two, _mm256_add_ps(xy, wz));
+			c[2] = _mm256_mul_ps(two, _mm256_sub_ps(xz, wy));
+			c[3] = _mm256_mul_ps(two, _mm256_sub_ps(xy, wz));
+			c[4] = _mm256_sub_ps(scale, _mm256_mul_ps(two, _mm256_add_ps(xx, zz)));
+			c[5] = _mm256_mul_ps(two, _mm256_add_ps(yz, wx));
+			c[6] = _mm256_mul_ps(two, _mm256_add_ps(xz, wy));
+			c[7] = _mm256_mul_ps(two, _mm256_sub_ps(yz, wx));
+			c[8] = _mm256_sub_ps(scale, _mm256_mul_ps(two, _mm256_add_ps(xx, yy)));
+		}
+		else {
+			__m256 a = _mm256_set1_ps(angle);
+			if (instances.angle)
+				a = _mm256_add_ps(a, _mm256_loadu_ps(instances.angle + i));
+
+			__m256 s, co;
+			sincos8(a, s, co);
+
+			__m256 zero = _mm256_setzero_ps();
+
+			c[0] = _mm256_mul_ps(co, scale);	c[1] = zero;	c[2] = _mm256_sub_ps(zero, _mm256_mul_ps(s, scale));
+			c[3] = zero;						c[4] = scale;	c[5] = zero;
+			c[6] = _mm256_mul_ps(s, scale);		c[7] = zero;	c[8] = _mm256_mul_ps(co, scale);
+		}
+
+		__m256 px = _mm256_loadu_ps(instances.x + i);
+		__m256 py = _mm256_loadu_ps(instances.y + i);
+		__m256 pz = _mm256_loadu_ps(instances.z + i);
+
+		// The math ran eight wide; the transposing stores go four at a time.
+		for (int half = 0; half < 2; ++half) {
+			__m128 lane[12];
+			for (int k = 0; k < 9; ++k)
+				lane[k] = half ? _mm256_extractf128_ps(c[k], 1) : _mm256_castps256_ps128(c[k]);
+
+			lane[9] = half ? _mm256_extractf128_ps(px, 1) : _mm256_castps256_ps128(px);
+			lane[10] = half ? _mm256_extractf128_ps(py, 1) : _mm256_castps256_ps128(py);
+			lane[11] = half ? _mm256_extractf128_ps(pz, 1) : _mm256_castps256_ps128(pz);
+
+			storeTransforms4(out + 16 * (i + 4 * half), lane[0], lane[1], lane[2],
+					lane[3], lane[4], lane[5], lane[6], lane[7], lane[8],
+					lane[9], lane[10], lane[11], nonTemporal);
+		}
+	}
+
+	if (nonTemporal)
+		_mm_sfence();
+
+	buildTransformsSSE41(instances, angle, i, end, out, nonTemporal);
+}
+
+static bool cpuSupports(TransformKernel kernel)
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 1);
+
+	bool sse41 = (info[2] & (1 << 19)) != 0;
+	if (kernel == TRANSFORM_KERNEL_SSE41)
+		return sse41;
+
+	// AVX state must be enabled by the OS as well (OSXSAVE + XCR0).
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!sse41 || !osxsave || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+
+	if (kernel == TRANSFORM_KERNEL_SSE41)
+		return __builtin_cpu_supports("sse4.1");
+
+	return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // TRANSFORM_KERNEL_X86
+
+bool transformKernelSupported(TransformKernel kernel)
+{
+	if (kernel == TRANSFORM_KERNEL_SCALAR)
+		return true;
+
+#ifdef TRANSFORM_KERNEL_X86
+	return cpuSupports(kernel);
+#else
+	return false;
+#endif
+}
+
+TransformKernel bestTransformKernel()
+{
+	static const TransformKernel best =
+		transformKernelSupported(TRANSFORM_KERNEL_AVX2) ? TRANSFORM_KERNEL_AVX2 :
+		transformKernelSupported(TRANSFORM_KERNEL_SSE41) ? TRANSFORM_KERNEL_SSE41 :
+		TRANSFORM_KERNEL_SCALAR;
+
+	return best;
+}
+
+const char* transformKernelName(TransformKernel kernel)
+{
+	switch (kernel) {
+	case TRANSFORM_KERNEL_SSE41:
+		return "sse4.1";
+	case TRANSFORM_KERNEL_AVX2:
+		return "avx2";
+	default:
+		return "scalar";
+	}
+}
+
+void buildTransforms(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out, bool nonTemporal, TransformKernel kernel)
+{
+	// Streaming stores need 16-byte alignment; every matrix is 64 bytes,
+	// so the base pointer decides for the whole range.
+	if ((uintptr_t)out & 15)
+		nonTemporal = false;
+
+#ifdef TRANSFORM_KERNEL_X86
+	if (kernel == TRANSFORM_KERNEL_AVX2) {
+		buildTransformsAVX2(instances, angle, begin, end, out, nonTemporal);
+		return;
+	}
+
+	if (kernel == TRANSFORM_KERNEL_SSE41) {
+		buildTransformsSSE41(instances, angle, begin, end, out, nonTemporal);
+		return;
+	}
+#endif
+
+	buildTransformsScalar(instances, angle, begin, end, out);
+}
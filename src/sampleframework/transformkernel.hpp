@@ -0,0 +1,47 @@
+#ifndef TRANSFORMKERNEL_H_
+#define TRANSFORMKERNEL_H_
+
+#include <cstddef>
+
+// Instance transforms in structure-of-arrays form. Null rotation or scale
+// arrays mean no per-instance rotation and unit scale.
+struct InstanceTransforms
+{
+	const float* x;
+	const float* y;
+	const float* z;
+
+	// Rotation about +Y in radians, added to the batch-wide angle.
+	const float* angle;
+
+	// Rotation as unit quaternions; used instead of angle when qx is set.
+	const float* qx;
+	const float* qy;
+	const float* qz;
+	const float* qw;
+
+	// Uniform scale.
+	const float* scale;
+};
+
+enum TransformKernel
+{
+	TRANSFORM_KERNEL_SCALAR,
+	TRANSFORM_KERNEL_SSE41,
+	TRANSFORM_KERNEL_AVX2,
+};
+
+// Widest kernel the CPU and OS support, detected once.
+TransformKernel bestTransformKernel();
+bool transformKernelSupported(TransformKernel kernel);
+const char* transformKernelName(TransformKernel kernel);
+
+// Writes M = T * R * S for instances [begin, end) as column-major 4x4
+// matrices, instance i at out + 16 * i, which is what the Ms texture buffer
+// expects. nonTemporal bypasses the cache for 16-byte aligned output, which
+// suits write-combined mapped GL buffers but not memory read back soon.
+void buildTransforms(const InstanceTransforms& instances, float angle,
+		size_t begin, size_t end, float* out, bool nonTemporal = false,
+		TransformKernel kernel = bestTransformKernel());
+
+#endif // TRANSFORMKERNEL_H_
@@ -0,0 +1,236 @@
+#include "vertexlayout.hpp"
+#include "halffloat.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char* const kFormatNames[] = {
+	"float", "quantized",
+};
+
+// In interleaving order.
+static const MeshAttribute kAttributes[] = {
+	MESH_ATTRIBUTE_POSITION, MESH_ATTRIBUTE_NORMAL, MESH_ATTRIBUTE_TEXCOORD, MESH_ATTRIBUTE_TANGENT,
+};
+
+static const int kLocations[] = {
+	VertexLayout::kPositionAttribute, VertexLayout::kNormalAttribute,
+	VertexLayout::kTexcoordAttribute, VertexLayout::kTangentAttribute,
+};
+
+static const int kFloatComponents[] = { 3, 3, 2, 4 };
+
+// Quantized: components, type and bytes taken.
+static const int kQuantizedComponents[] = { 3, 2, 2, 4 };
+static const VertexComponent kQuantizedTypes[] = {
+	VERTEX_COMPONENT_SNORM16, VERTEX_COMPONENT_SNORM16, VERTEX_COMPONENT_HALF, VERTEX_COMPONENT_SNORM_10_10_10_2,
+};
+static const uint32_t kQuantizedBytes[] = { 8, 4, 4, 4 };
+
+const char* vertexFormatName(VertexFormat format)
+{
+	return kFormatNames[format];
+}
+
+bool parseVertexFormat(const char* name, VertexFormat* format)
+{
+	for (int i = 0; i <= VERTEX_FORMAT_QUANTIZED; ++i) {
+		if (strcmp(name, kFormatNames[i]) == 0) {
+			*format = (VertexFormat)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+uint32_t vertexLayoutStride(uint32_t attributes, VertexFormat format)
+{
+	if (format == VERTEX_FORMAT_FLOAT)
+		return meshVertexStride(attributes);
+
+	uint32_t stride = 0;
+	for (int a = 0; a < 4; ++a) {
+		if (attributes & kAttributes[a])
+			stride += kQuantizedBytes[a];
+	}
+
+	return stride;
+}
+
+VertexLayout::VertexLayout()
+	: _attributes(0), _format(VERTEX_FORMAT_FLOAT), _stride(0), _attributeCount(0)
+{
+	for (int c = 0; c < 3; ++c) {
+		_positionOffset[c] = 0.0f;
+		_positionScale[c] = 1.0f;
+	}
+}
+
+void VertexLayout::init(uint32_t attributes, VertexFormat format, const float* boundsMin, const float* boundsMax)
+{
+	_attributes = attributes;
+	_format = format;
+	_stride = 0;
+	_attributeCount = 0;
+
+	for (int a = 0; a < 4; ++a) {
+		if (!(attributes & kAttributes[a]))
+			continue;
+
+		VertexAttributeLayout& layout = _layout[_attributeCount++];
+		layout.attribute = kAttributes[a];
+		layout.location = kLocations[a];
+		layout.offset = _stride;
+
+		if (format == VERTEX_FORMAT_FLOAT) {
+			layout.components = kFloatComponents[a];
+			layout.component = VERTEX_COMPONENT_FLOAT;
+			_stride += sizeof(float) * kFloatComponents[a];
+		}
+		else {
+			layout.components = kQuantizedComponents[a];
+			layout.component = kQuantizedTypes[a];
+			_stride += kQuantizedBytes[a];
+		}
+	}
+
+	for (int c = 0; c < 3; ++c) {
+		bool quantized = format == VERTEX_FORMAT_QUANTIZED;
+		_positionOffset[c] = quantized ? 0.5f * (boundsMin[c] + boundsMax[c]) : 0.0f;
+		_positionScale[c] = quantized ? 0.5f * (boundsMax[c] - boundsMin[c]) : 1.0f;
+	}
+
+	_vertexSource = "#define VERTEX_LAYOUT\n";
+	char line[128];
+
+	if (format == VERTEX_FORMAT_FLOAT) {
+		snprintf(line, sizeof(line), "layout(location = %d) in vec3 vertexPositionIn;\n", kPositionAttribute);
+		_vertexSource += line;
+		_vertexSource += "vec3 vertexPosition() { return vertexPositionIn; }\n";
+	}
+	else {
+		snprintf(line, sizeof(line), "layout(location = %d) in vec3 vertexPositionIn;\n", kPositionAttribute);
+		_vertexSource += line;
+		_vertexSource +=
+			"uniform vec3 vertexPositionOffset;\n"
+			"uniform vec3 vertexPositionScale;\n"
+			"vec3 vertexPosition() { return vertexPositionOffset + vertexPositionScale * vertexPositionIn; }\n";
+	}
+
+	if (attributes & MESH_ATTRIBUTE_NORMAL) {
+		snprintf(line, sizeof(line), "#define VERTEX_NORMAL\nlayout(location = %d) in %s vertexNormalIn;\n",
+				kNormalAttribute, format == VERTEX_FORMAT_FLOAT ? "vec3" : "vec2");
+		_vertexSource += line;
+
+		if (format == VERTEX_FORMAT_FLOAT) {
+			_vertexSource += "vec3 vertexNormal() { return vertexNormalIn; }\n";
+		}
+		else {
+			// The lower half of the octahedron is folded over the upper one.
+			_vertexSource +=
+				"vec3 vertexNormal()\n"
+				"{\n"
+				"	vec3 n = vec3(vertexNormalIn, 1.0 - abs(vertexNormalIn.x) - abs(vertexNormalIn.y));\n"
+				"	if (n.z < 0.0)\n"
+				"		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+				"	return normalize(n);\n"
+				"}\n";
+		}
+	}
+
+	if (attributes & MESH_ATTRIBUTE_TEXCOORD) {
+		snprintf(line, sizeof(line), "#define VERTEX_TEXCOORD\nlayout(location = %d) in vec2 vertexTexcoordIn;\n",
+				kTexcoordAttribute);
+		_vertexSource += line;
+		_vertexSource += "vec2 vertexTexcoord() { return vertexTexcoordIn; }\n";
+	}
+
+	if (attributes & MESH_ATTRIBUTE_TANGENT) {
+		snprintf(line, sizeof(line), "#define VERTEX_TANGENT\nlayout(location = %d) in vec4 vertexTangentIn;\n",
+				kTangentAttribute);
+		_vertexSource += line;
+		_vertexSource += format == VERTEX_FORMAT_FLOAT ?
+			"vec4 vertexTangent() { return vertexTangentIn; }\n" :
+			"vec4 vertexTangent() { return vec4(normalize(vertexTangentIn.xyz), vertexTangentIn.w < 0.0 ? -1.0 : 1.0); }\n";
+	}
+}
+
+void VertexLayout::init(const MeshFileHeader& header)
+{
+	init(header.attributes, (VertexFormat)header.vertexFormat, header.boundsMin, header.boundsMax);
+}
+
+// Normalized integers of bits bits, as GL 4.2 decodes them: c / (2^(bits-1) - 1).
+static int32_t snorm(float value, int bits)
+{
+	float limit = (float)((1 << (bits - 1)) - 1);
+	value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+	return (int32_t)std::floor(value * limit + 0.5f);
+}
+
+// Unit vector to the square [-1, 1]^2 of the octahedral mapping.
+static void octahedral(const float* n, float* e)
+{
+	float length = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	float x = length > 0.0f ? n[0] / length : 0.0f;
+	float y = length > 0.0f ? n[1] / length : 0.0f;
+
+	if (n[2] < 0.0f) {
+		float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = foldedX;
+		y = foldedY;
+	}
+
+	e[0] = x;
+	e[1] = y;
+}
+
+void VertexLayout::encode(const float* vertices, size_t count, void* out) const
+{
+	size_t floats = meshVertexStride(_attributes) / sizeof(float);
+	unsigned char* bytes = (unsigned char*)out;
+	memset(out, 0, count * _stride);
+
+	for (size_t v = 0; v < count; ++v) {
+		const float* vertex = vertices + v * floats;
+
+		for (int a = 0; a < _attributeCount; ++a) {
+			const VertexAttributeLayout& layout = _layout[a];
+			const float* value = vertex + meshAttributeOffset(_attributes, layout.attribute) / sizeof(float);
+			unsigned char* target = bytes + v * _stride + layout.offset;
+
+			if (layout.component == VERTEX_COMPONENT_FLOAT) {
+				memcpy(target, value, sizeof(float) * layout.components);
+			}
+			else if (layout.attribute == MESH_ATTRIBUTE_POSITION) {
+				int16_t q[3];
+				for (int c = 0; c < 3; ++c) {
+					float scale = _positionScale[c] > 0.0f ? _positionScale[c] : 1.0f;
+					q[c] = (int16_t)snorm((value[c] - _positionOffset[c]) / scale, 16);
+				}
+				memcpy(target, q, sizeof(q));
+			}
+			else if (layout.attribute == MESH_ATTRIBUTE_NORMAL) {
+				float e[2];
+				octahedral(value, e);
+				int16_t q[2] = { (int16_t)snorm(e[0], 16), (int16_t)snorm(e[1], 16) };
+				memcpy(target, q, sizeof(q));
+			}
+			else if (layout.attribute == MESH_ATTRIBUTE_TEXCOORD) {
+				uint16_t h[2] = { floatToHalf(value[0]), floatToHalf(value[1]) };
+				memcpy(target, h, sizeof(h));
+			}
+			else {
+				// x in the low bits, as GL_INT_2_10_10_10_REV.
+				uint32_t packed = (uint32_t)(snorm(value[0], 10) & 0x3ff) |
+					(uint32_t)(snorm(value[1], 10) & 0x3ff) << 10 |
+					(uint32_t)(snorm(value[2], 10) & 0x3ff) << 20 |
+					(uint32_t)(value[3] < 0.0f ? 3 : 1) << 30;
+				memcpy(target, &packed, sizeof(packed));
+			}
+		}
+	}
+}